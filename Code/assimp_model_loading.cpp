@@ -3,6 +3,10 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "engine.h"
+#include "assimp_model_loading.h"
+#include "glb_model_loading.h"
+#include "mesh_lod.h"
+#include "obj_model_loading.h"
 
 void ProcessAssimpMesh(const aiScene* scene, aiMesh *mesh, Mesh *myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
 {
@@ -87,6 +91,8 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh *mesh, Mesh *myMesh, u32 bas
     submesh.vertexBufferLayout = vertexBufferLayout;
     submesh.vertices.swap(vertices);
     submesh.indices.swap(indices);
+    ComputeSubmeshBounds(submesh);
+    GenerateSubmeshLods(submesh);
     myMesh->submeshes.push_back( submesh );
 }
 
@@ -128,21 +134,21 @@ void ProcessAssimpMaterial(App* app, aiMaterial *material, Material& myMaterial,
         material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
         String filename = MakeString(aiFilename.C_Str());
         String filepath = MakePath(directory, filename);
-        myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str);
+        myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str, TextureUsage_Linear);
     }
     if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
     {
         material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
         String filename = MakeString(aiFilename.C_Str());
         String filepath = MakePath(directory, filename);
-        myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str);
+        myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str, TextureUsage_Normal);
     }
     if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
     {
         material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
         String filename = MakeString(aiFilename.C_Str());
         String filepath = MakePath(directory, filename);
-        myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str);
+        myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str, TextureUsage_Linear);
     }
 
     //myMaterial.createNormalFromBump();
@@ -164,17 +170,22 @@ void ProcessAssimpNode(const aiScene* scene, aiNode *node, Mesh *myMesh, u32 bas
     }
 }
 
-u32 LoadModel(App* app, const char* filename)
+// Gathers the transform (relative to the root) of every node referencing each mesh
+static void CollectAssimpInstances(const aiNode* node, const glm::mat4& parentTransform, std::vector<std::vector<glm::mat4>>& meshInstances)
 {
-    const aiScene* scene = aiImportFile(filename,
-                                        aiProcess_Triangulate           |
-                                        aiProcess_GenSmoothNormals      |
-                                        aiProcess_CalcTangentSpace      |
-                                        aiProcess_JoinIdenticalVertices |
-                                        aiProcess_PreTransformVertices  |
-                                        aiProcess_ImproveCacheLocality  |
-                                        aiProcess_OptimizeMeshes        |
-                                        aiProcess_SortByPType);
+    // aiMatrix4x4 is row major
+    const glm::mat4 transform = parentTransform * glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        meshInstances[node->mMeshes[i]].push_back(transform);
+
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+        CollectAssimpInstances(node->mChildren[i], transform, meshInstances);
+}
+
+static u32 ImportAssimpModel(App* app, const char* filename, ModelImportMode mode)
+{
+    const aiScene* scene = aiImportFile(filename, mode == ModelImport_Instanced ? ASSIMP_MODEL_INSTANCED_IMPORT_FLAGS : ASSIMP_MODEL_IMPORT_FLAGS);
 
     if (!scene)
     {
@@ -202,47 +213,50 @@ u32 LoadModel(App* app, const char* filename)
         ProcessAssimpMaterial(app, scene->mMaterials[i], material, directory);
     }
 
-    ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
-
-    aiReleaseImport(scene);
-
-    u32 vertexBufferSize = 0;
-    u32 indexBufferSize = 0;
-
-    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    if (mode == ModelImport_Instanced)
     {
-        vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-        indexBufferSize  += mesh.submeshes[i].indices.size()  * sizeof(u32);
-    }
-
-    glGenBuffers(1, &mesh.vertexBufferHandle);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
+        // Each mesh becomes a single submesh, drawn once per node using it
+        std::vector<std::vector<glm::mat4>> meshInstances(scene->mNumMeshes);
+        CollectAssimpInstances(scene->mRootNode, glm::mat4(1.0f), meshInstances);
 
-    glGenBuffers(1, &mesh.indexBufferHandle);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
-
-    u32 indicesOffset = 0;
-    u32 verticesOffset = 0;
+        for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+        {
+            if (meshInstances[i].empty())
+                continue;
 
-    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+            AddInstanceBatch(model, (u32)mesh.submeshes.size(), meshInstances[i]);
+            ProcessAssimpMesh(scene, scene->mMeshes[i], &mesh, baseMeshMaterialIndex, model.materialIdx);
+        }
+    }
+    else
     {
-        const void* verticesData = mesh.submeshes[i].vertices.data();
-        const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-        glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-        mesh.submeshes[i].vertexOffset = verticesOffset;
-        verticesOffset += verticesSize;
-
-        const void* indicesData = mesh.submeshes[i].indices.data();
-        const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-        mesh.submeshes[i].indexOffset = indicesOffset;
-        indicesOffset += indicesSize;
+        ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
     }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    aiReleaseImport(scene);
+
+    UploadMesh(mesh);
+    if (!model.instanceBatches.empty())
+        UploadModelInstances(model, mesh);
+    ComputeModelBounds(app, model);
 
     return modelIdx;
-}
\ No newline at end of file
+}
+
+u32 LoadModel(App* app, const char* filename, ModelImportMode mode)
+{
+    // Formats with a native loader skip Assimp. OBJ files have no hierarchy to keep and glTF
+    // ones always keep it, so the import mode only matters for the rest
+    std::string extension = filename;
+    size_t dot = extension.find_last_of('.');
+    extension = dot == std::string::npos ? std::string() : extension.substr(dot);
+    for (char& c : extension)
+        c = (char)tolower(c);
+
+    if (extension == ".obj")
+        return LoadObjModel(app, filename);
+    if (extension == ".glb")
+        return LoadGlbModel(app, filename);
+
+    return ImportAssimpModel(app, filename, mode);
+}
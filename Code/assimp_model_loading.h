@@ -1,6 +1,22 @@
 #pragma once
-#include "platform.h"
+#include "engine.h"
 
-struct App;
+// Post processing applied to every model imported with Assimp
+#define ASSIMP_MODEL_IMPORT_FLAGS (aiProcess_Triangulate           | \
+                                   aiProcess_GenSmoothNormals      | \
+                                   aiProcess_CalcTangentSpace      | \
+                                   aiProcess_JoinIdenticalVertices | \
+                                   aiProcess_PreTransformVertices  | \
+                                   aiProcess_ImproveCacheLocality  | \
+                                   aiProcess_OptimizeMeshes        | \
+                                   aiProcess_SortByPType)
 
-u32 LoadModel(App* app, const char* filename);
\ No newline at end of file
+// Same without flattening the node hierarchy, for ModelImport_Instanced
+#define ASSIMP_MODEL_INSTANCED_IMPORT_FLAGS (ASSIMP_MODEL_IMPORT_FLAGS & ~(aiProcess_PreTransformVertices | aiProcess_OptimizeMeshes))
+
+/**
+ * Loads a model with the native loader for its format (.obj, .glb) or with Assimp for
+ * anything else. Assimp imports keep the node hierarchy as instance batches unless
+ * ModelImport_Flatten is passed. Returns the model index or UINT32_MAX on failure.
+ */
+u32 LoadModel(App* app, const char* filename, ModelImportMode mode = ModelImport_Instanced);
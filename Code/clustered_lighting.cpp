@@ -0,0 +1,229 @@
+#include "clustered_lighting.h"
+#include "job_system.h"
+#include "light_grid.h"
+
+#include <chrono>
+#include <float.h>
+#include <emmintrin.h>
+
+// Point lights in view space, structure of arrays padded to a multiple of 4 for SSE
+struct ClusterLightSoA
+{
+    std::vector<f32> x, y, z, range;
+    std::vector<u32> lightIdx;
+
+    void Push(vec3 position, f32 r, u32 idx)
+    {
+        x.push_back(position.x); y.push_back(position.y); z.push_back(position.z);
+        range.push_back(r);
+        lightIdx.push_back(idx);
+    }
+
+    void Pad()
+    {
+        // Far away with no range, never touches a cluster
+        while (x.size() % 4)
+            Push(vec3(FLT_MAX), 0.0f, UINT32_MAX);
+    }
+};
+
+static void GetClusterSliceDepths(const App* app, u32 slice, f32& nearDepth, f32& farDepth)
+{
+    const f32 nearSplit = glm::clamp(app->clusterNearDepth, app->zNear, app->zFar);
+    if (slice == 0)
+    {
+        nearDepth = app->zNear;
+        farDepth = nearSplit;
+        return;
+    }
+
+    const f32 ratio = app->zFar / nearSplit;
+    nearDepth = nearSplit * powf(ratio, (f32)(slice - 1) / (CLUSTER_GRID_Z - 1));
+    farDepth = nearSplit * powf(ratio, (f32)slice / (CLUSTER_GRID_Z - 1));
+}
+
+vec4 GetClusterDepthParams(const App* app)
+{
+    const f32 nearSplit = glm::clamp(app->clusterNearDepth, app->zNear, app->zFar);
+    return vec4(nearSplit, (CLUSTER_GRID_Z - 1) / logf(app->zFar / nearSplit), 0.0f, 0.0f);
+}
+
+static void BuildClusterBounds(App* app)
+{
+    app->clusterMin.resize(CLUSTER_COUNT);
+    app->clusterMax.resize(CLUSTER_COUNT);
+
+    // Symmetric perspective: a point at ndc (x, y) and depth d is (x d / P00, y d / P11, -d) in view space
+    const f32 scaleX = 1.0f / app->projection[0][0];
+    const f32 scaleY = 1.0f / app->projection[1][1];
+
+    for (u32 z = 0; z < CLUSTER_GRID_Z; ++z)
+    {
+        f32 depths[2];
+        GetClusterSliceDepths(app, z, depths[0], depths[1]);
+
+        for (u32 y = 0; y < CLUSTER_GRID_Y; ++y)
+        {
+            for (u32 x = 0; x < CLUSTER_GRID_X; ++x)
+            {
+                const vec2 ndcMin = vec2(-1.0f + 2.0f * x / CLUSTER_GRID_X, -1.0f + 2.0f * y / CLUSTER_GRID_Y);
+                const vec2 ndcMax = vec2(-1.0f + 2.0f * (x + 1) / CLUSTER_GRID_X, -1.0f + 2.0f * (y + 1) / CLUSTER_GRID_Y);
+
+                vec3 boundsMin = vec3(FLT_MAX);
+                vec3 boundsMax = vec3(-FLT_MAX);
+                for (f32 depth : depths)
+                {
+                    for (u32 corner = 0; corner < 4; ++corner)
+                    {
+                        const vec2 ndc = vec2(corner & 1 ? ndcMax.x : ndcMin.x, corner & 2 ? ndcMax.y : ndcMin.y);
+                        const vec3 point = vec3(ndc.x * depth * scaleX, ndc.y * depth * scaleY, -depth);
+                        boundsMin = glm::min(boundsMin, point);
+                        boundsMax = glm::max(boundsMax, point);
+                    }
+                }
+
+                const u32 clusterIdx = (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x;
+                app->clusterMin[clusterIdx] = boundsMin;
+                app->clusterMax[clusterIdx] = boundsMax;
+            }
+        }
+    }
+
+    app->clusterProjection = app->projection;
+}
+
+static void AssignClusterSlice(App* app, const ClusterLightSoA& lights, u32 slice)
+{
+    std::vector<u32>& indices = app->clusterSliceIndices[slice];
+    indices.clear();
+
+    f32 sliceNear, sliceFar;
+    GetClusterSliceDepths(app, slice, sliceNear, sliceFar);
+
+    // Lights reaching the depth range of the slice, the only ones tested against its clusters
+    ClusterLightSoA candidates;
+    for (u32 i = 0; i < lights.lightIdx.size(); ++i)
+    {
+        const f32 depth = -lights.z[i];
+        if (lights.lightIdx[i] != UINT32_MAX && depth + lights.range[i] >= sliceNear && depth - lights.range[i] <= sliceFar)
+            candidates.Push(vec3(lights.x[i], lights.y[i], lights.z[i]), lights.range[i], lights.lightIdx[i]);
+    }
+    candidates.Pad();
+
+    const __m128 zero = _mm_setzero_ps();
+    const u32 firstCluster = slice * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+    for (u32 clusterIdx = firstCluster; clusterIdx < firstCluster + CLUSTER_GRID_X * CLUSTER_GRID_Y; ++clusterIdx)
+    {
+        const vec3 boundsMin = app->clusterMin[clusterIdx];
+        const vec3 boundsMax = app->clusterMax[clusterIdx];
+        const __m128 minX = _mm_set1_ps(boundsMin.x), maxX = _mm_set1_ps(boundsMax.x);
+        const __m128 minY = _mm_set1_ps(boundsMin.y), maxY = _mm_set1_ps(boundsMax.y);
+        const __m128 minZ = _mm_set1_ps(boundsMin.z), maxZ = _mm_set1_ps(boundsMax.z);
+
+        const u32 first = (u32)indices.size();
+        for (u32 i = 0; i < candidates.x.size(); i += 4)
+        {
+            // Sphere against box: distance from the center to the closest point of the box
+            const __m128 x = _mm_loadu_ps(&candidates.x[i]);
+            const __m128 y = _mm_loadu_ps(&candidates.y[i]);
+            const __m128 z = _mm_loadu_ps(&candidates.z[i]);
+            const __m128 r = _mm_loadu_ps(&candidates.range[i]);
+            const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)), zero);
+            const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)), zero);
+            const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)), zero);
+            const __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+            const int touching = _mm_movemask_ps(_mm_cmple_ps(distanceSq, _mm_mul_ps(r, r)));
+            for (u32 lane = 0; lane < 4; ++lane)
+                if (touching & (1 << lane))
+                    indices.push_back(candidates.lightIdx[i + lane]);
+        }
+
+        // Offsets relative to the slice until the slices are concatenated
+        app->clusterLights[clusterIdx] = uvec2(first, (u32)indices.size() - first);
+    }
+}
+
+static void UploadStorageBuffer(GLuint handle, const void* data, u64 size)
+{
+    // Orphaned every frame, never empty so the bindings stay valid
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, handle);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max(size, (u64)16), NULL, GL_STREAM_DRAW);
+    if (size)
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+}
+
+void InitClusteredLighting(App* app)
+{
+    glGenBuffers(1, &app->clusterLightsBuffer);
+    glGenBuffers(1, &app->clusterLightIndexBuffer);
+
+    app->clusterLights.resize(CLUSTER_COUNT);
+    app->clusterSliceIndices.resize(CLUSTER_GRID_Z);
+}
+
+void UpdateClusteredLighting(App* app)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const Clock::time_point start = Clock::now();
+
+    if (app->clusterProjection != app->projection)
+        BuildClusterBounds(app);
+
+    // Only the point lights reaching the view are assigned and uploaded
+    const Clock::time_point cullStart = Clock::now();
+    std::vector<u32> visibleLights;
+    QueryLightsInFrustum(app->lightGrid, app->projection * app->view, visibleLights);
+    app->lightCullMs = std::chrono::duration<f32, std::milli>(Clock::now() - cullStart).count();
+
+    // The index lists point straight into the light buffer (light_buffer.h)
+    ClusterLightSoA viewLights;
+    for (u32 i : visibleLights)
+    {
+        const Light& light = app->lights[i];
+        const vec3 viewPosition = vec3(app->view * vec4(light.position, 1.0f));
+        viewLights.Push(viewPosition, light.range, i);
+    }
+
+    ParallelFor(CLUSTER_GRID_Z, 1, [app, &viewLights](u32 begin, u32 end)
+    {
+        for (u32 slice = begin; slice < end; ++slice)
+            AssignClusterSlice(app, viewLights, slice);
+    });
+
+    app->clusterLightIndices.clear();
+    app->clusterMaxLights = 0;
+    for (u32 slice = 0; slice < CLUSTER_GRID_Z; ++slice)
+    {
+        const u32 sliceOffset = (u32)app->clusterLightIndices.size();
+        const u32 firstCluster = slice * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+        for (u32 clusterIdx = firstCluster; clusterIdx < firstCluster + CLUSTER_GRID_X * CLUSTER_GRID_Y; ++clusterIdx)
+        {
+            app->clusterLights[clusterIdx].x += sliceOffset;
+            app->clusterMaxLights = glm::max(app->clusterMaxLights, app->clusterLights[clusterIdx].y);
+        }
+
+        const std::vector<u32>& sliceIndices = app->clusterSliceIndices[slice];
+        app->clusterLightIndices.insert(app->clusterLightIndices.end(), sliceIndices.begin(), sliceIndices.end());
+    }
+
+    UploadStorageBuffer(app->clusterLightsBuffer, app->clusterLights.data(), app->clusterLights.size() * sizeof(uvec2));
+    UploadStorageBuffer(app->clusterLightIndexBuffer, app->clusterLightIndices.data(), app->clusterLightIndices.size() * sizeof(u32));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, app->clusterLightsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, app->clusterLightIndexBuffer);
+
+    app->clusterPointLights = (u32)visibleLights.size();
+    app->clusterAssignMs = std::chrono::duration<f32, std::milli>(Clock::now() - start).count() - app->lightCullMs;
+}
+
+void AddRandomPointLights(App* app, u32 count, vec3 boxMin, vec3 boxMax, f32 range)
+{
+    for (u32 i = 0; i < count; ++i)
+    {
+        const vec3 t = vec3(rand(), rand(), rand()) / (f32)RAND_MAX;
+        const vec3 color = vec3(rand(), rand(), rand()) / (f32)RAND_MAX;
+        AddLight(app, LIGHT_POINT, color, vec3(0.0f), glm::mix(boxMin, boxMax, t), range);
+    }
+}
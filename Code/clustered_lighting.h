@@ -0,0 +1,36 @@
+//
+// clustered_lighting.h: Clustered forward lighting. The view frustum is split in
+// CLUSTER_GRID_X x CLUSTER_GRID_Y tiles on screen and CLUSTER_GRID_Z exponential slices in
+// depth. Every frame the point lights are assigned to the clusters their range touches on the
+// job system, four lights at a time with SSE, and the per cluster ranges and the light index
+// lists are uploaded as SSBOs. The indices point into the light buffer (light_buffer.h).
+// Fragments only loop over the lights of their cluster.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Creates the SSBOs the lit programs read the clusters from.
+ */
+void InitClusteredLighting(App* app);
+
+/**
+ * Rebuilds the cluster bounds if the projection changed, assigns the point lights of
+ * App::lights to the clusters, uploads the result and binds the SSBOs. Called once per frame
+ * from Update(), after the view matrix is set.
+ */
+void UpdateClusteredLighting(App* app);
+
+/**
+ * Parameters the shaders need to find the cluster of a fragment: x: end of the first slice,
+ * y: slices per log unit of depth after it.
+ */
+vec4 GetClusterDepthParams(const App* app);
+
+/**
+ * Adds count point lights of random colors at random places inside the box, to stress the
+ * light assignment.
+ */
+void AddRandomPointLights(App* app, u32 count, vec3 boxMin, vec3 boxMax, f32 range);
@@ -0,0 +1,112 @@
+#include "deferred_shading.h"
+#include "depth_prepass.h"
+#include "tiled_light_culling.h"
+
+void InitDeferredShading(App* app)
+{
+    app->gbufferAlbedoHandle = CreateAttachmentTexture(GL_RGBA8, app->displaySize, GL_RGBA, GL_UNSIGNED_BYTE);
+    app->gbufferNormalHandle = CreateAttachmentTexture(GL_RG16, app->displaySize, GL_RG, GL_UNSIGNED_SHORT);
+
+    // Emissive goes straight to the color attachment, the lights are added on top of it
+    glGenFramebuffers(1, &app->gbufferFramebufferHandle);
+    glBindFramebuffer(GL_FRAMEBUFFER, app->gbufferFramebufferHandle);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, app->gbufferAlbedoHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, app->gbufferNormalHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, app->colorAttachmentHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, app->depthAttachmentHandle, 0);
+    CheckFramebufferStatus();
+
+    // No depth attachment: the lighting pass samples the depth texture
+    glGenFramebuffers(1, &app->lightingFramebufferHandle);
+    glBindFramebuffer(GL_FRAMEBUFFER, app->lightingFramebufferHandle);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, app->colorAttachmentHandle, 0);
+    CheckFramebufferStatus();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    app->deferredLightingProgramIdx = LoadProgram(app, "shaders.glsl", "DEFERRED_LIGHTING");
+    InitTiledLightCulling(app);
+
+    glGenQueries(ARRAY_COUNT(app->scenePassQueries), app->scenePassQueries);
+}
+
+void RenderDeferred(App* app)
+{
+    // Geometry: the color attachment and depth were cleared in Update()
+    glBindFramebuffer(GL_FRAMEBUFFER, app->gbufferFramebufferHandle);
+    GLenum gbufferDrawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(ARRAY_COUNT(gbufferDrawBuffers), gbufferDrawBuffers);
+
+    const f32 zero[4] = {};
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, zero);
+
+    const bool depthPrepass = BeginDepthPrepass(app, ShaderFeature_GBuffer);
+    DrawGameObjects(app, ShaderFeature_GBuffer);
+    if (depthPrepass)
+        EndDepthPrepass();
+
+    // The depth is complete, the lights can be culled against it
+    const bool tiled = app->tiledLightCulling && DispatchTiledLightCulling(app);
+
+    // Lighting: once per covered pixel, added to the emissive
+    glBindFramebuffer(GL_FRAMEBUFFER, app->lightingFramebufferHandle);
+    GLenum lightingDrawBuffers[] = { GL_COLOR_ATTACHMENT0 };
+    glDrawBuffers(ARRAY_COUNT(lightingDrawBuffers), lightingDrawBuffers);
+    glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    const Program& program = app->programs[tiled ? app->deferredTiledLightingProgramIdx : app->deferredLightingProgramIdx];
+    glUseProgram(program.handle);
+    glUniform1i(GetUniformLocation(program, "uAlbedo"), 0);
+    glUniform1i(GetUniformLocation(program, "uNormal"), 1);
+    glUniform1i(GetUniformLocation(program, "uDepth"), 2);
+    const glm::mat4 inverseViewProjection = glm::inverse(app->projection * app->view);
+    glUniformMatrix4fv(GetUniformLocation(program, "uInverseViewProjection"), 1, GL_FALSE, value_ptr(inverseViewProjection));
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, app->gbufferAlbedoHandle);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, app->gbufferNormalHandle);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, app->depthAttachmentHandle);
+
+    glBindVertexArray(app->vaoQuad);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    glBindVertexArray(0);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glUseProgram(0);
+}
+
+void BeginScenePassTimer(App* app)
+{
+    // The query of this slot was issued ARRAY_COUNT(scenePassQueries) frames ago
+    const u32 slot = app->scenePassQueryFrame % ARRAY_COUNT(app->scenePassQueries);
+    const GLuint query = app->scenePassQueries[slot];
+    if (app->scenePassQueryFrame >= ARRAY_COUNT(app->scenePassQueries))
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+            app->scenePassGpuMs[app->scenePassQueryMode[slot]] = (f32)(elapsedNs / 1.0e6);
+        }
+    }
+
+    app->scenePassQueryMode[slot] = app->mode;
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void EndScenePassTimer(App* app)
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    app->scenePassQueryFrame++;
+}
@@ -0,0 +1,31 @@
+//
+// deferred_shading.h: Deferred shading for Mode_Deferred. The scene is drawn once into a
+// compact G-buffer (RGBA8 albedo, octahedral RG16 normals, emissive in the color attachment
+// and the shared depth attachment; positions are reconstructed from depth) and lit by a single
+// full-screen pass, so the lighting cost depends on the pixels and not on the scene. The GPU
+// time of the scene pass is measured with timer queries for both modes to compare them.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Creates the G-buffer and lighting framebuffers on the attachments of InitFramebuffer(),
+ * loads the DEFERRED_LIGHTING programs, the tiled light culling and the timer queries.
+ */
+void InitDeferredShading(App* app);
+
+/**
+ * Draws the game objects into the G-buffer with the GBUFFER variants and lights it into the
+ * color attachment, with the point lights of the clusters or, if App::tiledLightCulling, of
+ * the depth tiles. The GlobalParams block has to be bound already.
+ */
+void RenderDeferred(App* app);
+
+/**
+ * Start / end of the GPU timer of the scene pass. The result is read a few frames later into
+ * App::scenePassGpuMs of the mode that was drawn.
+ */
+void BeginScenePassTimer(App* app);
+void EndScenePassTimer(App* app);
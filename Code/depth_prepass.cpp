@@ -0,0 +1,74 @@
+#include "depth_prepass.h"
+#include "impostor.h"
+
+void InitDepthPrepass(App* app)
+{
+    app->depthPrepassProgramIdx = LoadProgram(app, "shaders.glsl", "DEPTH_PREPASS");
+    app->depthPrepassInstancedProgramIdx = LoadProgram(app, "shaders.glsl", "DEPTH_PREPASS", "#define INSTANCED\n");
+}
+
+bool BeginDepthPrepass(App* app, u32 passFeatures)
+{
+    const Program& program = app->programs[app->depthPrepassProgramIdx];
+    const Program& instancedProgram = app->programs[app->depthPrepassInstancedProgramIdx];
+    if (!app->depthPrepass || !program.handle || program.pending || !instancedProgram.handle || instancedProgram.pending)
+        return false;
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
+    {
+        const GameObject& gameObject = app->gameObjects[i];
+        glBindBufferRange(GL_UNIFORM_BUFFER, 1, app->cbuffer.handle, gameObject.blockOffset, sizeof(glm::mat4) * 2);
+
+        Model& model = app->models[gameObject.modelIdx];
+        Mesh& mesh = app->meshes[model.meshIdx];
+
+        // Same program as the shading pass, its depth comes from the fragment shader
+        if (gameObject.lod == MESH_LOD_IMPOSTOR)
+        {
+            DrawImpostor(app, model, (passFeatures & ShaderFeature_GBuffer) != 0);
+            continue;
+        }
+
+        const bool instanced = !model.instanceBatches.empty();
+        const Program& depthProgram = instanced ? instancedProgram : program;
+        glUseProgram(depthProgram.handle);
+
+        const u32 drawCount = instanced ? (u32)model.instanceBatches.size() : (u32)mesh.submeshes.size();
+        for (u32 d = 0; d < drawCount; ++d)
+        {
+            const u32 submeshIdx = instanced ? model.instanceBatches[d].submeshIdx : d;
+            glBindVertexArray(FindVAO(mesh, submeshIdx, depthProgram));
+
+            // The LOD of DrawGameObjects(), other triangles would fail the equal test
+            const Submesh& submesh = mesh.submeshes[submeshIdx];
+            const u32 lod = glm::min(gameObject.lod, (u32)submesh.lods.size());
+            const u32 indexCount = lod ? submesh.lods[lod - 1].indexCount : submesh.indexCount;
+            const u32 indexOffset = lod ? submesh.lods[lod - 1].indexOffset : submesh.indexOffset;
+
+            if (instanced)
+            {
+                const InstanceBatch& batch = model.instanceBatches[d];
+                glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, submesh.indexType, (void*)(u64)indexOffset,
+                                                    batch.instanceCount, batch.firstInstance);
+            }
+            else
+            {
+                glDrawElements(GL_TRIANGLES, indexCount, submesh.indexType, (void*)(u64)indexOffset);
+            }
+        }
+    }
+    glBindVertexArray(0);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    return true;
+}
+
+void EndDepthPrepass()
+{
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+}
@@ -0,0 +1,27 @@
+//
+// depth_prepass.h: Optional depth-only pass before the shading pass of either mode. The game
+// objects are drawn with the DEPTH_PREPASS programs, which only read the packed position stream
+// of the submeshes (Submesh::positionOffset), and the shading pass then tests with GL_EQUAL
+// without writing depth, so each pixel runs the expensive fragment shader once.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Loads the DEPTH_PREPASS programs.
+ */
+void InitDepthPrepass(App* app);
+
+/**
+ * If App::depthPrepass, draws the depth of the game objects into the bound framebuffer, with the
+ * same LODs as DrawGameObjects() and impostors of the pass features, and leaves the depth test
+ * at GL_EQUAL without writes. Returns false, drawing nothing, when disabled or still compiling.
+ */
+bool BeginDepthPrepass(App* app, u32 passFeatures);
+
+/**
+ * Restores the depth test changed by BeginDepthPrepass(), after the shading pass.
+ */
+void EndDepthPrepass();
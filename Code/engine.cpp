@@ -9,103 +9,244 @@
 #include <imgui.h>
 #include <stb_image.h>
 #include <stb_image_write.h>
+#include <bitset>
 
 #include "assimp_model_loading.h"
 #include "buffer_management.h"
-
-GLuint CreateProgramFromSource(String programSource, const char* shaderName)
+#include "clustered_lighting.h"
+#include "deferred_shading.h"
+#include "depth_prepass.h"
+#include "impostor.h"
+#include "job_system.h"
+#include "light_buffer.h"
+#include "light_grid.h"
+#include "mesh_lod.h"
+#include "obj_model_loading.h"
+#include "program_cache.h"
+#include "shader_hot_reload.h"
+#include "shader_variants.h"
+#include "shadow_atlas.h"
+#include "texture_compression.h"
+#include "texture_container.h"
+#include "texture_streaming.h"
+#include "texture_atlas.h"
+#include "world_streaming.h"
+
+// GL_KHR_parallel_shader_compile (and its ARB twin), newer than the generated glad loader
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR           0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+static void InitParallelShaderCompile(App* app)
 {
-    GLchar  infoLogBuffer[1024] = {};
-    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
-    GLsizei infoLogSize;
-    GLint   success;
+    for (const std::string& extension : app->openGLInfo.glExtensions)
+    {
+        if (extension != "GL_KHR_parallel_shader_compile" && extension != "GL_ARB_parallel_shader_compile")
+            continue;
+
+        PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)
+            GetGLProcAddress(extension == "GL_KHR_parallel_shader_compile" ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB");
+        if (!glMaxShaderCompilerThreadsKHR)
+            continue;
+
+        // All the threads the driver wants to use, it knows the core count better
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        app->parallelShaderCompile = true;
+        ILOG("Parallel shader compilation with %s", extension.c_str());
+        return;
+    }
+}
 
+static GLuint StartShaderCompile(GLenum type, String programSource, const char* shaderName, const char* defines, const char* stageDefine)
+{
     char versionString[] = "#version 430\n";
     char shaderNameDefine[128];
     sprintf(shaderNameDefine, "#define %s\n", shaderName);
-    char vertexShaderDefine[] = "#define VERTEX\n";
-    char fragmentShaderDefine[] = "#define FRAGMENT\n";
 
-    const GLchar* vertexShaderSource[] = {
-        versionString,
-        shaderNameDefine,
-        vertexShaderDefine,
-        programSource.str
-    };
-    const GLint vertexShaderLengths[] = {
-        (GLint) strlen(versionString),
-        (GLint) strlen(shaderNameDefine),
-        (GLint) strlen(vertexShaderDefine),
-        (GLint) programSource.len
-    };
-    const GLchar* fragmentShaderSource[] = {
+    const GLchar* shaderSource[] = {
         versionString,
         shaderNameDefine,
-        fragmentShaderDefine,
+        defines,
+        stageDefine,
         programSource.str
     };
-    const GLint fragmentShaderLengths[] = {
+    const GLint shaderLengths[] = {
         (GLint) strlen(versionString),
         (GLint) strlen(shaderNameDefine),
-        (GLint) strlen(fragmentShaderDefine),
+        (GLint) strlen(defines),
+        (GLint) strlen(stageDefine),
         (GLint) programSource.len
     };
 
-    GLuint vshader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vshader, ARRAY_COUNT(vertexShaderSource), vertexShaderSource, vertexShaderLengths);
-    glCompileShader(vshader);
-    glGetShaderiv(vshader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, ARRAY_COUNT(shaderSource), shaderSource, shaderLengths);
+    glCompileShader(shader);
+    return shader;
+}
+
+ProgramCompile StartProgramCompile(String programSource, const char* shaderName, const char* defines)
+{
+    ProgramCompile compile = {};
+    compile.programHandle = glCreateProgram();
+
+    // Compute programs are the ones asking for it, the define is also their stage define
+    if (strstr(defines, "#define COMPUTE\n"))
     {
-        glGetShaderInfoLog(vshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-        ELOG("glCompileShader() failed with vertex shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+        compile.computeShader = StartShaderCompile(GL_COMPUTE_SHADER, programSource, shaderName, defines, "");
+        glAttachShader(compile.programHandle, compile.computeShader);
     }
+    else
+    {
+        compile.vertexShader = StartShaderCompile(GL_VERTEX_SHADER, programSource, shaderName, defines, "#define VERTEX\n");
+        compile.fragmentShader = StartShaderCompile(GL_FRAGMENT_SHADER, programSource, shaderName, defines, "#define FRAGMENT\n");
+        glAttachShader(compile.programHandle, compile.vertexShader);
+        glAttachShader(compile.programHandle, compile.fragmentShader);
+    }
+
+    glProgramParameteri(compile.programHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); // For the program cache
+    glLinkProgram(compile.programHandle);
+
+    return compile;
+}
+
+static void FinishShaderCompile(GLuint programHandle, GLuint& shader, const char* stageName, const char* shaderName)
+{
+    if (!shader)
+        return;
 
-    GLuint fshader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fshader, ARRAY_COUNT(fragmentShaderSource), fragmentShaderSource, fragmentShaderLengths);
-    glCompileShader(fshader);
-    glGetShaderiv(fshader, GL_COMPILE_STATUS, &success);
+    GLchar infoLogBuffer[1024] = {};
+    GLsizei infoLogSize;
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(fshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-        ELOG("glCompileShader() failed with fragment shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+        glGetShaderInfoLog(shader, sizeof(infoLogBuffer), &infoLogSize, infoLogBuffer);
+        ELOG("glCompileShader() failed with %s shader %s\nReported message:\n%s\n", stageName, shaderName, infoLogBuffer);
     }
 
-    GLuint programHandle = glCreateProgram();
-    glAttachShader(programHandle, vshader);
-    glAttachShader(programHandle, fshader);
-    glLinkProgram(programHandle);
-    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+    glDetachShader(programHandle, shader);
+    glDeleteShader(shader);
+    shader = 0;
+}
+
+bool FinishProgramCompile(ProgramCompile& compile, const char* shaderName)
+{
+    GLchar  infoLogBuffer[1024] = {};
+    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
+    GLsizei infoLogSize;
+    GLint   success;
+
+    glGetProgramiv(compile.programHandle, GL_LINK_STATUS, &success);
+
+    FinishShaderCompile(compile.programHandle, compile.vertexShader, "vertex", shaderName);
+    FinishShaderCompile(compile.programHandle, compile.fragmentShader, "fragment", shaderName);
+    FinishShaderCompile(compile.programHandle, compile.computeShader, "compute", shaderName);
+
     if (!success)
     {
-        glGetProgramInfoLog(programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        glGetProgramInfoLog(compile.programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
         ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
     }
 
-    glUseProgram(0);
+    return success != 0;
+}
+
+bool IsProgramCompileDone(const App* app, const ProgramCompile& compile)
+{
+    if (!app->parallelShaderCompile)
+        return true;
+
+    // The link waits for the shaders, so the program completing covers them
+    GLint completed = GL_FALSE;
+    glGetProgramiv(compile.programHandle, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed != GL_FALSE;
+}
+
+GLuint CreateProgramFromSource(String programSource, const char* shaderName)
+{
+    ProgramCompile compile = StartProgramCompile(programSource, shaderName);
+    FinishProgramCompile(compile, shaderName);
 
-    glDetachShader(programHandle, vshader);
-    glDetachShader(programHandle, fshader);
-    glDeleteShader(vshader);
-    glDeleteShader(fshader);
+    glUseProgram(0);
 
-    return programHandle;
+    return compile.programHandle;
 }
 
-u32 LoadProgram(App* app, const char* filepath, const char* programName)
+u32 LoadProgram(App* app, const char* filepath, const char* programName, const char* defines)
 {
     String programSource = ReadTextFile(filepath);
 
     Program program = {};
-    program.handle = CreateProgramFromSource(programSource, programName);
     program.filepath = filepath;
     program.programName = programName;
+    program.defines = defines;
     program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+
+    // Programs restored from the cache are pending too, with no shaders, to be reflected
+    // once the caller has stored their index
+    PendingProgram pending = {};
+    pending.programIdx = app->programs.size();
+    pending.compile.programHandle = LoadCachedProgram(app, programSource, filepath, programName, defines, pending.cacheKey);
+    if (!pending.compile.programHandle)
+    {
+        // Only submitted, the status is queried once every program has been
+        pending.compile = StartProgramCompile(programSource, programName, defines);
+    }
+    pending.sourceTimestamp = program.lastWriteTimestamp;
+    app->pendingPrograms.push_back(pending);
+
+    program.handle = pending.compile.programHandle;
+    program.pending = true;
     app->programs.push_back(program);
 
     return app->programs.size() - 1;
 }
 
+static void FinishProgramLoad(App* app, PendingProgram& pending)
+{
+    Program& program = app->programs[pending.programIdx];
+    program.pending = false;
+
+    if (pending.compile.vertexShader || pending.compile.computeShader)
+    {
+        app->programCacheMisses++;
+        if (!FinishProgramCompile(pending.compile, program.programName.c_str()))
+        {
+            // Nothing is drawn with it, shader variants fall back to their uber program
+            glDeleteProgram(program.handle);
+            program.handle = 0;
+            return;
+        }
+        SaveCachedProgram(app, program, pending.cacheKey);
+    }
+
+    ReflectProgram(program);
+    QueryProgramUniforms(app, pending.programIdx);
+}
+
+void FinishProgramLoads(App* app)
+{
+    for (PendingProgram& pending : app->pendingPrograms)
+        FinishProgramLoad(app, pending);
+    app->pendingPrograms.clear();
+}
+
+void PollProgramLoads(App* app)
+{
+    for (u32 i = 0; i < app->pendingPrograms.size(); )
+    {
+        if (IsProgramCompileDone(app, app->pendingPrograms[i].compile))
+        {
+            FinishProgramLoad(app, app->pendingPrograms[i]);
+            app->pendingPrograms.erase(app->pendingPrograms.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
 Image LoadImage(const char* filename)
 {
     Image img = {};
@@ -127,58 +268,289 @@ void FreeImage(Image image)
     stbi_image_free(image.pixels);
 }
 
-GLuint CreateTexture2DFromImage(Image image)
+GLenum GetTextureInternalFormat(BlockFormat format, i32 nchannels)
 {
-    GLenum internalFormat = GL_RGB8;
-    GLenum dataFormat     = GL_RGB;
-    GLenum dataType       = GL_UNSIGNED_BYTE;
+    if (format != BlockFormat_None)
+        return GetBlockFormatInternalFormat(format);
 
-    switch (image.nchannels)
+    switch (nchannels)
     {
-        case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; break;
-        case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
+        case 3: return GL_RGB8;
+        case 4: return GL_RGBA8;
         default: ELOG("LoadTexture2D() - Unsupported number of channels");
     }
+    return GL_RGB8;
+}
+
+void UploadTextureLevel(BlockFormat format, i32 nchannels, GLint level, const MipLevel& mip, const u8* data)
+{
+    const GLenum internalFormat = GetTextureInternalFormat(format, nchannels);
+
+    if (format != BlockFormat_None)
+    {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, mip.size.x, mip.size.y, 0, mip.dataSize, data + mip.offset);
+    }
+    else
+    {
+        const GLenum dataFormat = nchannels == 4 ? GL_RGBA : GL_RGB;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Mip rows are tightly packed
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, mip.size.x, mip.size.y, 0, dataFormat, GL_UNSIGNED_BYTE, data + mip.offset);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+}
+
+GLuint CreateTexture2DFromLevels(BlockFormat format, i32 nchannels, const MipLevel* levels, u32 mipCount, const u8* data, u32 firstMip)
+{
+    firstMip = glm::min(firstMip, mipCount - 1);
+    const GLsizei levelCount = (GLsizei)(mipCount - firstMip);
 
     GLuint texHandle;
     glGenTextures(1, &texHandle);
     glBindTexture(GL_TEXTURE_2D, texHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    for (GLsizei level = 0; level < levelCount; ++level)
+        UploadTextureLevel(format, nchannels, level, levels[firstMip + level], data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glGenerateMipmap(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, 0);
 
     return texHandle;
 }
 
-u32 LoadTexture2D(App* app, const char* filepath)
+// Decodes the source image, builds its mips, compresses them and stores the result in a
+// texture container so the next loads can skip all of it
+static bool CookTexture(App* app, const char* filepath, const char* containerPath, u64 sourceTimestamp, u32 cookSettings, TextureUsage usage)
+{
+    Image image = LoadImage(filepath);
+    if (!image.pixels)
+        return false;
+
+    MipChain chain = GenerateMipChain(image, usage, app->textureMipFilter);
+    FreeImage(image);
+
+    BlockFormat format = app->compressTextures ? ChooseBlockFormat(chain, usage, app->textureCompressionQuality) : BlockFormat_None;
+
+    if (format != BlockFormat_None)
+    {
+        CompressedTexture compressed = CompressMipChain(chain, format, app->textureCompressionQuality);
+        ILOG("Compressed %s to %s (PSNR %.2f dB)", filepath, GetBlockFormatName(format), compressed.psnr);
+        return WriteTextureContainer(containerPath, sourceTimestamp, cookSettings, usage, format, chain.nchannels, compressed.levels, compressed.data.data());
+    }
+
+    return WriteTextureContainer(containerPath, sourceTimestamp, cookSettings, usage, format, chain.nchannels, chain.levels, chain.data.data());
+}
+
+u32 LoadTexture2D(App* app, const char* filepath, TextureUsage usage)
 {
     for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
-        if (app->textures[texIdx].filepath == filepath)
+        if (app->textures[texIdx].filepath == filepath && app->textures[texIdx].usage == usage)
             return texIdx;
 
-    Image image = LoadImage(filepath);
+    const std::string containerPath = GetTextureContainerPath(filepath, usage);
+    const u64 sourceTimestamp = GetFileLastWriteTimestamp(filepath);
+    const u32 cookSettings = GetTextureCookSettings(app->compressTextures, app->textureCompressionQuality, app->textureMipFilter);
 
-    if (image.pixels)
+    TextureContainer container;
+    if (!OpenTextureContainer(containerPath.c_str(), sourceTimestamp, cookSettings, usage, container))
     {
-        Texture tex = {};
-        tex.handle = CreateTexture2DFromImage(image);
-        tex.filepath = filepath;
+        if (!CookTexture(app, filepath, containerPath.c_str(), sourceTimestamp, cookSettings, usage) ||
+            !OpenTextureContainer(containerPath.c_str(), sourceTimestamp, cookSettings, usage, container))
+        {
+            ELOG("Could not load texture %s", filepath);
+            return UINT32_MAX;
+        }
+    }
+
+    const TextureContainerHeader& header = *container.header;
+
+    Texture tex = {};
+    tex.filepath = filepath;
+    tex.usage = usage;
+    tex.format = (BlockFormat)header.format;
+    tex.nchannels = header.nchannels;
+    tex.size = ivec2(header.width, header.height);
+    tex.mipCount = header.mipCount;
+    tex.residentMip = app->textureStreaming ? GetInitialStreamingMip(container) : 0;
+    tex.wantedMip = tex.residentMip;
+    tex.handle = CreateTexture2DFromLevels(tex.format, tex.nchannels, container.levels, header.mipCount, container.payload, tex.residentMip);
+
+    if (tex.residentMip > 0)
+        tex.container = container.file; // Keep it mapped, the rest of the levels stream from it
+    else
+        CloseTextureContainer(container);
+
+    app->textureStreamingResidentBytes += GetTextureResidentBytes(tex);
+    app->textureAtlasDirty |= IsAtlasCandidate(tex);
 
-        u32 texIdx = app->textures.size();
-        app->textures.push_back(tex);
+    u32 texIdx = app->textures.size();
+    app->textures.push_back(tex);
 
-        FreeImage(image);
-        return texIdx;
+    return texIdx;
+}
+
+void ComputeSubmeshBounds(Submesh& submesh)
+{
+    const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    const u32 floatStride = layout.stride / sizeof(float);
+    const u32 vertexCount = floatStride ? (u32)submesh.vertices.size() / floatStride : 0;
+
+    i32 texCoordOffset = -1;
+    for (const VertexBufferAttribute& attribute : layout.attributes)
+        if (attribute.location == 2)
+            texCoordOffset = attribute.offset / sizeof(float);
+
+    vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        vec3 position = glm::make_vec3(&submesh.vertices[i * floatStride]);
+        minPos = glm::min(minPos, position);
+        maxPos = glm::max(maxPos, position);
     }
-    else
+
+    submesh.boundsCenter = vertexCount ? (minPos + maxPos) * 0.5f : vec3(0.0f);
+    submesh.boundsRadius = 0.0f;
+    for (u32 i = 0; i < vertexCount; ++i)
+        submesh.boundsRadius = glm::max(submesh.boundsRadius, glm::distance(submesh.boundsCenter, glm::make_vec3(&submesh.vertices[i * floatStride])));
+
+    // Ratio between the area the triangles take in texture space and in object space
+    f64 uvArea = 0.0, worldArea = 0.0;
+    if (texCoordOffset >= 0)
     {
-        return UINT32_MAX;
+        for (u32 i = 0; i + 2 < submesh.indices.size(); i += 3)
+        {
+            const float* v0 = &submesh.vertices[submesh.indices[i + 0] * floatStride];
+            const float* v1 = &submesh.vertices[submesh.indices[i + 1] * floatStride];
+            const float* v2 = &submesh.vertices[submesh.indices[i + 2] * floatStride];
+
+            vec3 edge0 = glm::make_vec3(v1) - glm::make_vec3(v0);
+            vec3 edge1 = glm::make_vec3(v2) - glm::make_vec3(v0);
+            worldArea += 0.5 * glm::length(glm::cross(edge0, edge1));
+
+            vec2 uvEdge0 = glm::make_vec2(v1 + texCoordOffset) - glm::make_vec2(v0 + texCoordOffset);
+            vec2 uvEdge1 = glm::make_vec2(v2 + texCoordOffset) - glm::make_vec2(v0 + texCoordOffset);
+            uvArea += 0.5 * fabs(uvEdge0.x * uvEdge1.y - uvEdge0.y * uvEdge1.x);
+        }
+    }
+    submesh.uvDensity = worldArea > 0.0 ? (f32)sqrt(uvArea / worldArea) : 0.0f;
+}
+
+// Positions (location 0) out of the interleaved vertices
+static std::vector<vec3> GetSubmeshPositions(const Submesh& submesh)
+{
+    const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    const u32 floatStride = layout.stride / sizeof(float);
+    const u32 vertexCount = floatStride ? (u32)submesh.vertices.size() / floatStride : 0;
+
+    u32 positionOffset = 0;
+    for (const VertexBufferAttribute& attribute : layout.attributes)
+        if (attribute.location == 0)
+            positionOffset = attribute.offset / sizeof(float);
+
+    std::vector<vec3> positions(vertexCount);
+    for (u32 i = 0; i < vertexCount; ++i)
+        positions[i] = glm::make_vec3(&submesh.vertices[i * floatStride + positionOffset]);
+    return positions;
+}
+
+void UploadMesh(Mesh& mesh)
+{
+    u32 vertexBufferSize = 0;
+    u32 indexBufferSize = 0;
+    u32 positionsSize = 0;
+
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        const u32 floatStride = submesh.vertexBufferLayout.stride / sizeof(float);
+        vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
+        positionsSize += floatStride ? (u32)submesh.vertices.size() / floatStride * sizeof(vec3) : 0;
+        indexBufferSize  += mesh.submeshes[i].indices.size()  * sizeof(u32);
+        for (const SubmeshLod& lod : mesh.submeshes[i].lods)
+            indexBufferSize += lod.indices.size() * sizeof(u32);
     }
+
+    glGenBuffers(1, &mesh.vertexBufferHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
+    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize + positionsSize, NULL, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &mesh.indexBufferHandle);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
+
+    u32 indicesOffset = 0;
+    u32 verticesOffset = 0;
+    u32 positionsOffset = vertexBufferSize; // The position streams follow the interleaved vertices
+
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const void* verticesData = mesh.submeshes[i].vertices.data();
+        const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
+        glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
+        mesh.submeshes[i].vertexOffset = verticesOffset;
+        verticesOffset += verticesSize;
+
+        // Depth-only passes fetch 12 bytes per vertex instead of the whole interleaved vertex
+        const std::vector<vec3> positions = GetSubmeshPositions(mesh.submeshes[i]);
+        glBufferSubData(GL_ARRAY_BUFFER, positionsOffset, positions.size() * sizeof(vec3), positions.data());
+        mesh.submeshes[i].positionOffset = positionsOffset;
+        positionsOffset += positions.size() * sizeof(vec3);
+
+        const void* indicesData = mesh.submeshes[i].indices.data();
+        const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
+        mesh.submeshes[i].indexOffset = indicesOffset;
+        mesh.submeshes[i].indexCount = (u32)mesh.submeshes[i].indices.size();
+        mesh.submeshes[i].indexType = GL_UNSIGNED_INT;
+        indicesOffset += indicesSize;
+
+        for (SubmeshLod& lod : mesh.submeshes[i].lods)
+        {
+            const u32 lodIndicesSize = lod.indices.size() * sizeof(u32);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, lodIndicesSize, lod.indices.data());
+            lod.indexOffset = indicesOffset;
+            lod.indexCount = (u32)lod.indices.size();
+            indicesOffset += lodIndicesSize;
+        }
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void FreeMesh(Mesh& mesh)
+{
+    for (Submesh& submesh : mesh.submeshes)
+        for (const Vao& vao : submesh.vaos)
+            glDeleteVertexArrays(1, &vao.handle);
+
+    // GLB meshes use a single buffer for vertices and indices
+    if (mesh.indexBufferHandle != mesh.vertexBufferHandle)
+        glDeleteBuffers(1, &mesh.indexBufferHandle);
+    glDeleteBuffers(1, &mesh.vertexBufferHandle);
+    glDeleteBuffers(1, &mesh.instanceBufferHandle);
+
+    mesh = Mesh{};
+}
+
+void AddInstanceBatch(Model& model, u32 submeshIdx, const std::vector<glm::mat4>& transforms)
+{
+    InstanceBatch batch = {};
+    batch.submeshIdx = submeshIdx;
+    batch.firstInstance = (u32)model.instanceTransforms.size();
+    batch.instanceCount = (u32)transforms.size();
+    model.instanceBatches.push_back(batch);
+    model.instanceTransforms.insert(model.instanceTransforms.end(), transforms.begin(), transforms.end());
+}
+
+void UploadModelInstances(const Model& model, Mesh& mesh)
+{
+    glGenBuffers(1, &mesh.instanceBufferHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.instanceBufferHandle);
+    glBufferData(GL_ARRAY_BUFFER, model.instanceTransforms.size() * sizeof(glm::mat4), model.instanceTransforms.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
@@ -199,26 +571,55 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
 
+    // Programs reading nothing but the positions (depth passes) use the packed position stream
+    bool positionOnly = true;
+    for (const VertexShaderAttribute& input : program.vertexInputLayout.attributes)
+        if (input.location != 0 && (input.location < INSTANCE_TRANSFORM_LOCATION || input.location >= INSTANCE_TRANSFORM_LOCATION + 4))
+            positionOnly = false;
+
     //we have to link all vertex inputs attributes to attributes in the vertex buffer
     for (u32 i = 0; i < program.vertexInputLayout.attributes.size(); ++i)
     {
         bool attributeWasLinked = false;
 
-        for (u32 j = 0; j < submesh.vertexBufferLayout.attributes.size(); ++j)
+        if (positionOnly && program.vertexInputLayout.attributes[i].location == 0)
+        {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)(u64)submesh.positionOffset);
+            glEnableVertexAttribArray(0);
+            attributeWasLinked = true;
+        }
+
+        for (u32 j = 0; j < submesh.vertexBufferLayout.attributes.size() && !attributeWasLinked; ++j)
         {
             if (program.vertexInputLayout.attributes[i].location == submesh.vertexBufferLayout.attributes[j].location)
             {
-                const u32 index = submesh.vertexBufferLayout.attributes[j].location;
-                const u32 ncomp = submesh.vertexBufferLayout.attributes[j].componentCount;
-                const u32 offset = submesh.vertexBufferLayout.attributes[j].offset + submesh.vertexOffset;;
-                const u32 stride = submesh.vertexBufferLayout.stride;
-                glVertexAttribPointer(index, ncomp, GL_FLOAT, GL_FALSE, stride, (void*)(u64)offset);
+                const VertexBufferAttribute& attribute = submesh.vertexBufferLayout.attributes[j];
+                const u32 index = attribute.location;
+                const u32 ncomp = attribute.componentCount;
+                const u32 offset = attribute.offset + submesh.vertexOffset;
+                const u32 stride = attribute.stride ? attribute.stride : submesh.vertexBufferLayout.stride;
+                glVertexAttribPointer(index, ncomp, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE, stride, (void*)(u64)offset);
                 glEnableVertexAttribArray(index);
 
                 attributeWasLinked = true;
                 break;
             }
         }
+
+        // Instance transform columns come from the instance buffer, advancing once per instance
+        const u32 location = program.vertexInputLayout.attributes[i].location;
+        if (!attributeWasLinked && mesh.instanceBufferHandle &&
+            location >= INSTANCE_TRANSFORM_LOCATION && location < INSTANCE_TRANSFORM_LOCATION + 4)
+        {
+            const u32 column = location - INSTANCE_TRANSFORM_LOCATION;
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.instanceBufferHandle);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(u64)(column * sizeof(vec4)));
+            glVertexAttribDivisor(location, 1);
+            glEnableVertexAttribArray(location);
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
+
+            attributeWasLinked = true;
+        }
         assert(attributeWasLinked); //The submesh should provide an attribute for each vertex inputs
     }
 
@@ -232,14 +633,178 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
 
 }
 
+// Fills the vertex input layout of the program with its active attributes. Matrices take
+// one location per column.
+static void ReflectVertexInputs(Program& program)
+{
+    program.vertexInputLayout.attributes.clear();
+
+    int attributeCount = 0;
+    glGetProgramiv(program.handle, GL_ACTIVE_ATTRIBUTES, &attributeCount);
+
+    for (int i = 0; i < attributeCount; ++i)
+    {
+        GLchar attribName[100];
+        int attribNameLength = 0, attribSize = 0;
+        GLenum attribType;
+
+        glGetActiveAttrib(program.handle, i, ARRAY_COUNT(attribName)
+        ,&attribNameLength,&attribSize,&attribType,attribName);
+
+        int attributeLocation = glGetAttribLocation(program.handle, attribName);
+        if (attributeLocation < 0) // Built-ins like gl_VertexID
+            continue;
+
+        u8 componentCount = 1, columnCount = 1;
+        switch (attribType)
+        {
+            case GL_FLOAT_VEC2: componentCount = 2; break;
+            case GL_FLOAT_VEC3: componentCount = 3; break;
+            case GL_FLOAT_VEC4: componentCount = 4; break;
+            case GL_FLOAT_MAT4: componentCount = 4; columnCount = 4; break;
+            default:;
+        }
+
+        for (u8 column = 0; column < columnCount; ++column)
+            program.vertexInputLayout.attributes.push_back({(u8)(attributeLocation + column), componentCount});
+    }
+}
+
+static std::string GetProgramResourceName(GLuint programHandle, GLenum interfaceType, GLuint index)
+{
+    GLchar name[256];
+    GLsizei nameLength = 0;
+    glGetProgramResourceName(programHandle, interfaceType, index, ARRAY_COUNT(name), &nameLength, name);
+    return std::string(name, nameLength);
+}
+
+static void ReflectBlocks(Program& program, GLenum blockInterface, GLenum memberInterface, std::vector<ProgramBlock*>& blocksByIndex)
+{
+    GLint blockCount = 0;
+    glGetProgramInterfaceiv(program.handle, blockInterface, GL_ACTIVE_RESOURCES, &blockCount);
+
+    blocksByIndex.assign(blockCount, NULL);
+    for (GLint i = 0; i < blockCount; ++i)
+    {
+        const GLenum properties[] = { GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+        GLint values[ARRAY_COUNT(properties)];
+        glGetProgramResourceiv(program.handle, blockInterface, i, ARRAY_COUNT(properties), properties, ARRAY_COUNT(values), NULL, values);
+
+        ProgramBlock& block = program.blocks[GetProgramResourceName(program.handle, blockInterface, i)];
+        block.interfaceType = blockInterface;
+        block.binding = values[0];
+        block.dataSize = values[1];
+        blocksByIndex[i] = &block;
+    }
+
+    // Members of uniform blocks are listed with the uniforms, handled by ReflectUniforms()
+    if (memberInterface != GL_BUFFER_VARIABLE)
+        return;
+
+    GLint memberCount = 0;
+    glGetProgramInterfaceiv(program.handle, memberInterface, GL_ACTIVE_RESOURCES, &memberCount);
+    for (GLint i = 0; i < memberCount; ++i)
+    {
+        const GLenum properties[] = { GL_BLOCK_INDEX, GL_TYPE, GL_ARRAY_SIZE, GL_OFFSET, GL_ARRAY_STRIDE };
+        GLint values[ARRAY_COUNT(properties)];
+        glGetProgramResourceiv(program.handle, memberInterface, i, ARRAY_COUNT(properties), properties, ARRAY_COUNT(values), NULL, values);
+        if (values[0] < 0 || values[0] >= blockCount)
+            continue;
+
+        ProgramUniform member = { -1, (GLenum)values[1], values[2], values[3], values[4] };
+        blocksByIndex[values[0]]->members[GetProgramResourceName(program.handle, memberInterface, i)] = member;
+    }
+}
+
+static void ReflectUniforms(Program& program, const std::vector<ProgramBlock*>& uniformBlocksByIndex)
+{
+    GLint uniformCount = 0;
+    glGetProgramInterfaceiv(program.handle, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+
+    for (GLint i = 0; i < uniformCount; ++i)
+    {
+        const GLenum properties[] = { GL_BLOCK_INDEX, GL_TYPE, GL_ARRAY_SIZE, GL_OFFSET, GL_ARRAY_STRIDE, GL_LOCATION };
+        GLint values[ARRAY_COUNT(properties)];
+        glGetProgramResourceiv(program.handle, GL_UNIFORM, i, ARRAY_COUNT(properties), properties, ARRAY_COUNT(values), NULL, values);
+
+        std::string name = GetProgramResourceName(program.handle, GL_UNIFORM, i);
+        ProgramUniform uniform = { values[5], (GLenum)values[1], values[2], values[3], values[4] };
+
+        if (values[0] >= 0 && values[0] < (GLint)uniformBlocksByIndex.size())
+        {
+            uniform.location = -1;
+            uniformBlocksByIndex[values[0]]->members[name] = uniform;
+        }
+        else
+        {
+            // Arrays are reported as "uName[0]", looked up by "uName" like glGetUniformLocation()
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                name.resize(name.size() - 3);
+            uniform.offset = -1;
+            program.uniforms[name] = uniform;
+        }
+    }
+}
+
+void ReflectProgram(Program& program)
+{
+    program.uniforms.clear();
+    program.blocks.clear();
+
+    ReflectVertexInputs(program);
+
+    std::vector<ProgramBlock*> uniformBlocksByIndex;
+    std::vector<ProgramBlock*> storageBlocksByIndex;
+    ReflectBlocks(program, GL_UNIFORM_BLOCK, GL_UNIFORM, uniformBlocksByIndex);
+    ReflectBlocks(program, GL_SHADER_STORAGE_BLOCK, GL_BUFFER_VARIABLE, storageBlocksByIndex);
+    ReflectUniforms(program, uniformBlocksByIndex);
+}
+
+GLint GetUniformLocation(const Program& program, const char* name)
+{
+    auto it = program.uniforms.find(name);
+    return it != program.uniforms.end() ? it->second.location : -1;
+}
+
+const ProgramBlock* GetProgramBlock(const Program& program, const char* name)
+{
+    auto it = program.blocks.find(name);
+    return it != program.blocks.end() ? &it->second : NULL;
+}
+
+void QueryProgramUniforms(App* app, u32 programIdx)
+{
+    const Program& program = app->programs[programIdx];
+
+    if (IsShaderVariant(app->texturedMeshVariants, programIdx))
+    {
+        MeshProgramUniforms& uniforms = app->texturedMeshUniforms[programIdx];
+        uniforms.uTexture = GetUniformLocation(program, "uTexture");
+        uniforms.uAlbedoUvTransform = GetUniformLocation(program, "uAlbedoUvTransform");
+        uniforms.uAlbedo = GetUniformLocation(program, "uAlbedo");
+        uniforms.uEmissive = GetUniformLocation(program, "uEmissive");
+        uniforms.uFeatures = GetUniformLocation(program, "uFeatures");
+    }
+    if (programIdx == app->drawFramebufferProgramIdx)
+    {
+        app->drawFramebufferProgram = program;
+        app->programUniformTexture = GetUniformLocation(program, "uTexture"); //This right here does wacky stuff
+
+        if (app->programUniformTexture == GL_INVALID_VALUE || app->programUniformTexture == GL_INVALID_OPERATION)
+        {
+            //log("Fucky stuff wit da program texture");
+            ILOG("ProgramUniformTexture loaded incorrectly");
+        }
+    }
+}
+
 void Init(App* app)
 {
     //Get OpenGL info
-    //const unsigned char* a = ;
-    app->openGLInfo.glVersion = *glGetString(GL_VERSION);
-    app->openGLInfo.glRenderer = *glGetString(GL_RENDERER);
-    app->openGLInfo.glVendor = *glGetString(GL_VENDOR);
-    app->openGLInfo.glShadingLenguageVersion = *glGetString(GL_SHADING_LANGUAGE_VERSION);
+    app->openGLInfo.glVersion = (const char*)glGetString(GL_VERSION);
+    app->openGLInfo.glRenderer = (const char*)glGetString(GL_RENDERER);
+    app->openGLInfo.glVendor = (const char*)glGetString(GL_VENDOR);
+    app->openGLInfo.glShadingLenguageVersion = (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION);
 
     GLint numExtensions;
     glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
@@ -251,6 +816,12 @@ void Init(App* app)
         app->openGLInfo.glExtensions.push_back((const char*)glGetStringi(GL_EXTENSIONS, GLuint(i)));
     }
 
+    InitParallelShaderCompile(app);
+
+    InitJobSystem();
+    InitClusteredLighting(app);
+    InitLightBuffer(app);
+
     //initiate view matrix
 
     app->camera.target = vec3(0.0f);
@@ -268,13 +839,14 @@ void Init(App* app)
     app->world = TransformPositionScale(vec3(0.f,1.f,0.f),vec3(1.f)); //arbitrary position of the model, later should take th entitie's position
     app->worldViewProjection = app->projection * app->view * app->world;
 
+    app->gameObjects.resize(3);
     app->gameObjects[0].transform.matrix = TransformPositionScale(vec3(0.f, 1.f, 0.f), vec3(1.f));
     app->gameObjects[1].transform.matrix = TransformPositionScale(vec3(10.f, 0.f, 0.f), vec3(1.f));
     app->gameObjects[2].transform.matrix = TransformPositionScale(vec3(0.f, 0.f, 10.f), vec3(1.f));
-    app->activeGameObjects = 3;
 
-    AddLight(app, LIGHT_DIRECTIONAL, vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 0));
-    AddLight(app, LIGHT_POINT, vec3(1, 0, 0), vec3(0, 1, 0), vec3(10, 10, 0));
+    // Directions are the way the light travels
+    AddLight(app, LIGHT_DIRECTIONAL, vec3(0.8f), normalize(vec3(-0.3f, -1.0f, -0.5f)), vec3(0, 0, 0), 10.0f, true);
+    AddLight(app, LIGHT_POINT, vec3(1, 0, 0), vec3(0, 1, 0), vec3(10, 10, 0), 20.0f, true);
 
     app->mode = Mode::Mode_TexturedMesh; //Define what mode of draw we use
 
@@ -294,49 +866,71 @@ void Init(App* app)
             break;
         }
         case Mode_TexturedMesh:
+        case Mode_Deferred:
         {
             app->patrickTexIdx = LoadModel(app, "Patrick/Patrick.obj");
+            for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
+                app->gameObjects[i].modelIdx = app->patrickTexIdx;
 
-            app->texturedMeshProgramIdx = LoadProgram(app, "shaders.glsl", "TEXTURED_GEOMETRY");
-            Program& texturedMeshProgram = app->programs[app->texturedMeshProgramIdx];
-            
-            int attributeCount = 0;
-            glGetProgramiv(texturedMeshProgram.handle, GL_ACTIVE_ATTRIBUTES, &attributeCount);
+            // Variants are compiled the first time a material needs them
+            InitShaderVariants(app, app->texturedMeshVariants, "shaders.glsl", "TEXTURED_GEOMETRY", ShaderFeature_AlbedoMap | ShaderFeature_Emissive);
 
-            for (int i = 0; i < attributeCount; ++i)
-            {
-                GLchar attribName[100];
-                int attribNameLength = 0, attribSize = 0;
-                GLenum attribType;
-
-                glGetActiveAttrib(texturedMeshProgram.handle, i, ARRAY_COUNT(attribName)
-                ,&attribNameLength,&attribSize,&attribType,attribName);
-
-                int attributeLocation = glGetAttribLocation(texturedMeshProgram.handle, attribName);
-
-                texturedMeshProgram.vertexInputLayout.attributes.push_back({(u8)attributeLocation,(u8)attribSize});
-            }
+            // Impostor baking (one per model) and far field drawing
+            app->impostorBakeProgramIdx = LoadProgram(app, "shaders.glsl", "IMPOSTOR_BAKE");
+            app->impostorBakeInstancedProgramIdx = LoadProgram(app, "shaders.glsl", "IMPOSTOR_BAKE_INSTANCED");
+            app->impostorProgramIdx = LoadProgram(app, "shaders.glsl", "IMPOSTOR");
+            app->impostorGBufferProgramIdx = LoadProgram(app, "shaders.glsl", "IMPOSTOR", "#define GBUFFER\n");
+            glGenVertexArrays(1, &app->impostorVao);
 
             //Uniforms initialization
             
             glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &app->maxUniformBufferSize);
             glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &app->uniformBlockAlignment);
 
-            app->cbuffer = CreateConstantBuffer(app->maxUniformBufferSize);
+            // Each game object takes an aligned block, streamed worlds can have thousands of them
+            app->cbuffer = CreateConstantBuffer(glm::max((u32)app->maxUniformBufferSize, (u32)MB(1)));
+
+            // Both modes share the scene, they can be switched from the GUI
+            InitDeferredShading(app);
+            InitDepthPrepass(app);
+            InitShadowAtlas(app);
 
             break;
         }
     }
 
+    // Every program of the mode has been submitted, the driver compiled them meanwhile
+    FinishProgramLoads(app);
+
     app->diceTexIdx = LoadTexture2D(app, "dice.png");
     app->whiteTexIdx = LoadTexture2D(app, "color_white.png");
     app->blackTexIdx = LoadTexture2D(app, "color_black.png");
-    app->normalTexIdx = LoadTexture2D(app, "color_normal.png");
+    app->normalTexIdx = LoadTexture2D(app, "color_normal.png", TextureUsage_Normal);
     app->magentaTexIdx = LoadTexture2D(app, "color_magenta.png");
 
+    BuildTextureAtlas(app);
+
+    if (app->mode == Mode_TexturedMesh || app->mode == Mode_Deferred)
+    {
+        // After the atlas, the bake samples the albedo the same way the meshes do
+        BakeImpostor(app, app->patrickTexIdx);
+
+        // Only the cell list, the cells load around the camera from Update()
+        LoadWorldManifest(app, "world/world.json");
+    }
+
     
 }
 
+void Shutdown(App* app)
+{
+    for (Texture& texture : app->textures)
+        UnmapFile(texture.container);
+
+    ShutdownWorldStreaming(app);
+    ShutdownJobSystem();
+}
+
 void InitQuad(App* app)
 {
     //Init verts and indices to draw quad
@@ -375,50 +969,27 @@ void InitQuad(App* app)
     glBindVertexArray(0);
 
     
+    // Uniforms are queried from FinishProgramLoads()
     app->drawFramebufferProgramIdx = LoadProgram(app, "shaders.glsl", "DRAW_FRAMEBUFFER");
-
-    app->drawFramebufferProgram = app->programs[app->drawFramebufferProgramIdx];
-
-
-    app->programUniformTexture = glGetUniformLocation(app->drawFramebufferProgram.handle, "uTexture"); //This right here does wacky stuff
-
-    if (app->programUniformTexture == GL_INVALID_VALUE || app->programUniformTexture == GL_INVALID_OPERATION)
-    {
-        //log("Fucky stuff wit da program texture");
-        ILOG("ProgramUniformTexture loaded incorrectly");
-    }
 }
 
-void InitFramebuffer(App* app)
+GLuint CreateAttachmentTexture(GLenum internalFormat, ivec2 size, GLenum format, GLenum type)
 {
-    app->colorAttachmentHandle;
-    glGenTextures(1, &app->colorAttachmentHandle);
-    glBindTexture(GL_TEXTURE_2D, app->colorAttachmentHandle);
-    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,app->displaySize.x,app->displaySize.y,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    app->depthAttachmentHandle;
-    glGenTextures(1, &app->depthAttachmentHandle);
-    glBindTexture(GL_TEXTURE_2D, app->depthAttachmentHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, app->displaySize.x, app->displaySize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    GLuint textureHandle;
+    glGenTextures(1, &textureHandle);
+    glBindTexture(GL_TEXTURE_2D, textureHandle);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size.x, size.y, 0, format, type, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glBindTexture(GL_TEXTURE_2D, 0);
+    return textureHandle;
+}
 
-    app->framebufferHandle;
-    glGenFramebuffers(1, &app->framebufferHandle);
-    glBindFramebuffer(GL_FRAMEBUFFER, app->framebufferHandle);
-    glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0, app->colorAttachmentHandle,0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, app->depthAttachmentHandle, 0);
-
+bool CheckFramebufferStatus()
+{
     GLenum framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (framebufferStatus != GL_FRAMEBUFFER_COMPLETE)
     {
@@ -434,7 +1005,23 @@ void InitFramebuffer(App* app)
             case GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS: ELOG("GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS"); break;
             default: ELOG("Unknown framebuffer status error");
         }
+        return false;
     }
+    return true;
+}
+
+void InitFramebuffer(App* app)
+{
+    app->colorAttachmentHandle = CreateAttachmentTexture(GL_RGBA8, app->displaySize, GL_RGBA, GL_UNSIGNED_BYTE);
+    app->depthAttachmentHandle = CreateAttachmentTexture(GL_DEPTH_COMPONENT24, app->displaySize, GL_DEPTH_COMPONENT, GL_FLOAT);
+
+    app->framebufferHandle;
+    glGenFramebuffers(1, &app->framebufferHandle);
+    glBindFramebuffer(GL_FRAMEBUFFER, app->framebufferHandle);
+    glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0, app->colorAttachmentHandle,0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, app->depthAttachmentHandle, 0);
+
+    CheckFramebufferStatus();
 
     glDrawBuffers(1, &app->colorAttachmentHandle);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -455,6 +1042,16 @@ void Gui(App* app)
 
         if (ImGui::BeginMenu("GLInfo"))
         {
+            ImGui::Text("Version: %s", app->openGLInfo.glVersion.c_str());
+            ImGui::Text("Renderer: %s", app->openGLInfo.glRenderer.c_str());
+            ImGui::Text("Vendor: %s", app->openGLInfo.glVendor.c_str());
+            ImGui::Text("GLSL: %s", app->openGLInfo.glShadingLenguageVersion.c_str());
+            ImGui::Text("Program cache: %u hits, %u compiled", app->programCacheHits, app->programCacheMisses);
+            ImGui::Checkbox("Shader hot reload", &app->shaderHotReload);
+            ImGui::Text("Programs reloaded: %u", app->programReloadCount);
+            ImGui::Text("Textured mesh variants: %u", (u32)app->texturedMeshVariants.programs.size());
+            ImGui::Checkbox("Uber shader fallback", &app->uberShaderFallback);
+            ImGui::Text("Uber shader draws: %u", app->uberShaderDraws);
 
             ImGui::EndMenu();
         }
@@ -480,6 +1077,136 @@ void Gui(App* app)
 
         ImGui::End();
     }
+
+    if (ImGui::Begin("Texture Import"))
+    {
+        // Part of the cook settings, textures loaded from then on are cooked again with it
+        int mipFilter = app->textureMipFilter;
+        ImGui::RadioButton("Box mips", &mipFilter, MipFilter_Box);
+        ImGui::SameLine();
+        ImGui::RadioButton("Kaiser mips", &mipFilter, MipFilter_Kaiser);
+        app->textureMipFilter = (MipFilter)mipFilter;
+
+        ImGui::End();
+    }
+
+    if (ImGui::Begin("Texture Streaming"))
+    {
+        int budgetMB = app->textureStreamingBudget / MB(1);
+        ImGui::Text("Resident: %.2f MB", app->textureStreamingResidentBytes / (f64)MB(1));
+        if (ImGui::SliderInt("Budget (MB)", &budgetMB, 1, 1024))
+            app->textureStreamingBudget = (u32)budgetMB * MB(1);
+
+        ImGui::End();
+    }
+
+    if (ImGui::Begin("Model Loading"))
+    {
+        if (ImGui::Button("Benchmark OBJ import"))
+            BenchmarkObjImport("Patrick/Patrick.obj", 10, app->objImportNativeMs, app->objImportAssimpMs);
+
+        ImGui::Text("Native: %.3f ms", app->objImportNativeMs);
+        ImGui::Text("Assimp: %.3f ms", app->objImportAssimpMs);
+
+        ImGui::End();
+    }
+
+    if (ImGui::Begin("World Streaming"))
+    {
+        u32 residentCells = 0;
+        for (u32 cellIdx : app->worldActiveCells)
+            residentCells += app->worldCells[cellIdx].residency == WorldResidency_Resident;
+
+        ImGui::Text("Cells: %u resident, %u loading, %u total", residentCells, (u32)app->worldActiveCells.size() - residentCells, (u32)app->worldCells.size());
+        ImGui::Text("CPU: %.1f / %.1f MB", app->worldCpuBytes / (f32)MB(1), app->worldCpuBudget / (f32)MB(1));
+        ImGui::Text("GPU: %.1f / %.1f MB", app->worldGpuBytes / (f32)MB(1), app->worldGpuBudget / (f32)MB(1));
+        ImGui::SliderFloat("Load radius", &app->worldLoadRadius, app->worldCellSize, 1000.0f);
+        ImGui::SliderFloat("Prefetch (s)", &app->worldPrefetchSeconds, 0.0f, 10.0f);
+
+        int cpuBudgetMB = (int)(app->worldCpuBudget / MB(1));
+        if (ImGui::SliderInt("CPU budget (MB)", &cpuBudgetMB, 1, 4096))
+            app->worldCpuBudget = (u64)cpuBudgetMB * MB(1);
+        int gpuBudgetMB = (int)(app->worldGpuBudget / MB(1));
+        if (ImGui::SliderInt("GPU budget (MB)", &gpuBudgetMB, 1, 4096))
+            app->worldGpuBudget = (u64)gpuBudgetMB * MB(1);
+
+        ImGui::End();
+    }
+
+    if (ImGui::Begin("Lights"))
+    {
+        ImGui::Text("Point lights: %u, %u visible", (u32)app->lightGrid.lightIdx.size(), app->clusterPointLights);
+        ImGui::Text("Light grid: %.3f ms, view culling: %.3f ms", app->lightGridBuildMs, app->lightCullMs);
+        ImGui::Text("Light buffer: %u bytes in %u uploads", app->lightBufferUploadedBytes, app->lightBufferUploads);
+        ImGui::Text("Clusters: %u x %u x %u", CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z);
+        ImGui::Text("Light indices: %u, most in a cluster: %u", (u32)app->clusterLightIndices.size(), app->clusterMaxLights);
+        ImGui::Text("Assignment: %.3f ms", app->clusterAssignMs);
+        ImGui::SliderFloat("First slice depth", &app->clusterNearDepth, app->zNear, 50.0f);
+        if (ImGui::IsItemEdited())
+            app->clusterProjection = glm::mat4(0.0f); // Rebuild the cluster bounds
+
+        if (ImGui::Button("Add 1000 point lights"))
+            AddRandomPointLights(app, 1000, vec3(-100.0f, 0.0f, -100.0f), vec3(100.0f, 20.0f, 100.0f), 8.0f);
+
+        const LightBenchmark& benchmark = app->lightBenchmark;
+        if (!benchmark.running && ImGui::Button("Benchmark 10000 moving point lights"))
+            StartLightBenchmark(app, 10000, vec3(-200.0f, 0.0f, -200.0f), vec3(200.0f, 20.0f, 200.0f), 8.0f);
+        if (benchmark.running && benchmark.frame > 1)
+        {
+            const f32 frames = (f32)glm::min(benchmark.frame - 1, (u32)LIGHT_BENCHMARK_FRAMES);
+            ImGui::Text("Benchmark (%u frames): grid %.3f ms, culling %.3f ms, clusters %.3f ms", (u32)frames,
+                        benchmark.gridMs / frames, benchmark.cullMs / frames, benchmark.assignMs / frames);
+        }
+
+        if (app->mode != Mode_TexturedQuad)
+        {
+            // Same scene and lights, only the shading path changes
+            ImGui::Separator();
+            int mode = app->mode;
+            ImGui::RadioButton("Forward", &mode, Mode_TexturedMesh);
+            ImGui::SameLine();
+            ImGui::RadioButton("Deferred", &mode, Mode_Deferred);
+            app->mode = (Mode)mode;
+            ImGui::Checkbox("Tiled light culling on the GPU (deferred)", &app->tiledLightCulling);
+            ImGui::Checkbox("Depth prepass (shade visible fragments once)", &app->depthPrepass);
+
+            ImGui::Separator();
+            ImGui::Checkbox("Shadows", &app->shadows);
+            ImGui::Text("Shadow views: %u, atlas cells used: %u / %u", (u32)app->shadowViews.size(),
+                        (u32)std::bitset<64>(app->shadowAtlasCells).count(), (u32)(SHADOW_ATLAS_SIZE / SHADOW_CELL_SIZE) * (SHADOW_ATLAS_SIZE / SHADOW_CELL_SIZE));
+            ImGui::Text("Rendered: %u static views, %u dynamic", app->shadowStaticViewsRendered, app->shadowDynamicViewsRendered);
+            ImGui::Text("Cascades fitted: %u, splits:", app->shadowCascadesFitted);
+            for (f32 split : app->shadowCascadeSplits)
+            {
+                ImGui::SameLine();
+                ImGui::Text("%.1f", split);
+            }
+            if (app->shadowLightsOutOfAtlas)
+                ImGui::Text("%u shadowed lights don't fit the atlas", app->shadowLightsOutOfAtlas);
+            ImGui::Text("Scene pass GPU: forward %.3f ms, deferred %.3f ms",
+                        app->scenePassGpuMs[Mode_TexturedMesh], app->scenePassGpuMs[Mode_Deferred]);
+        }
+
+        ImGui::End();
+    }
+
+    if (ImGui::Begin("Mesh LODs"))
+    {
+        ImGui::Checkbox("Enabled", &app->meshLods);
+        ImGui::SliderFloat3("Screen sizes", app->meshLodScreenSizes, 0.0f, 1.0f);
+        ImGui::SliderFloat("Hysteresis", &app->meshLodHysteresis, 0.0f, 0.5f);
+        ImGui::Checkbox("Impostors", &app->drawImpostors);
+        ImGui::SliderFloat("Impostor screen size", &app->impostorScreenSize, 0.0f, 0.5f);
+        ImGui::Text("Triangles drawn: %u", app->drawnTriangles);
+
+        for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
+            if (app->gameObjects[i].lod == MESH_LOD_IMPOSTOR)
+                ImGui::Text("%s: impostor", app->gameObjects[i].name.c_str());
+            else
+                ImGui::Text("%s: LOD %u", app->gameObjects[i].name.c_str(), app->gameObjects[i].lod);
+
+        ImGui::End();
+    }
 }
 
 void Update(App* app)
@@ -488,6 +1215,18 @@ void Update(App* app)
 
     app->view = lookAt(app->camera.position, app->camera.target, vec3(0.f, 1.f, 0.f));
 
+    PollProgramLoads(app);
+    UpdateShaderHotReload(app);
+    UpdateWorldStreaming(app);
+    if (app->textureAtlasDirty)
+        BuildTextureAtlas(app); // Streamed in models may have brought new small textures
+    SelectMeshLods(app);
+    UpdateLightBenchmark(app);
+    UpdateLightGrid(app);
+    UpdateShadowAtlas(app);
+    UpdateLightBuffer(app);
+    UpdateClusteredLighting(app);
+
     //Buffer globalsBuffer = CreateBuffer(app->maxUniformBufferSize, GL_UNIFORM_BUFFER, GL_STREAM_DRAW);
 
     //BindBuffer(app->cbuffer);
@@ -509,25 +1248,36 @@ void Update(App* app)
     //Initialize global uniforms
     app->globalParamsOffset = app->cbuffer.head;
 
+    // The lights themselves are in the light buffer, only the directional ones are listed here
+    u32 directionalLights[MAX_DIRECTIONAL_LIGHTS] = {};
+    u32 directionalLightCount = 0;
+    for (u32 i = 0; i < (u32)app->lights.size() && directionalLightCount < MAX_DIRECTIONAL_LIGHTS; ++i)
+        if (app->lights[i].type == LIGHT_DIRECTIONAL)
+            directionalLights[directionalLightCount++] = i;
+
     PushVec3(app->cbuffer, app->camera.position);
 
-    PushUInt(app->cbuffer, app->activeLights);
+    PushUInt(app->cbuffer, directionalLightCount);
 
-    for (u32 i=0; i< app->activeLights;++i)
-    {
-        AlignHead(app->cbuffer, sizeof(vec4));
+    // What the shaders need to find the cluster of a fragment
+    PushMat4(app->cbuffer, app->view);
+    PushUVec4(app->cbuffer, uvec4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, 0));
+    PushVec4(app->cbuffer, GetClusterDepthParams(app));
+    PushVec4(app->cbuffer, vec4(app->displaySize.x, app->displaySize.y, 0.0f, 0.0f));
 
-        Light& light = app->lights[i];
-        PushUInt(app->cbuffer, light.type);
-        PushVec3(app->cbuffer, light.color);
-        PushVec3(app->cbuffer, light.direction);
-        PushVec3(app->cbuffer, light.position);
+    // Four indices per uvec4, std140 would pad single uints to 16 bytes
+    for (u32 i = 0; i < MAX_DIRECTIONAL_LIGHTS; i += 4)
+    {
+        uvec4 indices(0u);
+        for (u32 j = 0; j < 4 && i + j < MAX_DIRECTIONAL_LIGHTS; ++j)
+            indices[j] = directionalLights[i + j];
+        PushUVec4(app->cbuffer, indices);
     }
 
     app->globalParamsSize = app->cbuffer.head - app->globalParamsOffset;
 
 
-    for (int i = 0; i < app->activeGameObjects; ++i)
+    for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
     {
         //bufferHead = Align(bufferHead, app->uniformBlockAlignment);
 
@@ -544,7 +1294,8 @@ void Update(App* app)
 
     glUnmapBuffer(GL_UNIFORM_BUFFER);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    
+
+    UpdateTextureStreaming(app);
 }
 
 void UpdateInput(App* app)
@@ -592,6 +1343,100 @@ void UpdateInput(App* app)
 
 }
 
+void DrawGameObjects(App* app, u32 passFeatures)
+{
+    app->drawnTriangles = 0;
+    app->uberShaderDraws = 0;
+    for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
+    {
+
+        u32 blockSize = sizeof(glm::mat4) * 2;
+        glBindBufferRange(GL_UNIFORM_BUFFER, 1, app->cbuffer.handle, app->gameObjects[i].blockOffset, blockSize); //Here the offset should be saved for each entity defining where their information is stored in the uniform buffer
+        
+
+        Model& model = app->models[app->gameObjects[i].modelIdx];
+        Mesh& mesh = app->meshes[model.meshIdx];
+
+        if (app->gameObjects[i].lod == MESH_LOD_IMPOSTOR)
+        {
+            DrawImpostor(app, model, (passFeatures & ShaderFeature_GBuffer) != 0);
+            continue;
+        }
+
+        const bool instanced = !model.instanceBatches.empty();
+        glActiveTexture(GL_TEXTURE0);
+        GLuint boundTexture = 0;
+        u32 boundProgramIdx = UINT32_MAX;
+
+        // Instanced models draw each batch of instances sharing a submesh at once
+        const u32 drawCount = instanced ? (u32)model.instanceBatches.size() : (u32)mesh.submeshes.size();
+        for (u32 d = 0; d < drawCount; ++d)
+        {
+            const u32 submeshIdx = instanced ? model.instanceBatches[d].submeshIdx : d;
+            u32 submeshMaterialIdx = model.materialIdx[submeshIdx];
+            Material& submeshMaterial = app->materials[submeshMaterialIdx];
+
+            // The cheapest variant covering the features of the material
+            const u32 features = GetMaterialShaderFeatures(app, submeshMaterial) | (instanced ? ShaderFeature_Instanced : 0) | passFeatures;
+            const u32 programIdx = GetShaderVariant(app, app->texturedMeshVariants, features);
+            Program& texturedMeshProgram = app->programs[programIdx];
+            const MeshProgramUniforms& uniforms = app->texturedMeshUniforms[programIdx];
+            if (programIdx != boundProgramIdx)
+            {
+                glUseProgram(texturedMeshProgram.handle);
+                glUniform1i(uniforms.uTexture, 0);
+                boundProgramIdx = programIdx;
+            }
+            if (uniforms.uFeatures != -1)
+                glUniform1ui(uniforms.uFeatures, features);
+
+            GLuint vao = FindVAO(mesh, submeshIdx, texturedMeshProgram);
+            glBindVertexArray(vao);
+
+            if (features & ShaderFeature_AlbedoMap)
+            {
+                // Materials using atlased textures share the atlas binding
+                const Texture& albedoTexture = app->textures[submeshMaterial.albedoTextureIdx];
+                GLuint albedoHandle = albedoTexture.inAtlas ? app->textureAtlasHandle : albedoTexture.handle;
+                if (albedoHandle != boundTexture)
+                {
+                    glBindTexture(GL_TEXTURE_2D, albedoHandle);
+                    boundTexture = albedoHandle;
+                }
+                glUniform4fv(uniforms.uAlbedoUvTransform, 1, value_ptr(submeshMaterial.albedoUvTransform));
+            }
+            else
+            {
+                glUniform3fv(uniforms.uAlbedo, 1, value_ptr(submeshMaterial.albedo));
+            }
+            if (features & ShaderFeature_Emissive)
+                glUniform3fv(uniforms.uEmissive, 1, value_ptr(submeshMaterial.emissive));
+
+            // Submeshes with fewer levels than asked for use their coarsest one
+            Submesh& submesh = mesh.submeshes[submeshIdx];
+            const u32 lod = glm::min(app->gameObjects[i].lod, (u32)submesh.lods.size());
+            const u32 indexCount = lod ? submesh.lods[lod - 1].indexCount : submesh.indexCount;
+            const u32 indexOffset = lod ? submesh.lods[lod - 1].indexOffset : submesh.indexOffset;
+
+            if (instanced)
+            {
+                const InstanceBatch& batch = model.instanceBatches[d];
+                glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, submesh.indexType, (void*)(u64)indexOffset,
+                                                    batch.instanceCount, batch.firstInstance);
+                app->drawnTriangles += indexCount / 3 * batch.instanceCount;
+            }
+            else
+            {
+                glDrawElements(GL_TRIANGLES, indexCount, submesh.indexType, (void*)(u64)indexOffset);
+                app->drawnTriangles += indexCount / 3;
+            }
+
+        }
+
+
+    }
+}
+
 void Render(App* app)
 {
     switch (app->mode)
@@ -635,38 +1480,21 @@ void Render(App* app)
             //Bind buffer range with binding 0 for global params (light)
             glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
 
-            for (int i = 0; i < app->activeGameObjects; ++i)
-            {
-
-                u32 blockSize = sizeof(glm::mat4) * 2;
-                glBindBufferRange(GL_UNIFORM_BUFFER, 1, app->cbuffer.handle, app->gameObjects[i].blockOffset, blockSize); //Here the offset should be saved for each entity defining where their information is stored in the uniform buffer
-                
-
-                Program& texturedMeshProgram = app->programs[app->texturedMeshProgramIdx];
-                glUseProgram(texturedMeshProgram.handle);
-
-                Model& model = app->models[0];
-                Mesh& mesh = app->meshes[model.meshIdx];
-
-                for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-                {
-                    GLuint vao = FindVAO(mesh, i, texturedMeshProgram);
-                    glBindVertexArray(vao);
-
-                    u32 submeshMaterialIdx = model.materialIdx[i];
-                    Material& submeshMaterial = app->materials[submeshMaterialIdx];
-
-                    glActiveTexture(GL_TEXTURE0);
-                    glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
-                    glUniform1i(0, 0); //Here missing a variable app->texturedMeshProgram_uTexture
-
-                    Submesh& submesh = mesh.submeshes[i];
-                    glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
-
-                }
-
+            BeginScenePassTimer(app);
+            const bool depthPrepass = BeginDepthPrepass(app, 0);
+            DrawGameObjects(app, 0);
+            if (depthPrepass)
+                EndDepthPrepass();
+            EndScenePassTimer(app);
+            break;
+        }
+        case Mode::Mode_Deferred:
+        {
+            glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
 
-            }
+            BeginScenePassTimer(app);
+            RenderDeferred(app);
+            EndScenePassTimer(app);
             break;
         }
 
@@ -712,13 +1540,28 @@ glm::mat4 TransformPositionScale(const vec3& pos, const vec3& scaleFactor)
     return transform;
 }
 
-Light AddLight(App* app, LightType type, vec3 color, vec3 direction, vec3 position)
+void GetFrustumPlanes(const glm::mat4& viewProjection, vec4 planes[6])
 {
-    app->lights[app->activeLights].type = type;
-    app->lights[app->activeLights].color = color;
-    app->lights[app->activeLights].direction = direction;
-    app->lights[app->activeLights].position = position;
-    app->activeLights++;
+    // Rows of the matrix combined, normalized so w is a distance
+    const vec4 w = vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+    for (u32 i = 0; i < 3; ++i)
+    {
+        const vec4 row = vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        planes[i * 2 + 0] = (w + row) / glm::length(vec3(w + row));
+        planes[i * 2 + 1] = (w - row) / glm::length(vec3(w - row));
+    }
+}
 
-    return app->lights[app->activeLights - 1];
+Light AddLight(App* app, LightType type, vec3 color, vec3 direction, vec3 position, f32 range, bool castShadows)
+{
+    Light light = {};
+    light.type = type;
+    light.color = color;
+    light.direction = direction;
+    light.position = position;
+    light.range = range;
+    light.castShadows = castShadows;
+    app->lights.push_back(light);
+
+    return light;
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 #include "platform.h"
 #include <glad/glad.h>
+#include <unordered_map>
 
 typedef glm::vec2  vec2;
 typedef glm::vec3  vec3;
@@ -13,6 +14,8 @@ typedef glm::vec4  vec4;
 typedef glm::ivec2 ivec2;
 typedef glm::ivec3 ivec3;
 typedef glm::ivec4 ivec4;
+typedef glm::uvec2 uvec2;
+typedef glm::uvec4 uvec4;
 
 enum LightType
 {
@@ -26,8 +29,57 @@ struct Light
     vec3 color;
     vec3 direction;
     vec3 position;
+    f32  range; // Point lights, distance at which they fade out completely
+    bool castShadows = false; // Gets views in the shadow atlas (shadow_atlas.h)
 };
 
+// Light as the shaders read it from the light buffer (std430), see light_buffer.h
+struct GpuLight
+{
+    vec4 positionRange; // xyz: world position, w: range of point lights
+    vec3 color;
+    u32  shadowView;    // First of its views in the shadow atlas, UINT32_MAX if unshadowed
+    vec3 direction;
+    u32  type;          // LightType
+};
+
+// Directional lights are listed in GlobalParams, point lights are culled per cluster (clustered_lighting.h)
+#define MAX_DIRECTIONAL_LIGHTS 10
+
+// Spatial hash of the point lights (light_grid.h). Lights are sorted by bucket, structure of arrays
+struct LightGrid
+{
+    f32               cellSize = 1.0f;
+    u32               bucketMask = 0;      // Bucket count - 1, a power of 2
+    f32               maxRange = 0.0f;
+    std::vector<u32>  bucketStart;         // First light of each bucket, plus the end
+    std::vector<vec3> bucketMin;           // Bounds of the light spheres in each bucket
+    std::vector<vec3> bucketMax;
+    std::vector<f32>  x, y, z, range;
+    std::vector<u32>  lightIdx;            // In App::lights
+};
+
+// Moving lights timing the light grid and the clusters (light_grid.h)
+struct LightBenchmark
+{
+    bool              running = false;
+    u32               firstLight = 0;      // In App::lights
+    std::vector<vec3> origins;             // Center of the circle of each light
+    u32               frame = 0;
+    f32               gridMs = 0.0f;       // Sums over the measured frames
+    f32               cullMs = 0.0f;
+    f32               assignMs = 0.0f;
+};
+
+// Shadow views of a directional light, nearest first (shadow_atlas.h)
+#define SHADOW_CASCADE_COUNT 4
+
+// View frustum split in tiles on screen and exponential slices in depth
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT  (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
 struct Buffer
 {
     GLuint handle;
@@ -45,9 +97,12 @@ struct Vao
 
 struct VertexBufferAttribute
 {
-    u8 location;
-    u8 componentCount;
-    u8 offset;
+    u8     location;
+    u8     componentCount;
+    u32    offset;               // From the start of the vertex, or of the submesh data for separate streams
+    GLenum type = GL_FLOAT;      // Component type, converted to float by the vertex fetch
+    bool   normalized = false;   // Integer components are mapped to [0, 1] / [-1, 1]
+    u8     stride = 0;           // Set when the attribute lives in its own stream, 0 uses the layout stride
 };
 
 struct VertexBufferLayout
@@ -67,6 +122,25 @@ struct VertexShaderLayout
     std::vector<VertexShaderAttribute> attributes;
 };
 
+// Uniform of the default block, or member of a uniform / storage block
+struct ProgramUniform
+{
+    GLint  location;    // -1 for block members
+    GLenum type;
+    GLint  arraySize;
+    GLint  offset;      // Bytes from the start of the block, -1 outside blocks
+    GLint  arrayStride; // Bytes between elements of block member arrays
+};
+
+// Uniform block or shader storage block of a program
+struct ProgramBlock
+{
+    GLenum interfaceType; // GL_UNIFORM_BLOCK or GL_SHADER_STORAGE_BLOCK
+    GLint  binding;
+    GLint  dataSize;      // Minimum size of the buffer range bound to it
+    std::unordered_map<std::string, ProgramUniform> members;
+};
+
 
 //OpenGL info (retrieved in the initialization)
 struct OpenGLInfo
@@ -90,10 +164,61 @@ struct Image
     i32   stride;
 };
 
+enum TextureUsage
+{
+    TextureUsage_Color,  // sRGB encoded colors (albedo, emissive...)
+    TextureUsage_Normal, // Tangent space normal maps
+    TextureUsage_Linear  // Any other linear data (specular, bump...)
+};
+
+enum BlockFormat
+{
+    BlockFormat_None, // Keep the texture uncompressed
+    BlockFormat_BC1,  // RGB, 4 bpp
+    BlockFormat_BC3,  // RGB + smooth alpha, 8 bpp
+    BlockFormat_BC5,  // Two channels (tangent space normals, z rebuilt in the shader), 8 bpp
+    BlockFormat_BC7   // High quality RGB, 8 bpp
+};
+
+enum MipFilter
+{
+    MipFilter_Box,    // 2x2 average, cheapest
+    MipFilter_Kaiser  // Kaiser windowed sinc, sharper mips for detailed textures
+};
+
+enum CompressionQuality
+{
+    CompressionQuality_Fast,   // Bounding box endpoints, no refinement
+    CompressionQuality_Normal, // Principal axis endpoints plus one refinement pass
+    CompressionQuality_High    // Like normal with more refinement, opaque color textures go to BC7
+};
+
+struct MipLevel
+{
+    ivec2 size;
+    u32   offset;   // Offset of the level inside the data that holds the whole chain
+    u32   dataSize;
+};
+
 struct Texture
 {
-    GLuint      handle;
-    std::string filepath;
+    GLuint       handle;
+    std::string  filepath;
+    TextureUsage usage;
+    BlockFormat  format;
+    i32          nchannels;
+    ivec2        size;
+    u32          mipCount;
+
+    // Streaming: the .btex container stays mapped and feeds the levels that get streamed in
+    MappedFile   container;
+    u32          residentMip;    // Most detailed level currently on the GPU
+    u32          wantedMip;      // Most detailed level needed by what is being drawn
+    f32          screenCoverage; // Pixels covered by the biggest user this frame (eviction priority)
+
+    // Small textures are also packed in the shared atlas
+    bool         inAtlas;
+    vec4         atlasUvTransform; // xy: scale, zw: offset of the texture inside the atlas
 };
 
 struct Material
@@ -102,37 +227,101 @@ struct Material
     vec3        albedo;
     vec3        emissive;
     f32         smoothness;
-    u32         albedoTextureIdx;
-    u32         emissiveTextureIdx;
-    u32         specularTextureIdx;
-    u32         normalsTextureIdx;
-    u32         bumpTextureIdx;
+    u32         albedoTextureIdx = UINT32_MAX; // UINT32_MAX if the material has no such map
+    u32         emissiveTextureIdx = UINT32_MAX;
+    u32         specularTextureIdx = UINT32_MAX;
+    u32         normalsTextureIdx = UINT32_MAX;
+    u32         bumpTextureIdx = UINT32_MAX;
+    vec4        albedoUvTransform = vec4(1.0f, 1.0f, 0.0f, 0.0f); // Remaps the uvs when the albedo lives in the atlas
 };
 
 
 
+// Simplified levels generated below the original geometry of every submesh
+#define MESH_LOD_COUNT 3
+// Level of objects drawn with the impostor of their model
+#define MESH_LOD_IMPOSTOR (MESH_LOD_COUNT + 1)
+
+// Coarser index list over the same vertices, appended after the submesh indices in the mesh buffer
+struct SubmeshLod
+{
+    std::vector<u32> indices;
+    u32              indexOffset;
+    u32              indexCount;
+    f32              error; // Object space distance the surface moved at most
+};
+
 struct Submesh
 {
     VertexBufferLayout vertexBufferLayout;
     std::vector<float> vertices;
     std::vector<u32>   indices;
     u32                vertexOffset;
+    u32                positionOffset; // Tightly packed vec3 positions in the vertex buffer, read by position-only programs
     u32                indexOffset;
+    u32                indexCount;
+    GLenum             indexType;
+
+    // Bounding sphere and texture coordinate density (uv units per object space unit)
+    vec3               boundsCenter;
+    f32                boundsRadius;
+    f32                uvDensity;
+
+    std::vector<SubmeshLod> lods;
 
     std::vector<Vao>   vaos;
 };
 
+// Per instance node transforms are a mat4 vertex input taking this location and the next three
+#define INSTANCE_TRANSFORM_LOCATION 5
+
 struct Mesh
 {
     std::vector<Submesh> submeshes;
     GLuint               vertexBufferHandle;
     GLuint               indexBufferHandle;
+    GLuint               instanceBufferHandle; // Model::instanceTransforms, 0 if the mesh is not instanced
+};
+
+struct InstanceBatch
+{
+    u32 submeshIdx;
+    u32 firstInstance; // In Model::instanceTransforms (and the instance buffer)
+    u32 instanceCount;
 };
 
 struct Model
 {
     u32 meshIdx;
     std::vector<u32> materialIdx;
+
+    // Models imported keeping their node hierarchy draw each submesh once per node using it,
+    // with the node transform (relative to the model) as instance data
+    std::vector<InstanceBatch> instanceBatches;
+    std::vector<glm::mat4>     instanceTransforms;
+
+    u32 impostorIdx = UINT32_MAX; // Baked views drawn as a single quad when far away
+
+    // Bounding sphere of all the submeshes and instances, model space (ComputeModelBounds)
+    vec3 boundsCenter = vec3(0.0f);
+    f32  boundsRadius = 0.0f;
+};
+
+// Views of a model from a hemisphere of directions, laid out in a hemi-octahedral grid of frames
+struct Impostor
+{
+    GLuint albedoHandle;      // Alpha is coverage
+    GLuint normalDepthHandle; // Model space normal (xyz) and depth towards the viewer (w), 0.5 at the bounds center
+    u32    frameCount;        // Frames per side of the atlas
+    u32    frameResolution;
+    vec3   boundsCenter;      // Sphere the frames are fitted to, model space
+    f32    boundsRadius;
+};
+
+enum ModelImportMode
+{
+    ModelImport_Flatten,  // Node transforms baked into the vertices, one copy per node
+    ModelImport_Instanced // Node hierarchy kept, each mesh stored once and instanced per node
 };
 
 
@@ -142,15 +331,70 @@ struct Program
     GLuint             handle;
     std::string        filepath;
     std::string        programName;
-    u64                lastWriteTimestamp; // What is this for?
+    std::string        defines;            // Extra #define lines of shader variants
+    bool               pending;            // Loaded by LoadProgram(), not finished yet; handle is 0 if it failed to link
+    u64                lastWriteTimestamp; // Of the source the program was built from, for hot reload
 
+    // Reflected once when the program is loaded or reloaded, see ReflectProgram()
     VertexShaderLayout vertexInputLayout;
+    std::unordered_map<std::string, ProgramUniform> uniforms; // Default block, arrays without their "[0]"
+    std::unordered_map<std::string, ProgramBlock>   blocks;
+};
+
+// Program being compiled and linked, see StartProgramCompile()
+struct ProgramCompile
+{
+    GLuint programHandle;
+    GLuint vertexShader;
+    GLuint fragmentShader;
+    GLuint computeShader;  // Instead of the other two, for programs loaded with "#define COMPUTE\n"
+};
+
+// Program compiling in the background, at load (FinishProgramLoads()) or on a hot reload
+struct PendingProgram
+{
+    u32            programIdx;
+    ProgramCompile compile;
+    u64            sourceTimestamp;
+    u64            cacheKey;
+};
+
+// Feature keys of shader variants, each one enables a #define of the variant source (see
+// shader_variants.h). Keep in sync with ShaderFeatureDefines.
+enum ShaderFeature
+{
+    ShaderFeature_Instanced = 1 << 0, // INSTANCED: node transform per instance, models keeping their node hierarchy (GLB, Assimp)
+    ShaderFeature_AlbedoMap = 1 << 1, // ALBEDO_MAP: albedo sampled from a texture, the material color otherwise
+    ShaderFeature_Emissive  = 1 << 2, // EMISSIVE: adds the material emissive color
+    ShaderFeature_GBuffer   = 1 << 3, // GBUFFER: writes the G-buffer of Mode_Deferred instead of lit color
+    ShaderFeature_Uber      = 1 << 4, // UBER: the features in ShaderVariants::uberFeatures are branches on uFeatures
+    ShaderFeature_Count     = 5
+};
+
+// Program compiled on demand for every combination of ShaderFeature bits it is asked for
+struct ShaderVariants
+{
+    std::string                  filepath;
+    std::string                  programName;
+    u32                          uberFeatures; // Features the uber variants branch on at runtime
+    std::unordered_map<u32, u32> programs;     // Feature mask -> index in App::programs
+};
+
+// Uniform locations of a textured mesh variant, -1 for the ones its features compile out
+struct MeshProgramUniforms
+{
+    GLint uTexture;
+    GLint uAlbedoUvTransform;
+    GLint uAlbedo;
+    GLint uEmissive;
+    GLint uFeatures; // Uber variants only
 };
 
 enum Mode
 {
     Mode_TexturedQuad,
     Mode_TexturedMesh,
+    Mode_Deferred,
     Mode_Count
 };
 
@@ -164,6 +408,9 @@ glm::mat4 TransformScale(const vec3& scaleFactors);
 
 glm::mat4 TransformPositionScale(const vec3& pos, const vec3& scaleFactor);
 
+// Planes of the frustum of a view projection, xyz normal pointing inside and w distance
+void GetFrustumPlanes(const glm::mat4& viewProjection, vec4 planes[6]);
+
 struct Transform
 {
     glm::mat4 matrix;
@@ -177,23 +424,109 @@ struct Camera
     vec3 target;
 };
 
+// Shadow map of one light direction in the atlas, as the shaders read it (std430)
+struct ShadowView
+{
+    glm::mat4 viewProjection;
+    vec4      atlasRect; // xy: offset, zw: size, in atlas uv
+};
+
+// Views of a shadowed light and what its cached static layer was rendered with
+struct ShadowSlot
+{
+    u32                     lightIdx;
+    std::vector<ShadowView> views;     // The cascades of directional lights, the 6 cube faces of point lights
+    std::vector<ivec4>      viewRects; // In atlas pixels
+    u64                     cells;     // Atlas cells taken, a bit each
+    Light                   renderedLight;
+    u32                     staticViews;          // Bits of the views whose cached static layer is up to date
+    u32                     compositeStaticViews; // Bits of the views with no dynamic caster over the copied static layer
+};
+
 struct GameObject
 {
     std::string name;
     Transform transform; //(World matrix)
+    u32 modelIdx = 0;
+    u32 lod = 0; // 0 is the full geometry, then Submesh::lods
+    u32 cellIdx = UINT32_MAX; // World cell that spawned it, UINT32_MAX if not streamed
+    bool dynamic = false;     // Moves on its own, redrawn into the shadow maps every frame instead of cached
     GLuint bufferHandle;
     u32 blockOffset;
 };
 
-struct App
+enum WorldResidency
+{
+    WorldResidency_Unloaded,
+    WorldResidency_Loading,  // Job running on the CPU side
+    WorldResidency_Loaded,   // CPU side done, waiting for its GPU upload (assets only)
+    WorldResidency_Resident
+};
+
+// Placement of a model in a world cell, relative to the cell origin
+struct WorldObject
 {
-    GameObject gameObjects[50];
+    std::string model;
+    vec3        position = vec3(0.0f);
+    vec3        scale = vec3(1.0f);
+    f32         yaw = 0.0f; // Degrees around the y axis
+};
 
-    Light lights[10];
+struct WorldCellLoad;
+struct WorldAssetLoad;
 
-    u32 activeLights = 0;
+struct WorldCell
+{
+    ivec2                    coord;     // Covers [coord, coord + 1) * App::worldCellSize on x and z
+    std::string              filepath;  // Cell file with the objects, empty if they are in the manifest
+    std::vector<WorldObject> objects;   // Inline ones, or the ones read from the file while loaded
+    std::vector<u32>         assets;    // Distinct assets referenced while loading or resident
+    WorldResidency           residency = WorldResidency_Unloaded;
+    WorldCellLoad*           load = nullptr;
+};
 
-    u32 activeGameObjects=0;
+// Model shared by the cells placing it, loaded while at least one of them needs it
+struct WorldAsset
+{
+    std::string     filepath;
+    WorldResidency  residency = WorldResidency_Unloaded;
+    u32             modelIdx = UINT32_MAX; // Kept once created, reloads upload into the same mesh
+    u32             refCount = 0;
+    u64             cpuBytes = 0;          // Last measured sizes, used as estimates while unloaded
+    u64             gpuBytes = 0;          // (until the first load, a guess from the file size)
+    WorldAssetLoad* load = nullptr;
+};
+
+struct App
+{
+    std::vector<GameObject> gameObjects;
+
+    std::vector<Light> lights;
+    LightGrid          lightGrid;
+    LightBenchmark     lightBenchmark;
+    f32                lightGridBuildMs = 0.0f;
+    f32                lightCullMs = 0.0f;     // Point lights outside the view culled with the grid
+
+    // Packed copy of the lights on the GPU, only the changed ones are uploaded (light_buffer.h)
+    std::vector<GpuLight> gpuLights;
+    GLuint                lightBuffer;             // SSBO binding 0 of the lit programs
+    u32                   lightBufferCapacity = 0; // In lights
+    u32                   lightBufferUploadedBytes = 0; // Last frame
+    u32                   lightBufferUploads = 0;       // glBufferSubData calls, last frame
+
+    // Clustered forward lighting, see clustered_lighting.h
+    f32               clusterNearDepth = 2.0f; // End of the first slice, the others split the rest logarithmically
+    glm::mat4         clusterProjection = glm::mat4(0.0f); // The cluster bounds were built for
+    std::vector<vec3> clusterMin;              // View space bounds, by cluster index
+    std::vector<vec3> clusterMax;
+    std::vector<uvec2> clusterLights;          // By cluster index, x: first entry in clusterLightIndices, y: count
+    std::vector<u32>  clusterLightIndices;
+    std::vector<std::vector<u32>> clusterSliceIndices; // Per depth slice while assigning
+    GLuint            clusterLightsBuffer;     // SSBO bindings 1 and 2 of the lit programs
+    GLuint            clusterLightIndexBuffer;
+    u32               clusterPointLights = 0;  // Visible ones, the others are culled before the assignment
+    u32               clusterMaxLights = 0;    // Most lights in a single cluster, last frame
+    f32               clusterAssignMs = 0.0f;
 
     //OpenGL info for output purposes
     OpenGLInfo openGLInfo;
@@ -219,6 +552,52 @@ struct App
     GLuint depthAttachmentHandle;
     GLuint colorAttachmentHandle;
 
+    // Deferred shading (deferred_shading.h)
+    GLuint gbufferFramebufferHandle;
+    GLuint gbufferAlbedoHandle;       // RGBA8
+    GLuint gbufferNormalHandle;       // RG16, octahedral encoded
+    GLuint lightingFramebufferHandle; // Color attachment only
+    u32    deferredLightingProgramIdx;
+    GLuint scenePassQueries[4];       // GL_TIME_ELAPSED, read back a few frames later
+    u32    scenePassQueryMode[4];
+    u32    scenePassQueryFrame = 0;
+    f32    scenePassGpuMs[Mode_Count] = {};
+
+    // Tiled light culling on the GPU (tiled_light_culling.h), Mode_Deferred only
+    bool   tiledLightCulling = false;
+    u32    tiledLightCullingProgramIdx;
+    u32    deferredTiledLightingProgramIdx;
+    GLuint tileLightsBuffer;     // SSBO bindings 3 and 4 of the TILED_LIGHTS programs
+    GLuint tileLightIndexBuffer;
+
+    // Depth prepass (depth_prepass.h)
+    bool   depthPrepass = false;
+    u32    depthPrepassProgramIdx;
+    u32    depthPrepassInstancedProgramIdx;
+
+    // Shadow atlas (shadow_atlas.h)
+    bool                    shadows = true;
+    GLuint                  shadowAtlasHandle;       // Sampled: static layer plus dynamic casters
+    GLuint                  shadowStaticAtlasHandle; // Static casters only, cached
+    GLuint                  shadowFramebufferHandle = 0;
+    GLuint                  shadowStaticFramebufferHandle;
+    GLuint                  shadowViewBuffer;        // SSBO binding 5 of the lit programs
+    u64                     shadowAtlasCells = 0;
+    std::vector<ShadowSlot> shadowSlots;
+    std::vector<ShadowView> shadowViews;
+    std::vector<u32>        lightShadowViews;        // First view of each light in shadowViews, UINT32_MAX if unshadowed
+    u64                     shadowStaticHash = 0;
+    vec3                    shadowCasterCenter;      // Bounds of the casters the directional views are fitted to
+    f32                     shadowCasterRadius = 0.0f;
+    u32                     shadowDepthProgramIdx;
+    u32                     shadowDepthInstancedProgramIdx;
+    u32                     shadowStaticViewsRendered = 0;  // Last frame
+    u32                     shadowDynamicViewsRendered = 0;
+    u32                     shadowLightsOutOfAtlas = 0;
+    u32                     shadowFrame = 0;
+    u32                     shadowCascadesFitted = 0;   // Last frame
+    f32                     shadowCascadeSplits[SHADOW_CASCADE_COUNT + 1] = {}; // View depths
+
     Program drawFramebufferProgram;
     u32 drawFramebufferProgramIdx;
 
@@ -246,6 +625,70 @@ struct App
     glm::mat4 world; //The model matrix (?) (Should this be on the model?)
     glm::mat4 worldViewProjection;
 
+    // Block compression applied to the textures at import time
+    bool               compressTextures = true;
+    CompressionQuality textureCompressionQuality = CompressionQuality_Normal;
+    MipFilter          textureMipFilter = MipFilter_Box; // Of the textures cooked from then on
+
+    // Texture streaming: textures start with their small mips and stream up to what the
+    // screen needs, evicting the least needed mips when the budget is exceeded
+    bool textureStreaming = true;
+    u32  textureStreamingBudget = MB(128);
+    u32  textureStreamingUpdatesPerFrame = 4;
+    u64  textureStreamingResidentBytes = 0;
+
+    // Mesh levels of detail, switching to the next one when the object covers less than this
+    // fraction of the screen height
+    bool meshLods = true;
+    f32  meshLodScreenSizes[MESH_LOD_COUNT] = { 0.4f, 0.2f, 0.1f };
+    f32  meshLodHysteresis = 0.1f;
+    u32  drawnTriangles = 0;
+
+    // Octahedral impostors replacing models smaller than impostorScreenSize
+    bool drawImpostors = true;
+    f32  impostorScreenSize = 0.05f;
+    std::vector<Impostor> impostors;
+
+    // Last results of the OBJ import benchmark (milliseconds per import)
+    f64 objImportNativeMs = 0.0;
+    f64 objImportAssimpMs = 0.0;
+
+    // World streaming: cells of the manifest load around the camera (and where it is heading)
+    // within memory budgets for the geometry of their models
+    std::vector<WorldCell>            worldCells;
+    std::unordered_map<u64, u32>      worldCellByCoord;
+    std::vector<u32>                  worldActiveCells; // Loading or resident
+    std::vector<WorldAsset>           worldAssets;
+    std::unordered_map<std::string, u32> worldAssetByPath;
+    f32  worldCellSize = 40.0f;
+    f32  worldLoadRadius = 100.0f;
+    f32  worldPrefetchSeconds = 2.0f;
+    u64  worldCpuBudget = MB(64);
+    u64  worldGpuBudget = MB(64);
+    u64  worldCpuBytes = 0;
+    u64  worldGpuBytes = 0;
+    u32  worldMaxLoadingJobs = 2;
+    u32  worldUploadsPerFrame = 1;
+    vec3 worldCameraVelocity = vec3(0.0f);
+    vec3 worldLastCameraPosition = vec3(0.0f);
+
+    // Programs missing from the cache are all submitted before any status is queried, with
+    // GL_KHR_parallel_shader_compile the driver compiles them on several threads
+    bool parallelShaderCompile = false;
+    std::vector<PendingProgram> pendingPrograms;
+
+    // Linked programs are restored from binaries saved by previous runs
+    bool programBinaryCache = true;
+    u32  programCacheHits = 0;
+    u32  programCacheMisses = 0;
+
+    // Programs are recompiled when their source changes on disk
+    bool shaderHotReload = true;
+    f32  shaderHotReloadInterval = 0.5f; // Seconds between timestamp checks
+    f32  shaderHotReloadTimer = 0.0f;
+    u32  programReloadCount = 0;
+    std::vector<PendingProgram> programReloads;
+
     std::vector<Texture>  textures;
     std::vector<Material> materials;
     std::vector<Mesh>     meshes;
@@ -255,7 +698,10 @@ struct App
     // program indices
     u32 texturedGeometryProgramIdx;
 
-    u32 texturedMeshProgramIdx;
+    // Textured mesh program, one variant per material features
+    ShaderVariants texturedMeshVariants;
+    bool uberShaderFallback = true; // Draw with the uber variant while the right one compiles
+    u32  uberShaderDraws = 0;       // Last frame
     
     // texture indices
     u32 diceTexIdx;
@@ -277,18 +723,92 @@ struct App
     // Location of the texture uniform in the textured quad shader
     GLuint programUniformTexture;
 
+    // Uniform locations of the textured mesh variants, by program index
+    std::unordered_map<u32, MeshProgramUniforms> texturedMeshUniforms;
+
+    // Atlas holding all the small color textures (see texture_atlas.h)
+    GLuint textureAtlasHandle;
+    bool   textureAtlasDirty = false; // A texture the atlas should hold was loaded since it was built
+
+    u32 impostorBakeProgramIdx;
+    u32 impostorBakeInstancedProgramIdx;
+    u32 impostorProgramIdx;
+    u32 impostorGBufferProgramIdx;
+    GLuint impostorVao; // Empty, the quad corners come from gl_VertexID
+
     GLint maxUniformBufferSize, uniformBlockAlignment;
 
     // VAO object to link our screen filling quad with our textured quad shader
     GLuint vaoQuad;
 };
 
+/**
+ * Issues the compilation and link of a program without waiting for them: no status is
+ * queried until FinishProgramCompile(), so drivers compiling in the background don't stall.
+ */
+ProgramCompile StartProgramCompile(String programSource, const char* shaderName, const char* defines = "");
+
+/**
+ * Logs the compile and link errors and releases the shaders. Returns whether the program linked.
+ */
+bool FinishProgramCompile(ProgramCompile& compile, const char* shaderName);
+
+/**
+ * Whether FinishProgramCompile() would return without waiting. Always true without
+ * App::parallelShaderCompile, the driver compiles on the calling thread then.
+ */
+bool IsProgramCompileDone(const App* app, const ProgramCompile& compile);
+
+/**
+ * Adds a program to App::programs, restored from the cache or with its compile started. The
+ * handle is valid right away but can't be used to draw before FinishProgramLoads().
+ */
+u32 LoadProgram(App* app, const char* filepath, const char* programName, const char* defines = "");
+
+/**
+ * Waits for the programs started by LoadProgram(), stores their binaries and reflects their
+ * vertex inputs and uniforms.
+ */
+void FinishProgramLoads(App* app);
+
+/**
+ * Same as FinishProgramLoads() for the programs that already completed (IsProgramCompileDone()),
+ * the others are left pending. Doesn't wait.
+ */
+void PollProgramLoads(App* app);
+
+GLuint CreateProgramFromSource(String programSource, const char* shaderName);
+
+/**
+ * Fills the vertex input layout, the uniforms and the uniform and storage blocks (with their
+ * sizes and member offsets) of the program from the driver. The only place GL is asked about
+ * them, draw code reads the result.
+ */
+void ReflectProgram(Program& program);
+
+// Location of a default block uniform from the reflection, -1 if the program doesn't use it
+GLint GetUniformLocation(const Program& program, const char* name);
+
+// Reflected uniform or storage block, NULL if the program doesn't use it
+const ProgramBlock* GetProgramBlock(const Program& program, const char* name);
+
+// Copies the uniform locations the engine keeps in App for the program, after loading or reloading it
+void QueryProgramUniforms(App* app, u32 programIdx);
+
 void Init(App* app);
 
+void Shutdown(App* app);
+
 void InitQuad(App* app);
 
 void InitFramebuffer(App* app);
 
+// Texture to attach to a framebuffer, nearest filtered and clamped
+GLuint CreateAttachmentTexture(GLenum internalFormat, ivec2 size, GLenum format, GLenum type);
+
+// Logs why the bound framebuffer is incomplete, if it is
+bool CheckFramebufferStatus();
+
 void Gui(App* app);
 
 void UpdateInput(App* app);
@@ -297,8 +817,35 @@ void Update(App* app);
 
 void Render(App* app);
 
-u32 LoadTexture2D(App* app, const char* filepath);
+// Draws every game object with the textured mesh variants (or impostors), passFeatures are
+// ShaderFeature bits added to those of each material
+void DrawGameObjects(App* app, u32 passFeatures);
+
+Image LoadImage(const char* filename);
+
+void FreeImage(Image image);
+
+u32 LoadTexture2D(App* app, const char* filepath, TextureUsage usage = TextureUsage_Color);
+
+GLenum GetTextureInternalFormat(BlockFormat format, i32 nchannels);
+
+void UploadTextureLevel(BlockFormat format, i32 nchannels, GLint level, const MipLevel& mip, const u8* data);
+
+GLuint CreateTexture2DFromLevels(BlockFormat format, i32 nchannels, const MipLevel* levels, u32 mipCount, const u8* data, u32 firstMip);
+
+void ComputeSubmeshBounds(Submesh& submesh);
+
+// Creates the vertex and index buffers of the mesh and uploads every submesh into them
+void UploadMesh(Mesh& mesh);
+
+// Deletes the GL objects of the mesh and its CPU data, leaving it empty
+void FreeMesh(Mesh& mesh);
+
+void AddInstanceBatch(Model& model, u32 submeshIdx, const std::vector<glm::mat4>& transforms);
+
+// Creates the instance buffer of the mesh with the instance transforms of the model
+void UploadModelInstances(const Model& model, Mesh& mesh);
 
 GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program);
 
-Light AddLight(App* app,LightType type,vec3 color,vec3 direction,vec3 position);
+Light AddLight(App* app,LightType type,vec3 color,vec3 direction,vec3 position,f32 range = 10.0f,bool castShadows = false);
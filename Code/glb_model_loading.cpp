@@ -0,0 +1,521 @@
+#include "glb_model_loading.h"
+#include "json.h"
+#include "mesh_lod.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <string.h>
+
+#define GLB_MAGIC      0x46546C67 // "glTF"
+#define GLB_VERSION    2
+#define GLB_CHUNK_JSON 0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN  0x004E4942 // "BIN\0"
+
+#define GLTF_MODE_TRIANGLES 4
+
+// Triangles sampled to estimate the texture coordinate density of a primitive
+#define GLTF_UV_DENSITY_SAMPLES 4096
+
+// Deeper node trees are considered malformed (they could have cycles)
+#define GLTF_MAX_NODE_DEPTH 64
+
+struct GlbHeader
+{
+    u32 magic;
+    u32 version;
+    u32 length;
+};
+
+struct GlbChunkHeader
+{
+    u32 length;
+    u32 type;
+};
+
+struct GltfAccessor
+{
+    u32    offset;         // Inside the binary chunk
+    u32    stride;         // Distance between elements, tightly packed ones included
+    u32    count;
+    GLenum componentType;  // glTF uses the GL enums (GL_FLOAT, GL_UNSIGNED_SHORT...)
+    u8     componentCount;
+    bool   normalized;
+};
+
+static u32 GetComponentSize(GLenum componentType)
+{
+    switch (componentType)
+    {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:  return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:          return 4;
+        default:                return 0;
+    }
+}
+
+static u8 GetComponentCount(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2")   return 2;
+    if (type == "VEC3")   return 3;
+    if (type == "VEC4")   return 4;
+    return 0; // Matrices are not used by vertex attributes
+}
+
+// Sparse accessors and data outside the binary chunk are not supported
+static bool ReadAccessor(const JsonValue& gltf, u32 accessorIdx, u64 binSize, GltfAccessor& accessor)
+{
+    const JsonValue& json = gltf["accessors"][accessorIdx];
+    if (json.IsNull() || !json["sparse"].IsNull())
+        return false;
+
+    const JsonValue& view = gltf["bufferViews"][json["bufferView"].GetU32(UINT32_MAX)];
+    if (view.IsNull() || view["buffer"].GetU32() != 0)
+        return false;
+
+    accessor.componentType = json["componentType"].GetU32();
+    accessor.componentCount = GetComponentCount(json["type"].GetString());
+    accessor.count = json["count"].GetU32();
+    accessor.normalized = json["normalized"].GetBool();
+    accessor.offset = view["byteOffset"].GetU32() + json["byteOffset"].GetU32();
+
+    const u32 elementSize = GetComponentSize(accessor.componentType) * accessor.componentCount;
+    accessor.stride = view["byteStride"].GetU32(elementSize);
+    if (elementSize == 0 || accessor.count == 0 || accessor.stride > 255)
+        return false;
+
+    const u64 lastByte = (u64)accessor.offset + (u64)(accessor.count - 1) * accessor.stride + elementSize;
+    return lastByte <= binSize;
+}
+
+static vec4 ReadAccessorElement(const GltfAccessor& accessor, const u8* bin, u32 index)
+{
+    const u8* element = bin + accessor.offset + (u64)index * accessor.stride;
+    vec4 value(0.0f);
+
+    for (u32 c = 0; c < accessor.componentCount; ++c)
+    {
+        switch (accessor.componentType)
+        {
+            case GL_FLOAT:          memcpy(&value[c], element + c * 4, 4); break;
+            case GL_UNSIGNED_BYTE:  value[c] = accessor.normalized ? element[c] / 255.0f : element[c]; break;
+            case GL_BYTE:           value[c] = accessor.normalized ? glm::max(((const i8*)element)[c] / 127.0f, -1.0f) : ((const i8*)element)[c]; break;
+            case GL_UNSIGNED_SHORT: { u16 v; memcpy(&v, element + c * 2, 2); value[c] = accessor.normalized ? v / 65535.0f : v; break; }
+            case GL_SHORT:          { i16 v; memcpy(&v, element + c * 2, 2); value[c] = accessor.normalized ? glm::max(v / 32767.0f, -1.0f) : v; break; }
+            case GL_UNSIGNED_INT:   { u32 v; memcpy(&v, element + c * 4, 4); value[c] = (f32)v; break; }
+        }
+    }
+    return value;
+}
+
+static u32 ReadIndex(const GltfAccessor* indices, const u8* bin, u32 i)
+{
+    if (!indices)
+        return i;
+
+    const u8* element = bin + indices->offset + (u64)i * indices->stride;
+    switch (indices->componentType)
+    {
+        case GL_UNSIGNED_BYTE:  return element[0];
+        case GL_UNSIGNED_SHORT: { u16 v; memcpy(&v, element, 2); return v; }
+        default:                { u32 v; memcpy(&v, element, 4); return v; }
+    }
+}
+
+// Bounds come from the accessor min/max (mandatory for positions). The uv density is
+// estimated from a subset of the triangles, that is enough to pick streaming mips.
+static void ComputePrimitiveBounds(const JsonValue& positionJson, const GltfAccessor& positions, const GltfAccessor* texCoords,
+                                   const GltfAccessor* indices, const u8* bin, Submesh& submesh)
+{
+    vec3 minPos, maxPos;
+    const JsonValue& minJson = positionJson["min"];
+    const JsonValue& maxJson = positionJson["max"];
+    if (minJson.Size() == 3 && maxJson.Size() == 3)
+    {
+        minPos = vec3(minJson[0].GetNumber(), minJson[1].GetNumber(), minJson[2].GetNumber());
+        maxPos = vec3(maxJson[0].GetNumber(), maxJson[1].GetNumber(), maxJson[2].GetNumber());
+    }
+    else
+    {
+        minPos = vec3(FLT_MAX);
+        maxPos = vec3(-FLT_MAX);
+        for (u32 i = 0; i < positions.count; ++i)
+        {
+            vec3 position = vec3(ReadAccessorElement(positions, bin, i));
+            minPos = glm::min(minPos, position);
+            maxPos = glm::max(maxPos, position);
+        }
+    }
+
+    submesh.boundsCenter = (minPos + maxPos) * 0.5f;
+    submesh.boundsRadius = glm::length(maxPos - minPos) * 0.5f;
+    submesh.uvDensity = 0.0f;
+
+    if (!texCoords)
+        return;
+
+    const u32 triangleCount = submesh.indexCount / 3;
+    const u32 step = glm::max(triangleCount / GLTF_UV_DENSITY_SAMPLES, 1u);
+    f64 uvArea = 0.0, worldArea = 0.0;
+
+    for (u32 t = 0; t < triangleCount; t += step)
+    {
+        u32 i0 = ReadIndex(indices, bin, t * 3 + 0);
+        u32 i1 = ReadIndex(indices, bin, t * 3 + 1);
+        u32 i2 = ReadIndex(indices, bin, t * 3 + 2);
+        if (i0 >= positions.count || i1 >= positions.count || i2 >= positions.count ||
+            i0 >= texCoords->count || i1 >= texCoords->count || i2 >= texCoords->count)
+            continue;
+
+        vec3 p0 = vec3(ReadAccessorElement(positions, bin, i0));
+        vec3 edge0 = vec3(ReadAccessorElement(positions, bin, i1)) - p0;
+        vec3 edge1 = vec3(ReadAccessorElement(positions, bin, i2)) - p0;
+        worldArea += 0.5 * glm::length(glm::cross(edge0, edge1));
+
+        vec2 uv0 = vec2(ReadAccessorElement(*texCoords, bin, i0));
+        vec2 uvEdge0 = vec2(ReadAccessorElement(*texCoords, bin, i1)) - uv0;
+        vec2 uvEdge1 = vec2(ReadAccessorElement(*texCoords, bin, i2)) - uv0;
+        uvArea += 0.5 * fabs(uvEdge0.x * uvEdge1.y - uvEdge0.y * uvEdge1.x);
+    }
+
+    submesh.uvDensity = worldArea > 0.0 ? (f32)sqrt(uvArea / worldArea) : 0.0f;
+}
+
+static glm::mat4 GetGltfNodeTransform(const JsonValue& node)
+{
+    const JsonValue& matrix = node["matrix"];
+    if (matrix.Size() == 16)
+    {
+        // Column major, like glm
+        glm::mat4 transform;
+        for (u32 i = 0; i < 16; ++i)
+            transform[i / 4][i % 4] = (f32)matrix[i].GetNumber();
+        return transform;
+    }
+
+    const JsonValue& t = node["translation"];
+    const JsonValue& r = node["rotation"];
+    const JsonValue& s = node["scale"];
+    const glm::quat rotation((f32)r[3].GetNumber(1.0), (f32)r[0].GetNumber(), (f32)r[1].GetNumber(), (f32)r[2].GetNumber());
+
+    return glm::translate(vec3(t[0].GetNumber(), t[1].GetNumber(), t[2].GetNumber())) *
+           glm::mat4_cast(rotation) *
+           glm::scale(vec3(s[0].GetNumber(1.0), s[1].GetNumber(1.0), s[2].GetNumber(1.0)));
+}
+
+// Gathers the transform (relative to the scene) of every node referencing each mesh
+static void CollectGltfInstances(const JsonValue& gltf, u32 nodeIdx, const glm::mat4& parentTransform,
+                                 std::vector<std::vector<glm::mat4>>& meshInstances, u32 depth)
+{
+    const JsonValue& node = gltf["nodes"][nodeIdx];
+    if (node.IsNull() || depth > GLTF_MAX_NODE_DEPTH)
+        return;
+
+    const glm::mat4 transform = parentTransform * GetGltfNodeTransform(node);
+
+    const u32 meshIdx = node["mesh"].GetU32(UINT32_MAX);
+    if (meshIdx < meshInstances.size())
+        meshInstances[meshIdx].push_back(transform);
+
+    const JsonValue& children = node["children"];
+    for (u32 i = 0; i < children.Size(); ++i)
+        CollectGltfInstances(gltf, children[i].GetU32(UINT32_MAX), transform, meshInstances, depth + 1);
+}
+
+// Path of the image used by a glTF texture. Images embedded in the binary chunk are written
+// next to the .glb (once) so the texture cooker can treat them like any other file.
+static std::string GetGltfImagePath(const JsonValue& gltf, const JsonValue& textureInfo, const char* filename,
+                                    String directory, const u8* bin, u64 binSize, u64 glbTimestamp)
+{
+    const u32 imageIdx = gltf["textures"][textureInfo["index"].GetU32(UINT32_MAX)]["source"].GetU32(UINT32_MAX);
+    const JsonValue& image = gltf["images"][imageIdx];
+    if (image.IsNull())
+        return std::string();
+
+    if (!image["uri"].IsNull())
+    {
+        const std::string& uri = image["uri"].GetString();
+        if (uri.compare(0, 5, "data:") == 0)
+        {
+            ELOG("Error loading %s: data uri images are not supported", filename);
+            return std::string();
+        }
+        return MakePath(directory, MakeString(uri.c_str())).str;
+    }
+
+    const JsonValue& view = gltf["bufferViews"][image["bufferView"].GetU32(UINT32_MAX)];
+    const u64 offset = view["byteOffset"].GetU32();
+    const u64 size = view["byteLength"].GetU32();
+    if (view.IsNull() || offset + size > binSize)
+        return std::string();
+
+    std::string path = filename;
+    path = path.substr(0, path.find_last_of('.')) + "_image" + std::to_string(imageIdx) +
+           (image["mimeType"].GetString() == "image/jpeg" ? ".jpg" : ".png");
+
+    if (GetFileLastWriteTimestamp(path.c_str()) < glbTimestamp)
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            ELOG("Could not extract image %s", path.c_str());
+            return std::string();
+        }
+        fwrite(bin + offset, 1, size, file);
+        fclose(file);
+    }
+
+    return path;
+}
+
+static void LoadGltfMaterial(App* app, const JsonValue& gltf, const JsonValue& json, const char* filename,
+                             String directory, const u8* bin, u64 binSize, u64 glbTimestamp, Material& material)
+{
+    const JsonValue& pbr = json["pbrMetallicRoughness"];
+    const JsonValue& baseColor = pbr["baseColorFactor"];
+    const JsonValue& emissive = json["emissiveFactor"];
+
+    material.name = json["name"].GetString();
+    material.albedo = vec3(baseColor[0].GetNumber(1.0), baseColor[1].GetNumber(1.0), baseColor[2].GetNumber(1.0));
+    material.emissive = vec3(emissive[0].GetNumber(), emissive[1].GetNumber(), emissive[2].GetNumber());
+    material.smoothness = 1.0f - (f32)pbr["roughnessFactor"].GetNumber(1.0);
+
+    std::string path;
+    if (!(path = GetGltfImagePath(gltf, pbr["baseColorTexture"], filename, directory, bin, binSize, glbTimestamp)).empty())
+        material.albedoTextureIdx = LoadTexture2D(app, path.c_str());
+    if (!(path = GetGltfImagePath(gltf, json["emissiveTexture"], filename, directory, bin, binSize, glbTimestamp)).empty())
+        material.emissiveTextureIdx = LoadTexture2D(app, path.c_str());
+    // Metallic (b) and roughness (g) is the closest thing to a specular map glTF has
+    if (!(path = GetGltfImagePath(gltf, pbr["metallicRoughnessTexture"], filename, directory, bin, binSize, glbTimestamp)).empty())
+        material.specularTextureIdx = LoadTexture2D(app, path.c_str(), TextureUsage_Linear);
+    if (!(path = GetGltfImagePath(gltf, json["normalTexture"], filename, directory, bin, binSize, glbTimestamp)).empty())
+        material.normalsTextureIdx = LoadTexture2D(app, path.c_str(), TextureUsage_Normal);
+}
+
+u32 LoadGlbModel(App* app, const char* filename)
+{
+    MappedFile file = MapFile(filename);
+    if (!file.data)
+    {
+        ELOG("Error loading mesh %s: could not open the file", filename);
+        return UINT32_MAX;
+    }
+
+    // Header, JSON chunk and (optional) binary chunk
+    const u8* data = (const u8*)file.data;
+    const GlbHeader* header = (const GlbHeader*)data;
+    const GlbChunkHeader* jsonChunk = (const GlbChunkHeader*)(data + sizeof(GlbHeader));
+
+    if (file.size < sizeof(GlbHeader) + sizeof(GlbChunkHeader) || header->magic != GLB_MAGIC || header->version != GLB_VERSION ||
+        jsonChunk->type != GLB_CHUNK_JSON || sizeof(GlbHeader) + sizeof(GlbChunkHeader) + (u64)jsonChunk->length > file.size)
+    {
+        ELOG("Error loading mesh %s: not a glTF 2.0 binary file", filename);
+        UnmapFile(file);
+        return UINT32_MAX;
+    }
+
+    const char* jsonText = (const char*)(jsonChunk + 1);
+    const u64 binChunkOffset = sizeof(GlbHeader) + sizeof(GlbChunkHeader) + (u64)jsonChunk->length;
+
+    const u8* bin = NULL;
+    u64 binSize = 0;
+    if (binChunkOffset + sizeof(GlbChunkHeader) <= file.size)
+    {
+        const GlbChunkHeader* binChunk = (const GlbChunkHeader*)(data + binChunkOffset);
+        if (binChunk->type == GLB_CHUNK_BIN && binChunkOffset + sizeof(GlbChunkHeader) + binChunk->length <= file.size)
+        {
+            bin = (const u8*)(binChunk + 1);
+            binSize = binChunk->length;
+        }
+    }
+
+    JsonValue gltf;
+    if (!ParseJson(jsonText, jsonChunk->length, gltf))
+    {
+        ELOG("Error loading mesh %s: malformed JSON chunk", filename);
+        UnmapFile(file);
+        return UINT32_MAX;
+    }
+
+    // Only the embedded buffer is supported, external .bin files would need a GL buffer each
+    if (!bin || gltf["buffers"].Size() != 1 || !gltf["buffers"][0]["uri"].IsNull())
+    {
+        ELOG("Error loading mesh %s: only self contained .glb files are supported", filename);
+        UnmapFile(file);
+        return UINT32_MAX;
+    }
+
+    app->meshes.push_back(Mesh{});
+    Mesh& mesh = app->meshes.back();
+    u32 meshIdx = (u32)app->meshes.size() - 1u;
+
+    app->models.push_back(Model{});
+    Model& model = app->models.back();
+    model.meshIdx = meshIdx;
+    u32 modelIdx = (u32)app->models.size() - 1u;
+
+    String directory = GetDirectoryPart(MakeString(filename));
+    const u64 glbTimestamp = GetFileLastWriteTimestamp(filename);
+
+    const JsonValue& materials = gltf["materials"];
+    u32 baseMaterialIdx = (u32)app->materials.size();
+    for (u32 i = 0; i < materials.Size(); ++i)
+    {
+        Material material = {};
+        LoadGltfMaterial(app, gltf, materials[i], filename, directory, bin, binSize, glbTimestamp, material);
+        app->materials.push_back(material);
+    }
+    u32 defaultMaterialIdx = UINT32_MAX;
+
+    // Non indexed primitives get their indices generated after the binary chunk
+    const u32 generatedIndicesOffset = (u32)((binSize + 3) & ~3ull);
+    std::vector<u32> generatedIndices;
+
+    // Position-only programs read tightly packed float positions, other encodings are
+    // converted after the generated indices
+    std::vector<vec3> generatedPositions;
+    std::vector<u32> generatedPositionSubmeshes;
+
+    const JsonValue& meshes = gltf["meshes"];
+    std::vector<std::vector<u32>> meshSubmeshes(meshes.Size());
+    for (u32 m = 0; m < meshes.Size(); ++m)
+    {
+        const JsonValue& primitives = meshes[m]["primitives"];
+        for (u32 p = 0; p < primitives.Size(); ++p)
+        {
+            const JsonValue& primitive = primitives[p];
+            const JsonValue& attributes = primitive["attributes"];
+
+            GltfAccessor positions, normals, texCoords, tangents, indices;
+            const bool hasPositions = ReadAccessor(gltf, attributes["POSITION"].GetU32(UINT32_MAX), binSize, positions);
+            const bool hasNormals = ReadAccessor(gltf, attributes["NORMAL"].GetU32(UINT32_MAX), binSize, normals);
+            const bool hasTexCoords = ReadAccessor(gltf, attributes["TEXCOORD_0"].GetU32(UINT32_MAX), binSize, texCoords);
+            const bool hasTangents = ReadAccessor(gltf, attributes["TANGENT"].GetU32(UINT32_MAX), binSize, tangents);
+            const bool hasIndices = ReadAccessor(gltf, primitive["indices"].GetU32(UINT32_MAX), binSize, indices);
+
+            if (primitive["mode"].GetU32(GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES || !hasPositions)
+            {
+                ELOG("Skipping primitive %u of mesh %u in %s: only triangles with positions are supported", p, m, filename);
+                continue;
+            }
+
+            // Same locations as the Assimp path: position, normal, uv, tangent (bitangents are not stored in glTF)
+            Submesh submesh = {};
+            const GltfAccessor* streams[] = { &positions, hasNormals ? &normals : NULL, hasTexCoords ? &texCoords : NULL, hasTangents ? &tangents : NULL };
+            for (u32 location = 0; location < ARRAY_COUNT(streams); ++location)
+            {
+                if (!streams[location])
+                    continue;
+
+                VertexBufferAttribute attribute = {};
+                attribute.location = (u8)location;
+                attribute.componentCount = streams[location]->componentCount;
+                attribute.offset = streams[location]->offset;
+                attribute.type = streams[location]->componentType;
+                attribute.normalized = streams[location]->normalized;
+                attribute.stride = (u8)streams[location]->stride;
+                submesh.vertexBufferLayout.attributes.push_back(attribute);
+            }
+
+            if (hasIndices)
+            {
+                submesh.indexOffset = indices.offset;
+                submesh.indexCount = indices.count;
+                submesh.indexType = indices.componentType;
+            }
+            else
+            {
+                submesh.indexOffset = generatedIndicesOffset + (u32)generatedIndices.size() * sizeof(u32);
+                submesh.indexCount = positions.count;
+                submesh.indexType = GL_UNSIGNED_INT;
+                for (u32 i = 0; i < positions.count; ++i)
+                    generatedIndices.push_back(i);
+            }
+
+            if (positions.componentType == GL_FLOAT && positions.componentCount == 3 && positions.stride == sizeof(vec3))
+            {
+                submesh.positionOffset = positions.offset;
+            }
+            else
+            {
+                submesh.positionOffset = (u32)(generatedPositions.size() * sizeof(vec3)); // Relative until the indices are known
+                generatedPositionSubmeshes.push_back((u32)mesh.submeshes.size());
+                for (u32 i = 0; i < positions.count; ++i)
+                    generatedPositions.push_back(vec3(ReadAccessorElement(positions, bin, i)));
+            }
+
+            ComputePrimitiveBounds(gltf["accessors"][attributes["POSITION"].GetU32()], positions, hasTexCoords ? &texCoords : NULL,
+                                   hasIndices ? &indices : NULL, bin, submesh);
+
+            u32 materialIdx = primitive["material"].GetU32(UINT32_MAX);
+            if (materialIdx >= materials.Size())
+            {
+                if (defaultMaterialIdx == UINT32_MAX)
+                {
+                    // glTF default material: white, fully rough
+                    Material material = {};
+                    material.name = "DefaultMaterial";
+                    material.albedo = vec3(1.0f);
+                    defaultMaterialIdx = (u32)app->materials.size();
+                    app->materials.push_back(material);
+                }
+                model.materialIdx.push_back(defaultMaterialIdx);
+            }
+            else
+            {
+                model.materialIdx.push_back(baseMaterialIdx + materialIdx);
+            }
+
+            meshSubmeshes[m].push_back((u32)mesh.submeshes.size());
+            mesh.submeshes.push_back(submesh);
+        }
+    }
+
+    // The vertices can't be transformed without copying them, so the node hierarchy is kept
+    // and each primitive is instanced once per node using its mesh
+    std::vector<std::vector<glm::mat4>> meshInstances(meshes.Size());
+    const JsonValue& scene = gltf["scenes"][gltf["scene"].GetU32(0)];
+    if (scene.IsNull())
+    {
+        for (std::vector<glm::mat4>& instances : meshInstances)
+            instances.push_back(glm::mat4(1.0f));
+    }
+    for (u32 i = 0; i < scene["nodes"].Size(); ++i)
+        CollectGltfInstances(gltf, scene["nodes"][i].GetU32(UINT32_MAX), glm::mat4(1.0f), meshInstances, 0);
+
+    for (u32 m = 0; m < meshes.Size(); ++m)
+        for (u32 submeshIdx : meshSubmeshes[m])
+            if (!meshInstances[m].empty())
+                AddInstanceBatch(model, submeshIdx, meshInstances[m]);
+
+    const u32 generatedPositionsOffset = generatedIndicesOffset + (u32)generatedIndices.size() * sizeof(u32);
+    for (u32 submeshIdx : generatedPositionSubmeshes)
+        mesh.submeshes[submeshIdx].positionOffset += generatedPositionsOffset;
+
+    // The binary chunk goes to the GPU as is, it is the vertex and the index buffer at once
+    const u32 bufferSize = generatedPositionsOffset + (u32)generatedPositions.size() * sizeof(vec3);
+    glGenBuffers(1, &mesh.vertexBufferHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
+    if (generatedIndices.empty() && generatedPositions.empty())
+    {
+        glBufferData(GL_ARRAY_BUFFER, binSize, bin, GL_STATIC_DRAW);
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, bufferSize, NULL, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, binSize, bin);
+        glBufferSubData(GL_ARRAY_BUFFER, generatedIndicesOffset, generatedIndices.size() * sizeof(u32), generatedIndices.data());
+        glBufferSubData(GL_ARRAY_BUFFER, generatedPositionsOffset, generatedPositions.size() * sizeof(vec3), generatedPositions.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    mesh.indexBufferHandle = mesh.vertexBufferHandle;
+
+    UploadModelInstances(model, mesh);
+    ComputeModelBounds(app, model);
+
+    UnmapFile(file);
+
+    return modelIdx;
+}
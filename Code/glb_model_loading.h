@@ -0,0 +1,17 @@
+//
+// glb_model_loading.h: Loader for binary glTF 2.0 files (.glb). glTF data is already laid
+// out for the GPU, so the binary chunk is uploaded as is into a single GL buffer and the
+// accessors become vertex attributes and index ranges pointing inside it. The node hierarchy
+// is kept: primitives are drawn instanced, once per node using their mesh.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Loads every triangle primitive of the file as a submesh, with its material and textures.
+ * Embedded images are extracted next to the .glb so they go through the texture cooker.
+ * Returns the model index or UINT32_MAX on failure, like LoadModel().
+ */
+u32 LoadGlbModel(App* app, const char* filename);
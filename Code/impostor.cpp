@@ -0,0 +1,170 @@
+#include "impostor.h"
+#include "mesh_lod.h"
+
+// Inverse of EncodeHemiOctahedron() in shaders.glsl, uv in [0,1]
+static vec3 DecodeHemiOctahedron(vec2 uv)
+{
+    const vec2 t = uv * 2.0f - 1.0f;
+    const f32 x = (t.x + t.y) * 0.5f;
+    const f32 z = (t.x - t.y) * 0.5f;
+    return glm::normalize(vec3(x, 1.0f - glm::abs(x) - glm::abs(z), z));
+}
+
+// Same basis the IMPOSTOR vertex shader builds for the quad
+static void ImpostorBasis(const vec3& viewDirection, vec3& right, vec3& up)
+{
+    right = glm::cross(vec3(0.0f, 1.0f, 0.0f), viewDirection);
+    right = glm::dot(right, right) > 1e-6f ? glm::normalize(right) : vec3(1.0f, 0.0f, 0.0f);
+    up = glm::cross(viewDirection, right);
+}
+
+u32 BakeImpostor(App* app, u32 modelIdx, u32 frameCount, u32 frameResolution)
+{
+    Model& model = app->models[modelIdx];
+    Mesh& mesh = app->meshes[model.meshIdx];
+
+    Impostor impostor = {};
+    impostor.frameCount = frameCount;
+    impostor.frameResolution = frameResolution;
+    impostor.boundsCenter = model.boundsCenter;
+    impostor.boundsRadius = model.boundsRadius;
+    if (impostor.boundsRadius <= 0.0f || frameCount < 2)
+        return UINT32_MAX;
+
+    const ivec2 atlasSize(frameCount * frameResolution);
+    impostor.albedoHandle = CreateAttachmentTexture(GL_RGBA8, atlasSize, GL_RGBA, GL_UNSIGNED_BYTE);
+    impostor.normalDepthHandle = CreateAttachmentTexture(GL_RGBA8, atlasSize, GL_RGBA, GL_UNSIGNED_BYTE);
+    GLuint depthHandle = CreateAttachmentTexture(GL_DEPTH_COMPONENT24, atlasSize, GL_DEPTH_COMPONENT, GL_FLOAT);
+
+    GLuint framebufferHandle;
+    glGenFramebuffers(1, &framebufferHandle);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebufferHandle);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, impostor.albedoHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, impostor.normalDepthHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthHandle, 0);
+
+    if (!CheckFramebufferStatus())
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebufferHandle);
+        GLuint textures[] = { impostor.albedoHandle, impostor.normalDepthHandle, depthHandle };
+        glDeleteTextures(ARRAY_COUNT(textures), textures);
+        return UINT32_MAX;
+    }
+
+    GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(ARRAY_COUNT(drawBuffers), drawBuffers);
+
+    glViewport(0, 0, atlasSize.x, atlasSize.y);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+
+    const bool instanced = !model.instanceBatches.empty();
+    Program& program = app->programs[instanced ? app->impostorBakeInstancedProgramIdx : app->impostorBakeProgramIdx];
+    glUseProgram(program.handle);
+
+    const GLint uViewProjection = GetUniformLocation(program, "uViewProjection");
+    const GLint uTexture = GetUniformLocation(program, "uTexture");
+    const GLint uAlbedoUvTransform = GetUniformLocation(program, "uAlbedoUvTransform");
+    const GLint uViewDirection = GetUniformLocation(program, "uViewDirection");
+    const GLint uBounds = GetUniformLocation(program, "uBounds");
+
+    const vec3 center = impostor.boundsCenter;
+    const f32 radius = impostor.boundsRadius;
+    glUniform1i(uTexture, 0);
+    glUniform4f(uBounds, center.x, center.y, center.z, radius);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Orthographic views fitted to the bounding sphere, one per frame
+    const glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, radius * 3.0f);
+    for (u32 y = 0; y < frameCount; ++y)
+    {
+        for (u32 x = 0; x < frameCount; ++x)
+        {
+            const vec3 viewDirection = DecodeHemiOctahedron(vec2(x, y) / (f32)(frameCount - 1));
+            vec3 right, up;
+            ImpostorBasis(viewDirection, right, up);
+
+            const glm::mat4 view = glm::lookAt(center + viewDirection * radius * 2.0f, center, up);
+            const glm::mat4 viewProjection = projection * view;
+
+            glViewport(x * frameResolution, y * frameResolution, frameResolution, frameResolution);
+            glUniformMatrix4fv(uViewProjection, 1, GL_FALSE, glm::value_ptr(viewProjection));
+            glUniform3fv(uViewDirection, 1, glm::value_ptr(viewDirection));
+
+            const u32 drawCount = instanced ? (u32)model.instanceBatches.size() : (u32)mesh.submeshes.size();
+            for (u32 d = 0; d < drawCount; ++d)
+            {
+                const u32 submeshIdx = instanced ? model.instanceBatches[d].submeshIdx : d;
+                const Submesh& submesh = mesh.submeshes[submeshIdx];
+                glBindVertexArray(FindVAO(mesh, submeshIdx, program));
+
+                const Material& material = app->materials[model.materialIdx[submeshIdx]];
+                // The bake has no constant albedo path, materials without a map bake white
+                const u32 albedoTextureIdx = material.albedoTextureIdx < app->textures.size() ? material.albedoTextureIdx : app->whiteTexIdx;
+                const Texture& albedoTexture = app->textures[albedoTextureIdx];
+                glBindTexture(GL_TEXTURE_2D, albedoTexture.inAtlas ? app->textureAtlasHandle : albedoTexture.handle);
+                glUniform4fv(uAlbedoUvTransform, 1, glm::value_ptr(material.albedoUvTransform));
+
+                if (instanced)
+                {
+                    const InstanceBatch& batch = model.instanceBatches[d];
+                    glDrawElementsInstancedBaseInstance(GL_TRIANGLES, submesh.indexCount, submesh.indexType, (void*)(u64)submesh.indexOffset,
+                                                        batch.instanceCount, batch.firstInstance);
+                }
+                else
+                {
+                    glDrawElements(GL_TRIANGLES, submesh.indexCount, submesh.indexType, (void*)(u64)submesh.indexOffset);
+                }
+            }
+        }
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebufferHandle);
+    glDeleteTextures(1, &depthHandle);
+    glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+
+    // Mips keep the quads from shimmering once they are a few pixels big
+    GLuint atlases[] = { impostor.albedoHandle, impostor.normalDepthHandle };
+    for (GLuint atlas : atlases)
+    {
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    ILOG("Baked impostor with %ux%u frames of %u pixels", frameCount, frameCount, frameResolution);
+
+    model.impostorIdx = (u32)app->impostors.size();
+    app->impostors.push_back(impostor);
+    return model.impostorIdx;
+}
+
+void DrawImpostor(App* app, const Model& model, bool gbuffer)
+{
+    const Impostor& impostor = app->impostors[model.impostorIdx];
+    const Program& program = app->programs[gbuffer ? app->impostorGBufferProgramIdx : app->impostorProgramIdx];
+    glUseProgram(program.handle);
+
+    glUniform1i(GetUniformLocation(program, "uAlbedo"), 0);
+    glUniform1i(GetUniformLocation(program, "uNormalDepth"), 1);
+    glUniform1i(GetUniformLocation(program, "uFrameCount"), (GLint)impostor.frameCount);
+    glUniform4f(GetUniformLocation(program, "uBounds"), impostor.boundsCenter.x, impostor.boundsCenter.y, impostor.boundsCenter.z, impostor.boundsRadius);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, impostor.normalDepthHandle);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, impostor.albedoHandle);
+
+    glBindVertexArray(app->impostorVao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+
+    app->drawnTriangles += 2;
+}
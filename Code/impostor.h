@@ -0,0 +1,26 @@
+//
+// impostor.h: Octahedral impostors. A model is rendered once from a hemisphere of directions
+// into an atlas of frames (albedo plus normal and depth), and far away objects using it are
+// drawn as a single camera facing quad blending the frames closest to the view direction.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define IMPOSTOR_FRAME_COUNT      8   // Frames per side of the atlas
+#define IMPOSTOR_FRAME_RESOLUTION 128
+
+/**
+ * Bakes the impostor of a model with the IMPOSTOR_BAKE programs and sets Model::impostorIdx.
+ * Uses whatever mips of the textures are resident at the time. Returns the impostor index or
+ * UINT32_MAX on failure.
+ */
+u32 BakeImpostor(App* app, u32 modelIdx, u32 frameCount = IMPOSTOR_FRAME_COUNT, u32 frameResolution = IMPOSTOR_FRAME_RESOLUTION);
+
+/**
+ * Draws the impostor of the model with the IMPOSTOR program, or its GBUFFER variant when
+ * filling the G-buffer of Mode_Deferred. The LocalParams block of the game object has to be
+ * bound already.
+ */
+void DrawImpostor(App* app, const Model& model, bool gbuffer = false);
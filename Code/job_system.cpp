@@ -0,0 +1,156 @@
+#include "job_system.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+struct Job
+{
+    std::function<void()> func;
+    JobCounter*           counter;
+};
+
+struct JobSystem
+{
+    std::vector<std::thread> workers;
+    std::deque<Job>          queue;
+    std::mutex               queueMutex;
+    std::condition_variable  queueCondition;
+    bool                     isRunning = false;
+};
+
+static JobSystem GlobalJobSystem;
+
+static bool PopJob(Job& job)
+{
+    std::lock_guard<std::mutex> lock(GlobalJobSystem.queueMutex);
+    if (GlobalJobSystem.queue.empty())
+        return false;
+
+    job = std::move(GlobalJobSystem.queue.front());
+    GlobalJobSystem.queue.pop_front();
+    return true;
+}
+
+static void ExecuteJob(Job& job)
+{
+    job.func();
+    if (job.counter)
+        job.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+static void WorkerLoop()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(GlobalJobSystem.queueMutex);
+            GlobalJobSystem.queueCondition.wait(lock, [] { return !GlobalJobSystem.queue.empty() || !GlobalJobSystem.isRunning; });
+
+            if (!GlobalJobSystem.isRunning && GlobalJobSystem.queue.empty())
+                return;
+
+            job = std::move(GlobalJobSystem.queue.front());
+            GlobalJobSystem.queue.pop_front();
+        }
+        ExecuteJob(job);
+    }
+}
+
+void InitJobSystem(u32 workerCount)
+{
+    if (GlobalJobSystem.isRunning)
+        return;
+
+    if (workerCount == 0)
+    {
+        u32 hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    GlobalJobSystem.isRunning = true;
+    for (u32 i = 0; i < workerCount; ++i)
+        GlobalJobSystem.workers.emplace_back(WorkerLoop);
+
+    ILOG("Job system started with %u workers", workerCount);
+}
+
+void ShutdownJobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(GlobalJobSystem.queueMutex);
+        GlobalJobSystem.isRunning = false;
+    }
+    GlobalJobSystem.queueCondition.notify_all();
+
+    for (std::thread& worker : GlobalJobSystem.workers)
+        worker.join();
+    GlobalJobSystem.workers.clear();
+}
+
+u32 GetJobWorkerCount()
+{
+    return (u32)GlobalJobSystem.workers.size();
+}
+
+void RunJob(std::function<void()> job, JobCounter* counter)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    if (!GlobalJobSystem.isRunning)
+    {
+        // No workers (yet): run it right away so callers never wait forever
+        Job inlineJob{ std::move(job), counter };
+        ExecuteJob(inlineJob);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(GlobalJobSystem.queueMutex);
+        GlobalJobSystem.queue.push_back(Job{ std::move(job), counter });
+    }
+    GlobalJobSystem.queueCondition.notify_one();
+}
+
+bool IsJobDone(const JobCounter& counter)
+{
+    return counter.pending.load(std::memory_order_acquire) == 0;
+}
+
+void WaitForJobs(JobCounter& counter)
+{
+    while (!IsJobDone(counter))
+    {
+        Job job;
+        if (PopJob(job))
+            ExecuteJob(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void ParallelFor(u32 count, u32 batchSize, const std::function<void(u32 begin, u32 end)>& func)
+{
+    if (count == 0)
+        return;
+
+    if (batchSize == 0)
+        batchSize = 1;
+
+    if (count <= batchSize || GetJobWorkerCount() == 0)
+    {
+        func(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for (u32 begin = 0; begin < count; begin += batchSize)
+    {
+        u32 end = begin + batchSize < count ? begin + batchSize : count;
+        RunJob([&func, begin, end]() { func(begin, end); }, &counter);
+    }
+    WaitForJobs(counter);
+}
@@ -0,0 +1,44 @@
+//
+// job_system.h: A small pool of worker threads. CPU heavy work (texture processing,
+// model importing...) is split in jobs that the workers (and the calling thread) consume.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+#include <functional>
+
+struct JobCounter
+{
+    std::atomic<u32> pending{ 0 }; // Jobs submitted with this counter that did not finish yet
+};
+
+/**
+ * Starts the worker threads. A workerCount of 0 uses one worker per hardware thread
+ * except the one running the main loop.
+ */
+void InitJobSystem(u32 workerCount = 0);
+
+void ShutdownJobSystem();
+
+u32 GetJobWorkerCount();
+
+/**
+ * Queues a job. If a counter is given it is incremented now and decremented once the job finishes.
+ */
+void RunJob(std::function<void()> job, JobCounter* counter = nullptr);
+
+bool IsJobDone(const JobCounter& counter);
+
+/**
+ * Waits for all the jobs of the counter. The calling thread runs queued jobs meanwhile,
+ * so it is safe to wait from inside a job.
+ */
+void WaitForJobs(JobCounter& counter);
+
+/**
+ * Calls func(begin, end) over [0, count) split in batches of batchSize elements and
+ * waits for all of them to finish.
+ */
+void ParallelFor(u32 count, u32 batchSize, const std::function<void(u32 begin, u32 end)>& func);
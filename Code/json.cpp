@@ -0,0 +1,256 @@
+#include "json.h"
+
+#include <charconv>
+#include <string.h>
+
+// Deeper documents are rejected instead of risking a stack overflow
+#define JSON_MAX_DEPTH 128
+
+static const JsonValue JsonNull;
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+    if (type == JsonType_Object)
+        for (const std::pair<std::string, JsonValue>& member : members)
+            if (member.first == key)
+                return member.second;
+    return JsonNull;
+}
+
+const JsonValue& JsonValue::operator[](u32 index) const
+{
+    if (type == JsonType_Array && index < elements.size())
+        return elements[index];
+    return JsonNull;
+}
+
+struct JsonParser
+{
+    const char* begin;
+    const char* c;
+    const char* end;
+    u32         depth;
+};
+
+static void SkipWhitespace(JsonParser& parser)
+{
+    while (parser.c < parser.end && (*parser.c == ' ' || *parser.c == '\t' || *parser.c == '\n' || *parser.c == '\r'))
+        ++parser.c;
+}
+
+static bool Consume(JsonParser& parser, char expected)
+{
+    SkipWhitespace(parser);
+    if (parser.c < parser.end && *parser.c == expected)
+    {
+        ++parser.c;
+        return true;
+    }
+    return false;
+}
+
+static bool ConsumeLiteral(JsonParser& parser, const char* literal)
+{
+    const size_t len = strlen(literal);
+    if ((size_t)(parser.end - parser.c) < len || memcmp(parser.c, literal, len) != 0)
+        return false;
+    parser.c += len;
+    return true;
+}
+
+static void AppendUtf8(std::string& str, u32 codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        str += (char)codepoint;
+    }
+    else if (codepoint < 0x800)
+    {
+        str += (char)(0xC0 | (codepoint >> 6));
+        str += (char)(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        str += (char)(0xE0 | (codepoint >> 12));
+        str += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        str += (char)(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        str += (char)(0xF0 | (codepoint >> 18));
+        str += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        str += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        str += (char)(0x80 | (codepoint & 0x3F));
+    }
+}
+
+static bool ParseHex4(JsonParser& parser, u32& value)
+{
+    if (parser.end - parser.c < 4)
+        return false;
+    std::from_chars_result result = std::from_chars(parser.c, parser.c + 4, value, 16);
+    if (result.ptr != parser.c + 4)
+        return false;
+    parser.c += 4;
+    return true;
+}
+
+static bool ParseString(JsonParser& parser, std::string& str)
+{
+    if (!Consume(parser, '"'))
+        return false;
+
+    while (parser.c < parser.end && *parser.c != '"')
+    {
+        const char* run = parser.c;
+        while (parser.c < parser.end && *parser.c != '"' && *parser.c != '\\')
+            ++parser.c;
+        str.append(run, parser.c);
+
+        if (parser.c < parser.end && *parser.c == '\\')
+        {
+            if (++parser.c >= parser.end)
+                return false;
+
+            switch (*parser.c++)
+            {
+                case '"':  str += '"';  break;
+                case '\\': str += '\\'; break;
+                case '/':  str += '/';  break;
+                case 'b':  str += '\b'; break;
+                case 'f':  str += '\f'; break;
+                case 'n':  str += '\n'; break;
+                case 'r':  str += '\r'; break;
+                case 't':  str += '\t'; break;
+                case 'u':
+                {
+                    u32 codepoint;
+                    if (!ParseHex4(parser, codepoint))
+                        return false;
+
+                    // Characters outside the BMP come as a surrogate pair
+                    u32 low;
+                    if (codepoint >= 0xD800 && codepoint < 0xDC00 && ConsumeLiteral(parser, "\\u") && ParseHex4(parser, low))
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+
+                    AppendUtf8(str, codepoint);
+                    break;
+                }
+                default: return false;
+            }
+        }
+    }
+
+    return Consume(parser, '"');
+}
+
+static bool ParseValue(JsonParser& parser, JsonValue& value)
+{
+    SkipWhitespace(parser);
+    if (parser.c >= parser.end)
+        return false;
+
+    switch (*parser.c)
+    {
+        case '{':
+        {
+            if (++parser.depth > JSON_MAX_DEPTH)
+                return false;
+
+            ++parser.c;
+            value.type = JsonType_Object;
+            if (Consume(parser, '}'))
+                break;
+
+            do
+            {
+                value.members.emplace_back();
+                if (!ParseString(parser, value.members.back().first) || !Consume(parser, ':') ||
+                    !ParseValue(parser, value.members.back().second))
+                    return false;
+            }
+            while (Consume(parser, ','));
+
+            if (!Consume(parser, '}'))
+                return false;
+            parser.depth--;
+            break;
+        }
+        case '[':
+        {
+            if (++parser.depth > JSON_MAX_DEPTH)
+                return false;
+
+            ++parser.c;
+            value.type = JsonType_Array;
+            if (Consume(parser, ']'))
+                break;
+
+            do
+            {
+                value.elements.emplace_back();
+                if (!ParseValue(parser, value.elements.back()))
+                    return false;
+            }
+            while (Consume(parser, ','));
+
+            if (!Consume(parser, ']'))
+                return false;
+            parser.depth--;
+            break;
+        }
+        case '"':
+        {
+            value.type = JsonType_String;
+            return ParseString(parser, value.string);
+        }
+        case 't':
+        case 'f':
+        {
+            value.type = JsonType_Bool;
+            value.boolean = *parser.c == 't';
+            return ConsumeLiteral(parser, value.boolean ? "true" : "false");
+        }
+        case 'n':
+        {
+            value.type = JsonType_Null;
+            return ConsumeLiteral(parser, "null");
+        }
+        default:
+        {
+            value.type = JsonType_Number;
+            std::from_chars_result result = std::from_chars(parser.c, parser.end, value.number);
+            if (result.ec != std::errc())
+                return false;
+            parser.c = result.ptr;
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool ParseJson(const char* text, u64 length, JsonValue& root)
+{
+    JsonParser parser = { text, text, text + length, 0 };
+    root = JsonValue{};
+
+    if (!ParseValue(parser, root))
+    {
+        ELOG("JSON parse error at offset %u", (u32)(parser.c - parser.begin));
+        return false;
+    }
+
+    // Trailing padding (glTF pads its JSON chunk with spaces) is fine, anything else is not
+    SkipWhitespace(parser);
+    while (parser.c < parser.end && *parser.c == '\0')
+        ++parser.c;
+
+    if (parser.c != parser.end)
+    {
+        ELOG("JSON parse error: unexpected data at offset %u", (u32)(parser.c - parser.begin));
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,46 @@
+//
+// json.h: Minimal JSON reader. Parses a whole document into a tree of JsonValue, which is
+// enough for the small metadata documents we read (glTF headers, caches...).
+//
+
+#pragma once
+
+#include "platform.h"
+
+enum JsonType
+{
+    JsonType_Null,
+    JsonType_Bool,
+    JsonType_Number,
+    JsonType_String,
+    JsonType_Array,
+    JsonType_Object
+};
+
+struct JsonValue
+{
+    JsonType                                       type = JsonType_Null;
+    bool                                           boolean = false;
+    f64                                            number = 0.0;
+    std::string                                    string;
+    std::vector<JsonValue>                         elements; // Arrays
+    std::vector<std::pair<std::string, JsonValue>> members;  // Objects, in document order
+
+    // Missing members and out of range elements return a null value, so lookups can be chained
+    const JsonValue& operator[](const char* key) const;
+    const JsonValue& operator[](u32 index) const;
+    const JsonValue& operator[](i32 index) const { return (*this)[(u32)index]; } // So literal 0 is not taken as a key
+
+    bool IsNull() const { return type == JsonType_Null; }
+    u32  Size() const { return type == JsonType_Array ? (u32)elements.size() : (u32)members.size(); }
+
+    f64                GetNumber(f64 defaultValue = 0.0) const { return type == JsonType_Number ? number : defaultValue; }
+    u32                GetU32(u32 defaultValue = 0) const { return type == JsonType_Number ? (u32)number : defaultValue; }
+    bool               GetBool(bool defaultValue = false) const { return type == JsonType_Bool ? boolean : defaultValue; }
+    const std::string& GetString() const { return string; }
+};
+
+/**
+ * Parses the text into root. Returns false (and logs where) if the document is malformed.
+ */
+bool ParseJson(const char* text, u64 length, JsonValue& root);
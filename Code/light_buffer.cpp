@@ -0,0 +1,91 @@
+#include "light_buffer.h"
+
+#include <string.h>
+
+static GpuLight PackLight(const Light& light, u32 shadowView)
+{
+    GpuLight gpuLight = {};
+    gpuLight.positionRange = vec4(light.position, light.type == LIGHT_POINT ? light.range : 0.0f);
+    gpuLight.color = light.color;
+    gpuLight.shadowView = shadowView;
+    gpuLight.direction = light.direction;
+    gpuLight.type = light.type;
+    return gpuLight;
+}
+
+void InitLightBuffer(App* app)
+{
+    glGenBuffers(1, &app->lightBuffer);
+}
+
+void UpdateLightBuffer(App* app)
+{
+    const u32 lightCount = (u32)app->lights.size();
+    app->lightBufferUploadedBytes = 0;
+    app->lightBufferUploads = 0;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->lightBuffer);
+
+    if (lightCount > app->lightBufferCapacity || !app->lightBufferCapacity)
+    {
+        // Grown geometrically and uploaded whole. Entries past the lights are zero: directional
+        // lights without color, never listed and skipped by the tiled culling
+        u32 capacity = glm::max(app->lightBufferCapacity, 64u);
+        while (capacity < lightCount)
+            capacity *= 2;
+
+        app->gpuLights.resize(lightCount);
+        for (u32 i = 0; i < lightCount; ++i)
+            app->gpuLights[i] = PackLight(app->lights[i], app->lightShadowViews[i]);
+
+        std::vector<GpuLight> initialData(app->gpuLights);
+        initialData.resize(capacity, GpuLight{});
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GpuLight), initialData.data(), GL_DYNAMIC_DRAW);
+
+        app->lightBufferCapacity = capacity;
+        app->lightBufferUploadedBytes = capacity * sizeof(GpuLight);
+        app->lightBufferUploads = 1;
+    }
+    else
+    {
+        // Lights removed since last frame are zeroed like the rest of the tail
+        const u32 previousCount = (u32)app->gpuLights.size();
+        app->gpuLights.resize(glm::max(lightCount, previousCount));
+
+        u32 runFirst = UINT32_MAX;
+        u32 runEnd = 0;
+        for (u32 i = 0; i <= (u32)app->gpuLights.size(); ++i)
+        {
+            bool changed = false;
+            if (i < (u32)app->gpuLights.size())
+            {
+                const GpuLight gpuLight = i < lightCount ? PackLight(app->lights[i], app->lightShadowViews[i]) : GpuLight{};
+                changed = memcmp(&gpuLight, &app->gpuLights[i], sizeof(GpuLight)) != 0;
+                if (changed)
+                    app->gpuLights[i] = gpuLight;
+            }
+
+            // Flush the run once it is followed by enough unchanged lights, or at the end
+            const bool flush = runFirst != UINT32_MAX && (i == (u32)app->gpuLights.size() || (changed && i - runEnd > LIGHT_BUFFER_MERGE_GAP));
+            if (flush)
+            {
+                const u32 size = (runEnd - runFirst) * sizeof(GpuLight);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, runFirst * sizeof(GpuLight), size, &app->gpuLights[runFirst]);
+                app->lightBufferUploadedBytes += size;
+                app->lightBufferUploads++;
+                runFirst = UINT32_MAX;
+            }
+            if (changed)
+            {
+                if (runFirst == UINT32_MAX)
+                    runFirst = i;
+                runEnd = i + 1;
+            }
+        }
+
+        app->gpuLights.resize(lightCount);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, app->lightBuffer);
+}
@@ -0,0 +1,24 @@
+//
+// light_buffer.h: All the lights of App::lights in one SSBO, packed as the shaders read them
+// (GpuLight, std430) and in the same order, so the clusters, the tiles and the directional
+// light list of GlobalParams index it directly. A CPU copy of the packed lights is kept and
+// only the runs of lights that differ from it are uploaded, a still lighting rig costs a
+// compare per light and no upload.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define LIGHT_BUFFER_MERGE_GAP 8 // Unchanged lights between two runs uploaded rather than split in two calls
+
+/**
+ * Creates the light buffer.
+ */
+void InitLightBuffer(App* app);
+
+/**
+ * Packs App::lights with their shadow views, uploads the changed ones and binds the buffer.
+ * Called once per frame from Update(), after UpdateShadowAtlas() filled App::lightShadowViews.
+ */
+void UpdateLightBuffer(App* app);
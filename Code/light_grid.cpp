@@ -0,0 +1,220 @@
+#include "light_grid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static u32 GetLightBucket(const LightGrid& grid, ivec3 cell)
+{
+    return ((u32)cell.x * 73856093u ^ (u32)cell.y * 19349663u ^ (u32)cell.z * 83492791u) & grid.bucketMask;
+}
+
+static ivec3 GetLightCell(const LightGrid& grid, vec3 position)
+{
+    return ivec3(glm::floor(position / grid.cellSize));
+}
+
+// Whether the box is at least partly inside all the planes (normals pointing inside)
+static bool IsBoxInPlanes(const vec4* planes, u32 planeCount, vec3 boxMin, vec3 boxMax)
+{
+    for (u32 i = 0; i < planeCount; ++i)
+    {
+        const vec3 normal = vec3(planes[i]);
+        const vec3 farthest = glm::mix(boxMin, boxMax, vec3(glm::greaterThan(normal, vec3(0.0f))));
+        if (glm::dot(normal, farthest) + planes[i].w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void UpdateLightGrid(App* app)
+{
+    const Clock::time_point start = Clock::now();
+    LightGrid& grid = app->lightGrid;
+
+    grid.x.clear(); grid.y.clear(); grid.z.clear();
+    grid.range.clear();
+    grid.lightIdx.clear();
+
+    u32 pointLightCount = 0;
+    f32 rangeSum = 0.0f;
+    grid.maxRange = 0.0f;
+    for (const Light& light : app->lights)
+    {
+        if (light.type != LIGHT_POINT)
+            continue;
+        pointLightCount++;
+        rangeSum += light.range;
+        grid.maxRange = glm::max(grid.maxRange, light.range);
+    }
+
+    // About two buckets per light, cells about as large as a light
+    u32 bucketCount = 64;
+    while (bucketCount < pointLightCount * 2)
+        bucketCount *= 2;
+    grid.bucketMask = bucketCount - 1;
+    grid.cellSize = pointLightCount ? glm::max(2.0f * rangeSum / pointLightCount, 1.0f) : 1.0f;
+
+    // Counting sort by bucket
+    std::vector<u32> lightBuckets;
+    lightBuckets.reserve(pointLightCount);
+    grid.bucketStart.assign(bucketCount + 1, 0);
+    for (const Light& light : app->lights)
+    {
+        if (light.type != LIGHT_POINT)
+            continue;
+        const u32 bucket = GetLightBucket(grid, GetLightCell(grid, light.position));
+        lightBuckets.push_back(bucket);
+        grid.bucketStart[bucket + 1]++;
+    }
+    for (u32 i = 0; i < bucketCount; ++i)
+        grid.bucketStart[i + 1] += grid.bucketStart[i];
+
+    grid.x.resize(pointLightCount); grid.y.resize(pointLightCount); grid.z.resize(pointLightCount);
+    grid.range.resize(pointLightCount);
+    grid.lightIdx.resize(pointLightCount);
+    grid.bucketMin.assign(bucketCount, vec3(FLT_MAX));
+    grid.bucketMax.assign(bucketCount, vec3(-FLT_MAX));
+
+    std::vector<u32> bucketHead(grid.bucketStart.begin(), grid.bucketStart.end() - 1);
+    u32 pointIdx = 0;
+    for (u32 lightIdx = 0; lightIdx < (u32)app->lights.size(); ++lightIdx)
+    {
+        const Light& light = app->lights[lightIdx];
+        if (light.type != LIGHT_POINT)
+            continue;
+
+        const u32 bucket = lightBuckets[pointIdx++];
+        const u32 slot = bucketHead[bucket]++;
+        grid.x[slot] = light.position.x;
+        grid.y[slot] = light.position.y;
+        grid.z[slot] = light.position.z;
+        grid.range[slot] = light.range;
+        grid.lightIdx[slot] = lightIdx;
+
+        // Buckets mix the cells colliding in the hash, their bounds cover them all
+        grid.bucketMin[bucket] = glm::min(grid.bucketMin[bucket], light.position - light.range);
+        grid.bucketMax[bucket] = glm::max(grid.bucketMax[bucket], light.position + light.range);
+    }
+
+    app->lightGridBuildMs = std::chrono::duration<f32, std::milli>(Clock::now() - start).count();
+}
+
+void QueryLightsInSphere(const LightGrid& grid, vec3 center, f32 radius, std::vector<u32>& lightIndices)
+{
+    if (grid.lightIdx.empty())
+        return;
+
+    // Lights are filed by their center, any cell within reach of the largest range can hold one
+    const f32 reach = radius + grid.maxRange;
+    const ivec3 cellMin = GetLightCell(grid, center - reach);
+    const ivec3 cellMax = GetLightCell(grid, center + reach);
+    const u64 cellCount = (u64)(cellMax.x - cellMin.x + 1) * (cellMax.y - cellMin.y + 1) * (cellMax.z - cellMin.z + 1);
+
+    std::vector<u32> buckets;
+    if (cellCount > grid.bucketMask)
+    {
+        for (u32 bucket = 0; bucket <= grid.bucketMask; ++bucket)
+            buckets.push_back(bucket);
+    }
+    else
+    {
+        for (i32 z = cellMin.z; z <= cellMax.z; ++z)
+            for (i32 y = cellMin.y; y <= cellMax.y; ++y)
+                for (i32 x = cellMin.x; x <= cellMax.x; ++x)
+                    buckets.push_back(GetLightBucket(grid, ivec3(x, y, z)));
+
+        // Colliding cells share a bucket, visit it once
+        std::sort(buckets.begin(), buckets.end());
+        buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+    }
+
+    for (u32 bucket : buckets)
+    {
+        const vec3 closest = glm::clamp(center, grid.bucketMin[bucket], grid.bucketMax[bucket]);
+        if (grid.bucketStart[bucket] == grid.bucketStart[bucket + 1] || glm::dot(closest - center, closest - center) > radius * radius)
+            continue;
+
+        for (u32 i = grid.bucketStart[bucket]; i < grid.bucketStart[bucket + 1]; ++i)
+        {
+            const vec3 toLight = vec3(grid.x[i], grid.y[i], grid.z[i]) - center;
+            const f32 distance = radius + grid.range[i];
+            if (glm::dot(toLight, toLight) <= distance * distance)
+                lightIndices.push_back(grid.lightIdx[i]);
+        }
+    }
+}
+
+void QueryLightsInFrustum(const LightGrid& grid, const glm::mat4& viewProjection, std::vector<u32>& lightIndices)
+{
+    vec4 planes[6];
+    GetFrustumPlanes(viewProjection, planes);
+
+    for (u32 bucket = 0; bucket <= grid.bucketMask; ++bucket)
+    {
+        const u32 first = grid.bucketStart[bucket];
+        const u32 end = grid.bucketStart[bucket + 1];
+        if (first == end || !IsBoxInPlanes(planes, 6, grid.bucketMin[bucket], grid.bucketMax[bucket]))
+            continue;
+
+        for (u32 i = first; i < end; ++i)
+        {
+            const vec3 position = vec3(grid.x[i], grid.y[i], grid.z[i]);
+            bool inside = true;
+            for (u32 p = 0; p < 6 && inside; ++p)
+                inside = glm::dot(vec3(planes[p]), position) + planes[p].w >= -grid.range[i];
+            if (inside)
+                lightIndices.push_back(grid.lightIdx[i]);
+        }
+    }
+}
+
+void StartLightBenchmark(App* app, u32 count, vec3 boxMin, vec3 boxMax, f32 range)
+{
+    LightBenchmark& benchmark = app->lightBenchmark;
+    benchmark.firstLight = (u32)app->lights.size();
+    benchmark.origins.clear();
+    for (u32 i = 0; i < count; ++i)
+    {
+        const vec3 t = vec3(rand(), rand(), rand()) / (f32)RAND_MAX;
+        const vec3 color = vec3(rand(), rand(), rand()) / (f32)RAND_MAX;
+        benchmark.origins.push_back(glm::mix(boxMin, boxMax, t));
+        AddLight(app, LIGHT_POINT, color, vec3(0.0f), benchmark.origins.back(), range);
+    }
+
+    benchmark.running = true;
+    benchmark.frame = 0;
+    benchmark.gridMs = benchmark.cullMs = benchmark.assignMs = 0.0f;
+    ILOG("Light benchmark: %u moving point lights, %u lights in total", count, (u32)app->lights.size());
+}
+
+void UpdateLightBenchmark(App* app)
+{
+    LightBenchmark& benchmark = app->lightBenchmark;
+    if (!benchmark.running)
+        return;
+
+    // Timings of the previous frame, the first one only moved the lights
+    if (benchmark.frame > 0 && benchmark.frame <= LIGHT_BENCHMARK_FRAMES)
+    {
+        benchmark.gridMs += app->lightGridBuildMs;
+        benchmark.cullMs += app->lightCullMs;
+        benchmark.assignMs += app->clusterAssignMs;
+    }
+    if (benchmark.frame == LIGHT_BENCHMARK_FRAMES)
+    {
+        ILOG("Light benchmark over %u frames: grid build %.3f ms, view culling %.3f ms, cluster assignment %.3f ms",
+             LIGHT_BENCHMARK_FRAMES, benchmark.gridMs / LIGHT_BENCHMARK_FRAMES, benchmark.cullMs / LIGHT_BENCHMARK_FRAMES,
+             benchmark.assignMs / LIGHT_BENCHMARK_FRAMES);
+    }
+    benchmark.frame++;
+
+    // Circles of a few units, every light at its own phase
+    for (u32 i = 0; i < (u32)benchmark.origins.size(); ++i)
+    {
+        const f32 phase = app->runTime * 0.5f + i * 0.61803f;
+        app->lights[benchmark.firstLight + i].position = benchmark.origins[i] + vec3(cosf(phase), 0.0f, sinf(phase)) * 4.0f;
+    }
+}
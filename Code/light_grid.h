@@ -0,0 +1,41 @@
+//
+// light_grid.h: Spatial hash of the point lights, rebuilt every frame so they can all move.
+// Lights are bucketed by the grid cell of their position and stored sorted by bucket as
+// structure of arrays; each bucket keeps the bounds of its light spheres, so range and frustum
+// queries reject whole buckets before looking at a light. Used to cull the lights outside the
+// view before the cluster assignment and to find the lights reaching an object.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define LIGHT_BENCHMARK_FRAMES 300 // Averaged by the benchmark
+
+/**
+ * Rebuilds App::lightGrid from the point lights of App::lights. Called once per frame from
+ * Update(), after the lights moved and before anything queries them.
+ */
+void UpdateLightGrid(App* app);
+
+/**
+ * Appends to lightIndices (App::lights indices) the point lights whose range touches the sphere.
+ */
+void QueryLightsInSphere(const LightGrid& grid, vec3 center, f32 radius, std::vector<u32>& lightIndices);
+
+/**
+ * Appends to lightIndices the point lights whose range touches the frustum of viewProjection.
+ */
+void QueryLightsInFrustum(const LightGrid& grid, const glm::mat4& viewProjection, std::vector<u32>& lightIndices);
+
+/**
+ * Adds count point lights moving in circles inside the box and times the light grid, the view
+ * culling and the cluster assignment with them, averaged over the next frames.
+ */
+void StartLightBenchmark(App* app, u32 count, vec3 boxMin, vec3 boxMax, f32 range);
+
+/**
+ * Moves the benchmark lights and logs the timings once enough frames were measured. Called
+ * once per frame from Update(), before UpdateLightGrid().
+ */
+void UpdateLightBenchmark(App* app);
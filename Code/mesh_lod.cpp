@@ -0,0 +1,568 @@
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <string.h>
+#include <unordered_map>
+
+// Errors are measured with positions normalized by the bounding radius
+#define LOD_MAX_ERROR       0.05f
+// Border edges get planes perpendicular to their triangle so open boundaries keep their shape
+#define LOD_BORDER_WEIGHT   10.0
+// Attribute error added when a collapse replaces the normal / uv of the corners it moves
+#define LOD_NORMAL_WEIGHT   0.0025f
+#define LOD_TEXCOORD_WEIGHT 0.01f
+// Collapses that turn a triangle more than this (cosine) are rejected, it would fold over
+#define LOD_MIN_NORMAL_DOT  0.25f
+// A level has to remove at least this fraction of the triangles of the previous one
+#define LOD_MIN_REDUCTION   0.15f
+#define LOD_MIN_TRIANGLES   32
+
+struct Quadric
+{
+    f64 a2, b2, c2, d2;
+    f64 ab, ac, ad, bc, bd, cd;
+    f64 weight;
+};
+
+static void AddPlane(Quadric& q, const glm::dvec3& n, f64 d, f64 weight)
+{
+    q.a2 += weight * n.x * n.x; q.b2 += weight * n.y * n.y; q.c2 += weight * n.z * n.z; q.d2 += weight * d * d;
+    q.ab += weight * n.x * n.y; q.ac += weight * n.x * n.z; q.ad += weight * n.x * d;
+    q.bc += weight * n.y * n.z; q.bd += weight * n.y * d;   q.cd += weight * n.z * d;
+    q.weight += weight;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other)
+{
+    q.a2 += other.a2; q.b2 += other.b2; q.c2 += other.c2; q.d2 += other.d2;
+    q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+    q.bc += other.bc; q.bd += other.bd; q.cd += other.cd;
+    q.weight += other.weight;
+}
+
+// Weighted mean of the squared distances to the planes
+static f32 EvaluateQuadric(const Quadric& q, const vec3& p)
+{
+    const f64 x = p.x, y = p.y, z = p.z;
+    const f64 error = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + q.d2 +
+                      2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z + q.ad * x + q.bd * y + q.cd * z);
+    return q.weight > 0.0 ? (f32)glm::max(error / q.weight, 0.0) : 0.0f;
+}
+
+static u64 EdgeKey(u32 a, u32 b)
+{
+    return a < b ? ((u64)a << 32) | b : ((u64)b << 32) | a;
+}
+
+struct Collapse
+{
+    u32 from;
+    u32 to;
+    f32 error;
+};
+
+struct Simplifier
+{
+    // Vertices with the same position form a group, the collapses work on groups and the
+    // vertices (wedges) of the group being removed move to the matching wedge of the target
+    std::vector<u32>     vertexGroup;
+    std::vector<vec3>    groupPositions;
+    std::vector<Quadric> groupQuadrics;
+    std::vector<std::vector<u32>> groupTriangles;
+
+    std::vector<u32>  triangles; // Vertex indices, three per triangle
+    std::vector<bool> triangleAlive;
+    u32               aliveTriangles;
+
+    const float* vertices;
+    u32          floatStride;
+    i32          normalOffset;   // In floats, -1 if there are none
+    i32          texCoordOffset;
+};
+
+static const vec3& TrianglePosition(const Simplifier& s, u32 vertex)
+{
+    return s.groupPositions[s.vertexGroup[vertex]];
+}
+
+static vec3 ComputeNormal(const vec3& p0, const vec3& p1, const vec3& p2)
+{
+    return glm::cross(p1 - p0, p2 - p0);
+}
+
+// Attribute error of moving the corners of vertex `from` to vertex `to`
+static f32 GetAttributeError(const Simplifier& s, u32 from, u32 to)
+{
+    f32 error = 0.0f;
+    const float* a = s.vertices + (u64)from * s.floatStride;
+    const float* b = s.vertices + (u64)to * s.floatStride;
+
+    if (s.normalOffset >= 0)
+    {
+        vec3 delta = glm::make_vec3(a + s.normalOffset) - glm::make_vec3(b + s.normalOffset);
+        error += LOD_NORMAL_WEIGHT * glm::dot(delta, delta);
+    }
+    if (s.texCoordOffset >= 0)
+    {
+        vec2 delta = glm::make_vec2(a + s.texCoordOffset) - glm::make_vec2(b + s.texCoordOffset);
+        error += LOD_TEXCOORD_WEIGHT * glm::dot(delta, delta);
+    }
+    return error;
+}
+
+// Checks and applies the collapse of group `from` into group `to`. Marks every group whose
+// neighbourhood changed so no other collapse of this pass uses stale data.
+static bool TryCollapse(Simplifier& s, const Collapse& collapse, f32 maxErrorSq, std::vector<bool>& touched, f32& resultError)
+{
+    const u32 from = collapse.from;
+    const u32 to = collapse.to;
+
+    // Each wedge of `from` goes to the wedge of `to` it shares an edge with. If a wedge has
+    // none (the edge crosses a uv seam instead of following it) the seam would break.
+    std::vector<std::pair<u32, u32>> wedgeMap;
+    std::vector<u32> fromNeighbours, toNeighbours;
+    u32 sharedTriangles = 0;
+
+    for (u32 t : s.groupTriangles[from])
+    {
+        if (!s.triangleAlive[t])
+            continue;
+
+        const u32* tri = &s.triangles[t * 3];
+        i32 fromCorner = -1, toCorner = -1;
+        for (u32 c = 0; c < 3; ++c)
+        {
+            const u32 group = s.vertexGroup[tri[c]];
+            if (group == from)    fromCorner = (i32)c;
+            else if (group == to) toCorner = (i32)c;
+            else                  fromNeighbours.push_back(group);
+        }
+
+        if (toCorner >= 0)
+        {
+            sharedTriangles++;
+            const u32 wedge = tri[fromCorner];
+            const u32 target = tri[toCorner];
+            for (const std::pair<u32, u32>& mapping : wedgeMap)
+                if (mapping.first == wedge && mapping.second != target)
+                    return false;
+            wedgeMap.push_back(std::make_pair(wedge, target));
+        }
+    }
+
+    for (u32 t : s.groupTriangles[from])
+    {
+        if (!s.triangleAlive[t])
+            continue;
+
+        const u32* tri = &s.triangles[t * 3];
+        for (u32 c = 0; c < 3; ++c)
+        {
+            if (s.vertexGroup[tri[c]] != from)
+                continue;
+
+            bool mapped = false;
+            for (const std::pair<u32, u32>& mapping : wedgeMap)
+                mapped |= mapping.first == tri[c];
+            if (!mapped)
+                return false;
+        }
+    }
+
+    // Link condition: the only vertices both groups share are the ones of their common
+    // triangles, otherwise the collapse pinches the surface
+    for (u32 t : s.groupTriangles[to])
+    {
+        if (!s.triangleAlive[t])
+            continue;
+        for (u32 c = 0; c < 3; ++c)
+        {
+            const u32 group = s.vertexGroup[s.triangles[t * 3 + c]];
+            if (group != from && group != to)
+                toNeighbours.push_back(group);
+        }
+    }
+    std::sort(fromNeighbours.begin(), fromNeighbours.end());
+    fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+    std::sort(toNeighbours.begin(), toNeighbours.end());
+    toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+
+    u32 commonNeighbours = 0;
+    for (u32 a = 0, b = 0; a < fromNeighbours.size() && b < toNeighbours.size();)
+    {
+        if (fromNeighbours[a] == toNeighbours[b]) { commonNeighbours++; a++; b++; }
+        else if (fromNeighbours[a] < toNeighbours[b]) a++;
+        else b++;
+    }
+    if (commonNeighbours > sharedTriangles)
+        return false;
+
+    // Triangles that stay must not flip
+    const vec3& target = s.groupPositions[to];
+    for (u32 t : s.groupTriangles[from])
+    {
+        if (!s.triangleAlive[t])
+            continue;
+
+        const u32* tri = &s.triangles[t * 3];
+        vec3 p[3] = { TrianglePosition(s, tri[0]), TrianglePosition(s, tri[1]), TrianglePosition(s, tri[2]) };
+        bool hasTo = false;
+        for (u32 c = 0; c < 3; ++c)
+            hasTo |= s.vertexGroup[tri[c]] == to;
+        if (hasTo)
+            continue;
+
+        const vec3 before = ComputeNormal(p[0], p[1], p[2]);
+        for (u32 c = 0; c < 3; ++c)
+            if (s.vertexGroup[tri[c]] == from)
+                p[c] = target;
+        const vec3 after = ComputeNormal(p[0], p[1], p[2]);
+
+        if (glm::dot(before, after) < LOD_MIN_NORMAL_DOT * glm::length(before) * glm::length(after))
+            return false;
+    }
+
+    f32 error = collapse.error;
+    for (const std::pair<u32, u32>& mapping : wedgeMap)
+        error = glm::max(error, collapse.error + GetAttributeError(s, mapping.first, mapping.second));
+    if (error > maxErrorSq)
+        return false;
+
+    // Apply it
+    std::vector<u32>& toTriangles = s.groupTriangles[to];
+    toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(), [&s](u32 t) { return !s.triangleAlive[t]; }), toTriangles.end());
+
+    for (u32 t : s.groupTriangles[from])
+    {
+        if (!s.triangleAlive[t])
+            continue;
+
+        u32* tri = &s.triangles[t * 3];
+        bool degenerate = false;
+        for (u32 c = 0; c < 3; ++c)
+        {
+            touched[s.vertexGroup[tri[c]]] = true;
+            if (s.vertexGroup[tri[c]] == to)
+                degenerate = true;
+        }
+
+        if (degenerate)
+        {
+            s.triangleAlive[t] = false;
+            s.aliveTriangles--;
+            continue;
+        }
+
+        for (u32 c = 0; c < 3; ++c)
+            for (const std::pair<u32, u32>& mapping : wedgeMap)
+                if (tri[c] == mapping.first)
+                {
+                    tri[c] = mapping.second;
+                    break;
+                }
+        toTriangles.push_back(t);
+    }
+
+    s.groupTriangles[from].clear();
+    AddQuadric(s.groupQuadrics[to], s.groupQuadrics[from]);
+    touched[from] = touched[to] = true;
+    resultError = glm::max(resultError, error);
+    return true;
+}
+
+f32 SimplifySubmeshIndices(const Submesh& submesh, const std::vector<u32>& indices, u32 targetIndexCount, f32 maxError, std::vector<u32>& result)
+{
+    Simplifier s = {};
+    s.vertices = submesh.vertices.data();
+    s.floatStride = submesh.vertexBufferLayout.stride / sizeof(float);
+    s.normalOffset = -1;
+    s.texCoordOffset = -1;
+    for (const VertexBufferAttribute& attribute : submesh.vertexBufferLayout.attributes)
+    {
+        if (attribute.location == 1) s.normalOffset = attribute.offset / sizeof(float);
+        if (attribute.location == 2) s.texCoordOffset = attribute.offset / sizeof(float);
+    }
+
+    const u32 vertexCount = s.floatStride ? (u32)submesh.vertices.size() / s.floatStride : 0;
+    const f32 radius = submesh.boundsRadius > 0.0f ? submesh.boundsRadius : 1.0f;
+
+    // Group the vertices by position
+    std::unordered_map<u64, u32> groupByPosition;
+    s.vertexGroup.assign(vertexCount, UINT32_MAX);
+    for (u32 index : indices)
+    {
+        if (s.vertexGroup[index] != UINT32_MAX)
+            continue;
+
+        const float* p = s.vertices + (u64)index * s.floatStride;
+        u32 bits[3];
+        memcpy(bits, p, sizeof(bits));
+        const u64 key = ((u64)bits[0] * 0x9E3779B97F4A7C15ull) ^ ((u64)bits[1] * 0xC2B2AE3D27D4EB4Full) ^ ((u64)bits[2] * 0x165667B19E3779F9ull);
+
+        // Hash collisions of different positions just get their own group
+        auto it = groupByPosition.find(key);
+        if (it != groupByPosition.end() && glm::make_vec3(p) == glm::make_vec3(s.vertices + (u64)it->second * s.floatStride))
+        {
+            s.vertexGroup[index] = s.vertexGroup[it->second];
+            continue;
+        }
+
+        s.vertexGroup[index] = (u32)s.groupPositions.size();
+        s.groupPositions.push_back((glm::make_vec3(p) - submesh.boundsCenter) / radius);
+        if (it == groupByPosition.end())
+            groupByPosition.emplace(key, index);
+    }
+
+    const u32 groupCount = (u32)s.groupPositions.size();
+    s.groupQuadrics.assign(groupCount, Quadric{});
+    s.groupTriangles.resize(groupCount);
+
+    s.triangles.reserve(indices.size());
+    for (u32 i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const u32 tri[3] = { indices[i], indices[i + 1], indices[i + 2] };
+        if (s.vertexGroup[tri[0]] == s.vertexGroup[tri[1]] || s.vertexGroup[tri[1]] == s.vertexGroup[tri[2]] || s.vertexGroup[tri[0]] == s.vertexGroup[tri[2]])
+            continue;
+
+        const u32 t = (u32)s.triangles.size() / 3;
+        s.triangles.insert(s.triangles.end(), tri, tri + 3);
+        for (u32 c = 0; c < 3; ++c)
+            s.groupTriangles[s.vertexGroup[tri[c]]].push_back(t);
+
+        // Plane of the triangle, weighted by its area
+        const glm::dvec3 p0 = TrianglePosition(s, tri[0]);
+        const glm::dvec3 normal = glm::cross(glm::dvec3(TrianglePosition(s, tri[1])) - p0, glm::dvec3(TrianglePosition(s, tri[2])) - p0);
+        const f64 length = glm::length(normal);
+        if (length > 0.0)
+            for (u32 c = 0; c < 3; ++c)
+                AddPlane(s.groupQuadrics[s.vertexGroup[tri[c]]], normal / length, -glm::dot(normal / length, p0), length * 0.5);
+    }
+
+    const u32 triangleCount = (u32)s.triangles.size() / 3;
+    s.triangleAlive.assign(triangleCount, true);
+    s.aliveTriangles = triangleCount;
+
+    // Border edges (used by a single triangle) get perpendicular planes to keep the outline
+    {
+        std::unordered_map<u64, u32> edgeUses;
+        for (u32 t = 0; t < triangleCount; ++t)
+            for (u32 c = 0; c < 3; ++c)
+                edgeUses[EdgeKey(s.vertexGroup[s.triangles[t * 3 + c]], s.vertexGroup[s.triangles[t * 3 + (c + 1) % 3]])]++;
+
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            const u32* tri = &s.triangles[t * 3];
+            const glm::dvec3 p0 = TrianglePosition(s, tri[0]);
+            const glm::dvec3 faceNormal = glm::cross(glm::dvec3(TrianglePosition(s, tri[1])) - p0, glm::dvec3(TrianglePosition(s, tri[2])) - p0);
+
+            for (u32 c = 0; c < 3; ++c)
+            {
+                const u32 a = s.vertexGroup[tri[c]], b = s.vertexGroup[tri[(c + 1) % 3]];
+                if (edgeUses[EdgeKey(a, b)] != 1)
+                    continue;
+
+                const glm::dvec3 edge = glm::dvec3(s.groupPositions[b]) - glm::dvec3(s.groupPositions[a]);
+                glm::dvec3 normal = glm::cross(edge, faceNormal);
+                const f64 length = glm::length(normal);
+                if (length <= 0.0)
+                    continue;
+                normal /= length;
+
+                const f64 d = -glm::dot(normal, glm::dvec3(s.groupPositions[a]));
+                const f64 weight = glm::dot(edge, edge) * LOD_BORDER_WEIGHT;
+                AddPlane(s.groupQuadrics[a], normal, d, weight);
+                AddPlane(s.groupQuadrics[b], normal, d, weight);
+            }
+        }
+    }
+
+    // Passes of collapses ordered by error. Within a pass a group is only touched once, then
+    // the costs are recomputed with the new topology.
+    const u32 targetTriangles = targetIndexCount / 3;
+    const f32 maxErrorSq = maxError * maxError;
+    f32 resultError = 0.0f;
+
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(groupCount);
+    std::unordered_map<u64, u32> edgeUses;
+
+    while (s.aliveTriangles > targetTriangles)
+    {
+        // Vertices on non-manifold edges are locked, border vertices can only slide along the border
+        edgeUses.clear();
+        for (u32 t = 0; t < triangleCount; ++t)
+            if (s.triangleAlive[t])
+                for (u32 c = 0; c < 3; ++c)
+                    edgeUses[EdgeKey(s.vertexGroup[s.triangles[t * 3 + c]], s.vertexGroup[s.triangles[t * 3 + (c + 1) % 3]])]++;
+
+        std::vector<u8> groupKind(groupCount, 0); // 0 manifold, 1 border, 2 locked
+        for (const std::pair<const u64, u32>& edge : edgeUses)
+        {
+            const u8 kind = edge.second == 1 ? 1 : edge.second > 2 ? 2 : 0;
+            groupKind[edge.first >> 32] = glm::max(groupKind[edge.first >> 32], kind);
+            groupKind[edge.first & 0xFFFFFFFF] = glm::max(groupKind[edge.first & 0xFFFFFFFF], kind);
+        }
+
+        collapses.clear();
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            if (!s.triangleAlive[t])
+                continue;
+
+            for (u32 c = 0; c < 3; ++c)
+            {
+                const u32 a = s.vertexGroup[s.triangles[t * 3 + c]], b = s.vertexGroup[s.triangles[t * 3 + (c + 1) % 3]];
+                if (a > b && edgeUses[EdgeKey(a, b)] == 2)
+                    continue; // Interior edges are seen twice
+
+                const bool borderEdge = edgeUses[EdgeKey(a, b)] == 1;
+                Quadric q = s.groupQuadrics[a];
+                AddQuadric(q, s.groupQuadrics[b]);
+
+                Collapse best = { 0, 0, FLT_MAX };
+                const u32 ends[2][2] = { { a, b }, { b, a } };
+                for (u32 d = 0; d < 2; ++d)
+                {
+                    const u32 from = ends[d][0], to = ends[d][1];
+                    if (groupKind[from] == 2 || (groupKind[from] == 1 && !borderEdge))
+                        continue;
+
+                    const f32 error = EvaluateQuadric(q, s.groupPositions[to]);
+                    if (error < best.error)
+                        best = Collapse{ from, to, error };
+                }
+
+                if (best.error <= maxErrorSq)
+                    collapses.push_back(best);
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+        std::fill(touched.begin(), touched.end(), false);
+        u32 collapsed = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (s.aliveTriangles <= targetTriangles)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+            if (TryCollapse(s, collapse, maxErrorSq, touched, resultError))
+                collapsed++;
+        }
+
+        if (collapsed == 0)
+            break;
+    }
+
+    result.clear();
+    result.reserve(s.aliveTriangles * 3);
+    for (u32 t = 0; t < triangleCount; ++t)
+        if (s.triangleAlive[t])
+            result.insert(result.end(), &s.triangles[t * 3], &s.triangles[t * 3] + 3);
+
+    return sqrtf(resultError);
+}
+
+void GenerateSubmeshLods(Submesh& submesh)
+{
+    submesh.lods.clear();
+
+    const std::vector<u32>* previous = &submesh.indices;
+    f32 previousError = 0.0f;
+
+    for (u32 level = 0; level < MESH_LOD_COUNT; ++level)
+    {
+        const u32 targetIndexCount = (u32)(previous->size() / 6) * 3;
+        if (targetIndexCount < LOD_MIN_TRIANGLES * 3)
+            break;
+
+        SubmeshLod lod = {};
+        const f32 error = SimplifySubmeshIndices(submesh, *previous, targetIndexCount, LOD_MAX_ERROR, lod.indices);
+        if (lod.indices.size() > previous->size() * (1.0f - LOD_MIN_REDUCTION))
+            break;
+
+        // Errors add up along the chain since each level starts from the previous one
+        previousError += error;
+        lod.error = previousError * submesh.boundsRadius;
+        submesh.lods.push_back(lod);
+        previous = &submesh.lods.back().indices;
+    }
+}
+
+void ComputeModelBounds(const App* app, Model& model)
+{
+    const Mesh& mesh = app->meshes[model.meshIdx];
+    vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+    std::vector<std::pair<vec3, f32>> spheres;
+
+    if (model.instanceBatches.empty())
+    {
+        for (const Submesh& submesh : mesh.submeshes)
+            spheres.push_back(std::make_pair(submesh.boundsCenter, submesh.boundsRadius));
+    }
+    for (const InstanceBatch& batch : model.instanceBatches)
+    {
+        const Submesh& submesh = mesh.submeshes[batch.submeshIdx];
+        for (u32 i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; ++i)
+        {
+            const glm::mat4& transform = model.instanceTransforms[i];
+            const f32 scale = glm::max(glm::length(vec3(transform[0])), glm::max(glm::length(vec3(transform[1])), glm::length(vec3(transform[2]))));
+            spheres.push_back(std::make_pair(vec3(transform * vec4(submesh.boundsCenter, 1.0f)), submesh.boundsRadius * scale));
+        }
+    }
+
+    for (const std::pair<vec3, f32>& sphere : spheres)
+    {
+        minPos = glm::min(minPos, sphere.first - sphere.second);
+        maxPos = glm::max(maxPos, sphere.first + sphere.second);
+    }
+
+    model.boundsCenter = spheres.empty() ? vec3(0.0f) : (minPos + maxPos) * 0.5f;
+    model.boundsRadius = 0.0f;
+    for (const std::pair<vec3, f32>& sphere : spheres)
+        model.boundsRadius = glm::max(model.boundsRadius, glm::distance(model.boundsCenter, sphere.first) + sphere.second);
+}
+
+// Screen size below which an object switches from level `lod` to the next one
+static f32 GetLodScreenSize(const App* app, u32 lod)
+{
+    return lod < MESH_LOD_COUNT ? app->meshLodScreenSizes[lod] : app->impostorScreenSize;
+}
+
+void SelectMeshLods(App* app)
+{
+    for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
+    {
+        GameObject& gameObject = app->gameObjects[i];
+        if (!app->meshLods || gameObject.modelIdx >= app->models.size())
+        {
+            gameObject.lod = 0;
+            continue;
+        }
+
+        const Model& model = app->models[gameObject.modelIdx];
+        const vec3 center = model.boundsCenter;
+        const f32 radius = model.boundsRadius;
+
+        // Past the last geometric level, models with a baked impostor switch to it
+        const u32 maxLod = app->drawImpostors && model.impostorIdx != UINT32_MAX ? MESH_LOD_IMPOSTOR : MESH_LOD_COUNT;
+
+        const glm::mat4& world = gameObject.transform.matrix;
+        const f32 scale = glm::max(glm::length(vec3(world[0])), glm::max(glm::length(vec3(world[1])), glm::length(vec3(world[2]))));
+        const f32 distance = glm::max(glm::length(vec3(world * vec4(center, 1.0f)) - app->camera.position), app->zNear);
+
+        // Fraction of the screen height covered by the bounding sphere
+        const f32 screenSize = radius * scale * app->projection[1][1] / distance;
+
+        // Thresholds are moved away from the current level so small camera moves around one
+        // don't switch every frame
+        u32 lod = glm::min(gameObject.lod, maxLod);
+        while (lod < maxLod && screenSize < GetLodScreenSize(app, lod) * (1.0f - app->meshLodHysteresis))
+            lod++;
+        while (lod > 0 && screenSize > GetLodScreenSize(app, lod - 1) * (1.0f + app->meshLodHysteresis))
+            lod--;
+
+        gameObject.lod = lod;
+    }
+}
@@ -0,0 +1,38 @@
+//
+// mesh_lod.h: Level of detail for meshes. At import each submesh is simplified with quadric
+// error edge collapses into a chain of coarser index lists that share its vertices, and every
+// frame each game object picks a level from its size on screen.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Simplifies indices (triangles into the vertices of the submesh) down to targetIndexCount
+ * or until the next collapse would move the surface more than maxError (a fraction of the
+ * submesh bounding radius). Only edges are collapsed, the vertices are reused as they are,
+ * so UV seams and normal discontinuities stay sharp. Returns the error reached.
+ */
+f32 SimplifySubmeshIndices(const Submesh& submesh, const std::vector<u32>& indices, u32 targetIndexCount, f32 maxError, std::vector<u32>& result);
+
+/**
+ * Fills submesh.lods with up to MESH_LOD_COUNT levels, each with about half the triangles of
+ * the previous one. Levels that don't simplify enough are not generated. Needs the bounds
+ * (ComputeSubmeshBounds) and runs on the CPU data only, so it is safe from worker threads.
+ */
+void GenerateSubmeshLods(Submesh& submesh);
+
+/**
+ * Stores in Model::boundsCenter / boundsRadius the bounding sphere of all the submeshes (and
+ * instances) of the model, in model space. Called by the importers once the mesh is uploaded,
+ * and again whenever the mesh is refilled.
+ */
+void ComputeModelBounds(const App* app, Model& model);
+
+/**
+ * Picks the level of every game object from its projected size against
+ * App::meshLodScreenSizes, with App::meshLodHysteresis to avoid popping back and forth. Objects
+ * smaller than App::impostorScreenSize use MESH_LOD_IMPOSTOR if their model has one.
+ */
+void SelectMeshLods(App* app);
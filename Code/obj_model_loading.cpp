@@ -0,0 +1,740 @@
+#include "obj_model_loading.h"
+#include "assimp_model_loading.h"
+#include "job_system.h"
+#include "mesh_lod.h"
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <charconv>
+#include <chrono>
+#include <string.h>
+#include <unordered_map>
+
+// Files are split in chunks of at least this size, smaller ones are not worth a job
+#define OBJ_MIN_CHUNK_SIZE KB(64)
+
+// Negative (relative) indices are resolved against the chunk first and fixed up once the
+// number of elements in the previous chunks is known
+#define OBJ_RELATIVE_POSITION (1 << 0)
+#define OBJ_RELATIVE_TEXCOORD (1 << 1)
+#define OBJ_RELATIVE_NORMAL   (1 << 2)
+
+struct ObjCorner
+{
+    i32 position;
+    i32 texCoord; // -1 if the face has none
+    i32 normal;   // -1 if the face has none
+    u32 relative; // OBJ_RELATIVE_* flags
+};
+
+struct ObjMaterialSwitch
+{
+    u32         firstTriangle;
+    std::string material;
+};
+
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    std::vector<vec3>              positions;
+    std::vector<vec2>              texCoords;
+    std::vector<vec3>              normals;
+    std::vector<ObjCorner>         corners; // Three per triangle
+    std::vector<ObjMaterialSwitch> materialSwitches;
+    std::vector<std::string>       materialLibraries;
+
+    // Elements in the previous chunks
+    u32 positionBase;
+    u32 texCoordBase;
+    u32 normalBase;
+    u32 cornerBase;
+};
+
+struct ObjGeometry
+{
+    std::vector<vec3>      positions;
+    std::vector<vec2>      texCoords;
+    std::vector<vec3>      normals;
+    std::vector<ObjCorner> corners;
+};
+
+struct ObjTriangleRange
+{
+    u32 first;
+    u32 last;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Text parsing
+
+static const char* SkipSpaces(const char* c, const char* end)
+{
+    while (c < end && (*c == ' ' || *c == '\t'))
+        ++c;
+    return c;
+}
+
+static const char* SkipLine(const char* c, const char* end)
+{
+    const char* eol = (const char*)memchr(c, '\n', end - c);
+    return eol ? eol + 1 : end;
+}
+
+static bool IsKeyword(const char* c, const char* end, const char* keyword)
+{
+    const size_t len = strlen(keyword);
+    return (size_t)(end - c) > len && memcmp(c, keyword, len) == 0 && (c[len] == ' ' || c[len] == '\t');
+}
+
+static const char* ParseFloat(const char* c, const char* end, f32& value)
+{
+    c = SkipSpaces(c, end);
+    if (c < end && *c == '+') // from_chars does not accept the plus sign
+        ++c;
+
+    value = 0.0f;
+    std::from_chars_result result = std::from_chars(c, end, value);
+    return result.ptr;
+}
+
+static std::string ParseRestOfLine(const char* c, const char* end)
+{
+    c = SkipSpaces(c, end);
+    const char* lineEnd = c;
+    while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r')
+        ++lineEnd;
+    while (lineEnd > c && (lineEnd[-1] == ' ' || lineEnd[-1] == '\t'))
+        --lineEnd;
+    return std::string(c, lineEnd);
+}
+
+static std::string JoinPath(const std::string& directory, const std::string& filename)
+{
+    return directory.empty() ? filename : directory + "/" + filename;
+}
+
+// Parses one of the indices of a face vertex. There may be none, as the texture coordinate in "3//1"
+static bool ParseIndex(const char*& c, const char* end, u32 count, i32& index, bool& relative)
+{
+    i32 value = 0;
+    std::from_chars_result result = std::from_chars(c, end, value);
+    if (result.ec != std::errc())
+        return false;
+
+    c = result.ptr;
+    relative = value < 0;
+    index = relative ? (i32)count + value : value - 1;
+    return value != 0;
+}
+
+static void ParseFace(const char* c, const char* end, ObjChunk& chunk, std::vector<ObjCorner>& polygon)
+{
+    polygon.clear();
+
+    for (;;)
+    {
+        c = SkipSpaces(c, end);
+        if (c >= end || *c == '\n' || *c == '\r' || *c == '#')
+            break;
+
+        ObjCorner corner = { -1, -1, -1, 0 };
+        bool relative = false;
+        if (!ParseIndex(c, end, (u32)chunk.positions.size(), corner.position, relative))
+            break;
+        corner.relative |= relative ? OBJ_RELATIVE_POSITION : 0;
+
+        if (c < end && *c == '/')
+        {
+            ++c;
+            if (ParseIndex(c, end, (u32)chunk.texCoords.size(), corner.texCoord, relative))
+                corner.relative |= relative ? OBJ_RELATIVE_TEXCOORD : 0;
+            else
+                corner.texCoord = -1;
+
+            if (c < end && *c == '/')
+            {
+                ++c;
+                if (ParseIndex(c, end, (u32)chunk.normals.size(), corner.normal, relative))
+                    corner.relative |= relative ? OBJ_RELATIVE_NORMAL : 0;
+                else
+                    corner.normal = -1;
+            }
+        }
+
+        polygon.push_back(corner);
+    }
+
+    // Fan triangulation, like Assimp does for convex polygons
+    for (u32 i = 2; i < polygon.size(); ++i)
+    {
+        chunk.corners.push_back(polygon[0]);
+        chunk.corners.push_back(polygon[i - 1]);
+        chunk.corners.push_back(polygon[i]);
+    }
+}
+
+static void ParseObjChunk(ObjChunk& chunk)
+{
+    std::vector<ObjCorner> polygon;
+    const char* end = chunk.end;
+
+    for (const char* c = chunk.begin; c < end; c = SkipLine(c, end))
+    {
+        c = SkipSpaces(c, end);
+        if (end - c < 2)
+            break;
+
+        if (c[0] == 'v' && (c[1] == ' ' || c[1] == '\t'))
+        {
+            vec3 position;
+            c = ParseFloat(c + 1, end, position.x);
+            c = ParseFloat(c, end, position.y);
+            c = ParseFloat(c, end, position.z);
+            chunk.positions.push_back(position);
+        }
+        else if (IsKeyword(c, end, "vt"))
+        {
+            vec2 texCoord;
+            c = ParseFloat(c + 2, end, texCoord.x);
+            c = ParseFloat(c, end, texCoord.y);
+            chunk.texCoords.push_back(texCoord);
+        }
+        else if (IsKeyword(c, end, "vn"))
+        {
+            vec3 normal;
+            c = ParseFloat(c + 2, end, normal.x);
+            c = ParseFloat(c, end, normal.y);
+            c = ParseFloat(c, end, normal.z);
+            chunk.normals.push_back(normal);
+        }
+        else if (c[0] == 'f' && (c[1] == ' ' || c[1] == '\t'))
+        {
+            ParseFace(c + 1, end, chunk, polygon);
+        }
+        else if (IsKeyword(c, end, "usemtl"))
+        {
+            chunk.materialSwitches.push_back(ObjMaterialSwitch{ (u32)chunk.corners.size() / 3, ParseRestOfLine(c + 6, end) });
+        }
+        else if (IsKeyword(c, end, "mtllib"))
+        {
+            chunk.materialLibraries.push_back(ParseRestOfLine(c + 6, end));
+        }
+        // Groups, objects and smoothing groups don't matter, submeshes are split by material
+    }
+}
+
+static void ParseMtlFile(const std::string& filename, const std::string& directory, std::vector<ObjMaterial>& materials)
+{
+    MappedFile file = MapFile(filename.c_str());
+    if (!file.data)
+    {
+        ELOG("Could not open material library %s", filename.c_str());
+        return;
+    }
+
+    const char* end = (const char*)file.data + file.size;
+    u32 materialIdx = UINT32_MAX;
+
+    for (const char* c = (const char*)file.data; c < end; c = SkipLine(c, end))
+    {
+        c = SkipSpaces(c, end);
+
+        if (IsKeyword(c, end, "newmtl"))
+        {
+            materialIdx = (u32)materials.size();
+            materials.push_back(ObjMaterial{});
+            materials.back().name = ParseRestOfLine(c + 6, end);
+            continue;
+        }
+        if (materialIdx == UINT32_MAX)
+            continue;
+
+        ObjMaterial& material = materials[materialIdx];
+
+        // Texture options (-bm 1, -s 1 1 1...) go before the file name
+        std::string* map = NULL;
+        const char* mapArgs = NULL;
+
+        if (IsKeyword(c, end, "Kd"))
+        {
+            c = ParseFloat(c + 2, end, material.albedo.r);
+            c = ParseFloat(c, end, material.albedo.g);
+            c = ParseFloat(c, end, material.albedo.b);
+        }
+        else if (IsKeyword(c, end, "Ke"))
+        {
+            c = ParseFloat(c + 2, end, material.emissive.r);
+            c = ParseFloat(c, end, material.emissive.g);
+            c = ParseFloat(c, end, material.emissive.b);
+        }
+        else if (IsKeyword(c, end, "Ns"))
+        {
+            c = ParseFloat(c + 2, end, material.shininess);
+        }
+        else if (IsKeyword(c, end, "map_Kd"))   { map = &material.albedoMap;   mapArgs = c + 6; }
+        else if (IsKeyword(c, end, "map_Ke"))   { map = &material.emissiveMap; mapArgs = c + 6; }
+        else if (IsKeyword(c, end, "map_Ks"))   { map = &material.specularMap; mapArgs = c + 6; }
+        else if (IsKeyword(c, end, "norm"))     { map = &material.normalsMap;  mapArgs = c + 4; }
+        else if (IsKeyword(c, end, "map_Kn"))   { map = &material.normalsMap;  mapArgs = c + 6; }
+        else if (IsKeyword(c, end, "map_Bump")) { map = &material.bumpMap;     mapArgs = c + 8; }
+        else if (IsKeyword(c, end, "map_bump")) { map = &material.bumpMap;     mapArgs = c + 8; }
+        else if (IsKeyword(c, end, "bump"))     { map = &material.bumpMap;     mapArgs = c + 4; }
+
+        if (map)
+        {
+            std::string args = ParseRestOfLine(mapArgs, end);
+            size_t nameStart = args.find_last_of(" \t");
+            *map = JoinPath(directory, nameStart == std::string::npos ? args : args.substr(nameStart + 1));
+        }
+    }
+
+    UnmapFile(file);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Geometry
+
+// Merges the chunks into a single set of arrays with absolute indices
+static void MergeObjChunks(std::vector<ObjChunk>& chunks, ObjGeometry& geometry)
+{
+    u32 positionCount = 0, texCoordCount = 0, normalCount = 0, cornerCount = 0;
+    for (ObjChunk& chunk : chunks)
+    {
+        chunk.positionBase = positionCount;
+        chunk.texCoordBase = texCoordCount;
+        chunk.normalBase = normalCount;
+        chunk.cornerBase = cornerCount;
+        positionCount += (u32)chunk.positions.size();
+        texCoordCount += (u32)chunk.texCoords.size();
+        normalCount += (u32)chunk.normals.size();
+        cornerCount += (u32)chunk.corners.size();
+    }
+
+    geometry.positions.resize(positionCount);
+    geometry.texCoords.resize(texCoordCount);
+    geometry.normals.resize(normalCount);
+    geometry.corners.resize(cornerCount);
+
+    ParallelFor((u32)chunks.size(), 1, [&](u32 begin, u32 end) {
+        for (u32 i = begin; i < end; ++i)
+        {
+            const ObjChunk& chunk = chunks[i];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), geometry.positions.begin() + chunk.positionBase);
+            std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), geometry.texCoords.begin() + chunk.texCoordBase);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), geometry.normals.begin() + chunk.normalBase);
+
+            ObjCorner* corners = &geometry.corners[chunk.cornerBase];
+            for (u32 c = 0; c < chunk.corners.size(); ++c)
+            {
+                ObjCorner corner = chunk.corners[c];
+                if (corner.relative & OBJ_RELATIVE_POSITION) corner.position += (i32)chunk.positionBase;
+                if (corner.relative & OBJ_RELATIVE_TEXCOORD) corner.texCoord += (i32)chunk.texCoordBase;
+                if (corner.relative & OBJ_RELATIVE_NORMAL)   corner.normal += (i32)chunk.normalBase;
+                corner.relative = 0;
+
+                // Out of range indices are dropped here so nothing downstream has to check them
+                if (corner.texCoord >= (i32)geometry.texCoords.size()) corner.texCoord = -1;
+                if (corner.normal >= (i32)geometry.normals.size())     corner.normal = -1;
+                if (corner.position >= (i32)geometry.positions.size()) corner.position = -1;
+                corners[c] = corner;
+            }
+        }
+    });
+}
+
+static bool IsValidTriangle(const ObjCorner* corners)
+{
+    return corners[0].position >= 0 && corners[1].position >= 0 && corners[2].position >= 0;
+}
+
+// Smooth normals for the faces without them: face normals averaged over each position,
+// appended to the normals of the file
+static void GenerateMissingNormals(ObjGeometry& geometry)
+{
+    bool missingNormals = false;
+    for (const ObjCorner& corner : geometry.corners)
+        missingNormals |= corner.normal < 0;
+
+    if (!missingNormals)
+        return;
+
+    const u32 generatedBase = (u32)geometry.normals.size();
+    geometry.normals.resize(generatedBase + geometry.positions.size(), vec3(0.0f));
+    vec3* generated = &geometry.normals[generatedBase];
+
+    for (u32 i = 0; i + 2 < geometry.corners.size(); i += 3)
+    {
+        ObjCorner* corners = &geometry.corners[i];
+        if (!IsValidTriangle(corners))
+            continue;
+
+        const vec3& p0 = geometry.positions[corners[0].position];
+        const vec3& p1 = geometry.positions[corners[1].position];
+        const vec3& p2 = geometry.positions[corners[2].position];
+        vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+        const f32 length = glm::length(faceNormal);
+        if (length > 0.0f)
+            faceNormal /= length;
+
+        for (u32 c = 0; c < 3; ++c)
+        {
+            if (corners[c].normal >= 0)
+                continue;
+            generated[corners[c].position] += faceNormal;
+        }
+    }
+
+    for (u32 i = generatedBase; i < geometry.normals.size(); ++i)
+    {
+        const f32 length = glm::length(geometry.normals[i]);
+        geometry.normals[i] = length > 0.0f ? geometry.normals[i] / length : vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    for (ObjCorner& corner : geometry.corners)
+        if (corner.normal < 0 && corner.position >= 0)
+            corner.normal = (i32)generatedBase + corner.position;
+}
+
+struct ObjVertexKey
+{
+    i32 position;
+    i32 texCoord;
+    i32 normal;
+};
+
+static u32 HashVertexKey(const ObjVertexKey& key)
+{
+    u32 hash = (u32)key.position * 0x9E3779B1u;
+    hash ^= (u32)key.texCoord * 0x85EBCA77u + (hash << 6) + (hash >> 2);
+    hash ^= (u32)key.normal * 0xC2B2AE3Du + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+static vec3 OrthogonalizeTangent(const vec3& normal, const vec3& tangent)
+{
+    vec3 result = tangent - normal * glm::dot(normal, tangent);
+    const f32 length = glm::length(result);
+    if (length > 1e-6f)
+        return result / length;
+
+    // No usable uv gradient, any vector perpendicular to the normal will do
+    vec3 axis = fabsf(normal.x) < 0.9f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+    return glm::normalize(glm::cross(normal, glm::cross(axis, normal)));
+}
+
+// Welds the corners of the triangles in the ranges into indexed vertices with the same
+// layout ProcessAssimpMesh() produces: position, normal, [uv, tangent, bitangent]
+static void BuildObjSubmesh(const ObjGeometry& geometry, const std::vector<ObjTriangleRange>& ranges, Submesh& submesh)
+{
+    u32 cornerCount = 0;
+    bool hasTexCoords = false;
+    for (const ObjTriangleRange& range : ranges)
+    {
+        cornerCount += (range.last - range.first) * 3;
+        for (u32 c = range.first * 3; c < range.last * 3 && !hasTexCoords; ++c)
+            hasTexCoords = geometry.corners[c].texCoord >= 0;
+    }
+
+    const u32 floatStride = hasTexCoords ? 14 : 6;
+
+    u32 tableSize = 16;
+    while (tableSize < cornerCount * 2)
+        tableSize *= 2;
+    std::vector<u32> table(tableSize, UINT32_MAX);
+    std::vector<ObjVertexKey> vertexKeys;
+    vertexKeys.reserve(cornerCount / 2);
+
+    std::vector<float>& vertices = submesh.vertices;
+    std::vector<u32>& indices = submesh.indices;
+    indices.reserve(cornerCount);
+
+    for (const ObjTriangleRange& range : ranges)
+    {
+        for (u32 t = range.first; t < range.last; ++t)
+        {
+            const ObjCorner* corners = &geometry.corners[t * 3];
+            if (!IsValidTriangle(corners))
+                continue;
+
+            for (u32 c = 0; c < 3; ++c)
+            {
+                const ObjVertexKey key = { corners[c].position, hasTexCoords ? corners[c].texCoord : -1, corners[c].normal };
+
+                u32 slot = HashVertexKey(key) & (tableSize - 1);
+                while (table[slot] != UINT32_MAX)
+                {
+                    const ObjVertexKey& other = vertexKeys[table[slot]];
+                    if (other.position == key.position && other.texCoord == key.texCoord && other.normal == key.normal)
+                        break;
+                    slot = (slot + 1) & (tableSize - 1);
+                }
+
+                if (table[slot] == UINT32_MAX)
+                {
+                    table[slot] = (u32)vertexKeys.size();
+                    vertexKeys.push_back(key);
+
+                    const vec3& position = geometry.positions[key.position];
+                    const vec3& normal = geometry.normals[key.normal];
+                    vertices.insert(vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z });
+                    if (hasTexCoords)
+                    {
+                        const vec2 texCoord = key.texCoord >= 0 ? geometry.texCoords[key.texCoord] : vec2(0.0f);
+                        vertices.insert(vertices.end(), { texCoord.x, texCoord.y, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+                    }
+                }
+                indices.push_back(table[slot]);
+            }
+        }
+    }
+
+    if (hasTexCoords)
+    {
+        // Per face tangent space accumulated on the vertices, then made orthonormal to the normal
+        const u32 vertexCount = (u32)vertexKeys.size();
+        std::vector<vec3> tangents(vertexCount, vec3(0.0f));
+        std::vector<vec3> bitangents(vertexCount, vec3(0.0f));
+
+        for (u32 i = 0; i + 2 < indices.size(); i += 3)
+        {
+            const float* v0 = &vertices[indices[i + 0] * floatStride];
+            const float* v1 = &vertices[indices[i + 1] * floatStride];
+            const float* v2 = &vertices[indices[i + 2] * floatStride];
+
+            const vec3 edge0 = glm::make_vec3(v1) - glm::make_vec3(v0);
+            const vec3 edge1 = glm::make_vec3(v2) - glm::make_vec3(v0);
+            const vec2 uvEdge0 = glm::make_vec2(v1 + 6) - glm::make_vec2(v0 + 6);
+            const vec2 uvEdge1 = glm::make_vec2(v2 + 6) - glm::make_vec2(v0 + 6);
+
+            const f32 det = uvEdge0.x * uvEdge1.y - uvEdge1.x * uvEdge0.y;
+            const f32 sign = det < 0.0f ? -1.0f : 1.0f;
+            vec3 tangent = (edge0 * uvEdge1.y - edge1 * uvEdge0.y) * sign;
+            vec3 bitangent = (edge1 * uvEdge0.x - edge0 * uvEdge1.x) * sign;
+
+            const f32 tangentLength = glm::length(tangent);
+            const f32 bitangentLength = glm::length(bitangent);
+            if (tangentLength > 0.0f) tangent /= tangentLength;
+            if (bitangentLength > 0.0f) bitangent /= bitangentLength;
+
+            for (u32 c = 0; c < 3; ++c)
+            {
+                tangents[indices[i + c]] += tangent;
+                bitangents[indices[i + c]] += bitangent;
+            }
+        }
+
+        // Bitangents already point along +v, which is what ProcessAssimpMesh() ends up with
+        // after flipping the ones Assimp gives
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            float* vertex = &vertices[v * floatStride];
+            const vec3 normal = glm::make_vec3(vertex + 3);
+            const vec3 tangent = OrthogonalizeTangent(normal, tangents[v]);
+            const vec3 bitangent = OrthogonalizeTangent(normal, bitangents[v]);
+            vertex[8]  = tangent.x;   vertex[9]  = tangent.y;   vertex[10] = tangent.z;
+            vertex[11] = bitangent.x; vertex[12] = bitangent.y; vertex[13] = bitangent.z;
+        }
+    }
+
+    VertexBufferLayout vertexBufferLayout = {};
+    vertexBufferLayout.attributes.push_back( VertexBufferAttribute{ 0, 3, 0 } );
+    vertexBufferLayout.attributes.push_back( VertexBufferAttribute{ 1, 3, 3*sizeof(float) } );
+    vertexBufferLayout.stride = 6 * sizeof(float);
+    if (hasTexCoords)
+    {
+        vertexBufferLayout.attributes.push_back( VertexBufferAttribute{ 2, 2, vertexBufferLayout.stride } );
+        vertexBufferLayout.stride += 2 * sizeof(float);
+        vertexBufferLayout.attributes.push_back( VertexBufferAttribute{ 3, 3, vertexBufferLayout.stride } );
+        vertexBufferLayout.stride += 3 * sizeof(float);
+        vertexBufferLayout.attributes.push_back( VertexBufferAttribute{ 4, 3, vertexBufferLayout.stride } );
+        vertexBufferLayout.stride += 3 * sizeof(float);
+    }
+
+    submesh.vertexBufferLayout = vertexBufferLayout;
+    ComputeSubmeshBounds(submesh);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Loading
+
+bool ParseObjModel(const char* filename, ObjModel& model)
+{
+    MappedFile file = MapFile(filename);
+    if (!file.data)
+    {
+        ELOG("Error loading mesh %s: could not open the file", filename);
+        return false;
+    }
+
+    const char* begin = (const char*)file.data;
+    const char* end = begin + file.size;
+
+    // Line aligned chunks, a few per thread so they even out
+    const u64 chunkSize = glm::max((u64)OBJ_MIN_CHUNK_SIZE, file.size / ((GetJobWorkerCount() + 1) * 4) + 1);
+    std::vector<ObjChunk> chunks;
+    for (const char* c = begin; c < end;)
+    {
+        const char* chunkEnd = (u64)(end - c) > chunkSize ? SkipLine(c + chunkSize, end) : end;
+        chunks.push_back(ObjChunk{});
+        chunks.back().begin = c;
+        chunks.back().end = chunkEnd;
+        c = chunkEnd;
+    }
+
+    ParallelFor((u32)chunks.size(), 1, [&chunks](u32 first, u32 last) {
+        for (u32 i = first; i < last; ++i)
+            ParseObjChunk(chunks[i]);
+    });
+
+    ObjGeometry geometry;
+    MergeObjChunks(chunks, geometry);
+    UnmapFile(file);
+
+    GenerateMissingNormals(geometry);
+
+    // Triangles are grouped by material, one submesh each (as with aiProcess_OptimizeMeshes)
+    std::string directory = filename;
+    size_t separator = directory.find_last_of("/\\");
+    directory = separator == std::string::npos ? std::string() : directory.substr(0, separator);
+
+    std::vector<ObjMaterial> libraryMaterials;
+    std::unordered_map<std::string, u32> submeshByMaterial;
+    std::vector<std::vector<ObjTriangleRange>> submeshRanges;
+
+    std::string currentMaterial;
+    u32 rangeStart = 0;
+    auto closeRange = [&](u32 rangeEnd) {
+        if (rangeEnd == rangeStart)
+            return;
+
+        auto it = submeshByMaterial.find(currentMaterial);
+        if (it == submeshByMaterial.end())
+        {
+            it = submeshByMaterial.emplace(currentMaterial, (u32)submeshRanges.size()).first;
+            submeshRanges.emplace_back();
+            model.materials.push_back(ObjMaterial{});
+            model.materials.back().name = currentMaterial.empty() ? "DefaultMaterial" : currentMaterial;
+        }
+        submeshRanges[it->second].push_back(ObjTriangleRange{ rangeStart, rangeEnd });
+    };
+
+    for (ObjChunk& chunk : chunks)
+    {
+        for (const std::string& library : chunk.materialLibraries)
+            ParseMtlFile(JoinPath(directory, library), directory, libraryMaterials);
+
+        for (ObjMaterialSwitch& materialSwitch : chunk.materialSwitches)
+        {
+            const u32 firstTriangle = chunk.cornerBase / 3 + materialSwitch.firstTriangle;
+            closeRange(firstTriangle);
+            currentMaterial = materialSwitch.material;
+            rangeStart = firstTriangle;
+        }
+    }
+    closeRange((u32)geometry.corners.size() / 3);
+
+    for (ObjMaterial& material : model.materials)
+        for (const ObjMaterial& libraryMaterial : libraryMaterials)
+            if (libraryMaterial.name == material.name)
+                material = libraryMaterial;
+
+    model.submeshes.resize(submeshRanges.size());
+    ParallelFor((u32)submeshRanges.size(), 1, [&](u32 first, u32 last) {
+        for (u32 i = first; i < last; ++i)
+            BuildObjSubmesh(geometry, submeshRanges[i], model.submeshes[i]);
+    });
+
+    return true;
+}
+
+bool PrepareObjModel(const char* filename, ObjModel& model)
+{
+    if (!ParseObjModel(filename, model))
+        return false;
+
+    // Not part of ParseObjModel so the import benchmark compares parsing only
+    ParallelFor((u32)model.submeshes.size(), 1, [&model](u32 first, u32 last) {
+        for (u32 i = first; i < last; ++i)
+            GenerateSubmeshLods(model.submeshes[i]);
+    });
+    return true;
+}
+
+u32 CreateObjModel(App* app, ObjModel& objModel)
+{
+    app->meshes.push_back(Mesh{});
+    Mesh& mesh = app->meshes.back();
+    mesh.submeshes.swap(objModel.submeshes);
+    u32 meshIdx = (u32)app->meshes.size() - 1u;
+
+    app->models.push_back(Model{});
+    Model& model = app->models.back();
+    model.meshIdx = meshIdx;
+    u32 modelIdx = (u32)app->models.size() - 1u;
+
+    for (const ObjMaterial& objMaterial : objModel.materials)
+    {
+        Material material = {};
+        material.name = objMaterial.name;
+        material.albedo = objMaterial.albedo;
+        material.emissive = objMaterial.emissive;
+        material.smoothness = objMaterial.shininess / 256.0f;
+
+        if (!objMaterial.albedoMap.empty())
+            material.albedoTextureIdx = LoadTexture2D(app, objMaterial.albedoMap.c_str());
+        if (!objMaterial.emissiveMap.empty())
+            material.emissiveTextureIdx = LoadTexture2D(app, objMaterial.emissiveMap.c_str());
+        if (!objMaterial.specularMap.empty())
+            material.specularTextureIdx = LoadTexture2D(app, objMaterial.specularMap.c_str(), TextureUsage_Linear);
+        if (!objMaterial.normalsMap.empty())
+            material.normalsTextureIdx = LoadTexture2D(app, objMaterial.normalsMap.c_str(), TextureUsage_Normal);
+        if (!objMaterial.bumpMap.empty())
+            material.bumpTextureIdx = LoadTexture2D(app, objMaterial.bumpMap.c_str(), TextureUsage_Linear);
+
+        model.materialIdx.push_back((u32)app->materials.size());
+        app->materials.push_back(material);
+    }
+
+    UploadMesh(mesh);
+    ComputeModelBounds(app, model);
+
+    return modelIdx;
+}
+
+u32 LoadObjModel(App* app, const char* filename)
+{
+    ObjModel objModel;
+    if (!PrepareObjModel(filename, objModel))
+        return UINT32_MAX;
+
+    return CreateObjModel(app, objModel);
+}
+
+void BenchmarkObjImport(const char* filename, u32 iterations, f64& nativeMs, f64& assimpMs)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    iterations = glm::max(iterations, 1u);
+
+    Clock::time_point start = Clock::now();
+    for (u32 i = 0; i < iterations; ++i)
+    {
+        ObjModel model;
+        ParseObjModel(filename, model);
+    }
+    nativeMs = std::chrono::duration<f64, std::milli>(Clock::now() - start).count() / iterations;
+
+    // Only the import itself, without converting the aiScene into submeshes like LoadModel()
+    // does afterwards, so if anything this favours Assimp
+    start = Clock::now();
+    for (u32 i = 0; i < iterations; ++i)
+    {
+        const aiScene* scene = aiImportFile(filename, ASSIMP_MODEL_IMPORT_FLAGS);
+        aiReleaseImport(scene);
+    }
+    assimpMs = std::chrono::duration<f64, std::milli>(Clock::now() - start).count() / iterations;
+
+    ILOG("OBJ import benchmark (%s, %u iterations): native %.3f ms, Assimp %.3f ms", filename, iterations, nativeMs, assimpMs);
+}
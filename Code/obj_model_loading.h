@@ -0,0 +1,61 @@
+//
+// obj_model_loading.h: Native loader for Wavefront OBJ/MTL files, the format most of our
+// models come in. It maps the file, parses line aligned chunks of it in parallel and welds
+// the vertices with a hash table, emitting the same submesh layout as the Assimp path.
+//
+
+#pragma once
+
+#include "engine.h"
+
+struct ObjMaterial
+{
+    std::string name;
+    vec3        albedo = vec3(0.6f); // Same default as Assimp for materials missing in the .mtl
+    vec3        emissive = vec3(0.0f);
+    f32         shininess = 0.0f;
+
+    // Texture paths, already relative to the working directory
+    std::string albedoMap;
+    std::string emissiveMap;
+    std::string specularMap;
+    std::string normalsMap;
+    std::string bumpMap;
+};
+
+struct ObjModel
+{
+    std::vector<Submesh>     submeshes; // One per material, GPU fields left empty
+    std::vector<ObjMaterial> materials; // Material of each submesh
+};
+
+/**
+ * CPU side of the import: parses the .obj and its material libraries into submeshes with
+ * position, normal, texture coordinates and tangent space (when the file has uvs). Smooth
+ * normals are generated for the faces that do not have them. Thread safe, touches no GL state.
+ */
+bool ParseObjModel(const char* filename, ObjModel& model);
+
+/**
+ * ParseObjModel() plus the LOD chain of every submesh: all the CPU work of LoadObjModel(),
+ * so it can run on a worker thread before CreateObjModel().
+ */
+bool PrepareObjModel(const char* filename, ObjModel& model);
+
+/**
+ * GPU side of the import: loads the textures, creates the materials and uploads the mesh.
+ * Main thread only. Takes the submeshes out of the model. Returns the model index.
+ */
+u32 CreateObjModel(App* app, ObjModel& objModel);
+
+/**
+ * Parses the file, loads its textures and materials and uploads the mesh. Returns the model
+ * index or UINT32_MAX on failure, like LoadModel().
+ */
+u32 LoadObjModel(App* app, const char* filename);
+
+/**
+ * Imports the file `iterations` times with ParseObjModel and with aiImportFile (same flags
+ * as LoadModel) and returns the average milliseconds per import of each one.
+ */
+void BenchmarkObjImport(const char* filename, u32 iterations, f64& nativeMs, f64& assimpMs);
@@ -81,6 +81,33 @@ String ReadTextFile(const char *filepath);
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+/**
+ * Size of the file in bytes, 0 if it does not exist.
+ */
+u64 GetFileSizeInBytes(const char *filepath);
+
+struct MappedFile
+{
+    void* data;          // NULL if the file could not be mapped
+    u64   size;
+    void* fileHandle;    // Platform handles, only meaningful to the platform layer
+    void* mappingHandle;
+};
+
+/**
+ * Maps a whole file in memory as read only. Pages are loaded by the OS on first access,
+ * so nothing is copied until the data is actually used.
+ */
+MappedFile MapFile(const char* filepath);
+
+void UnmapFile(MappedFile& file);
+
+/**
+ * Address of an OpenGL function of the current context, for extension entry points the
+ * glad loader doesn't know about. NULL if the driver doesn't expose it.
+ */
+void* GetGLProcAddress(const char* name);
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
@@ -0,0 +1,138 @@
+#include "program_cache.h"
+
+static u64 HashBytes(u64 hash, const void* data, u64 size)
+{
+    // FNV-1a
+    const u8* bytes = (const u8*)data;
+    for (u64 i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static u64 HashString(u64 hash, const std::string& string)
+{
+    // Include the terminator so consecutive strings can't run into each other
+    return HashBytes(hash, string.c_str(), string.size() + 1);
+}
+
+static std::string GetProgramCachePath(const char* filepath, const char* programName, const char* defines)
+{
+    std::string path = std::string(filepath) + "." + programName;
+
+    // Shader variants of the same program each get their own file
+    if (defines[0])
+    {
+        char definesHash[32];
+        sprintf(definesHash, ".%08x", (u32)HashString(14695981039346656037ull, defines));
+        path += definesHash;
+    }
+
+    return path + ".pbin";
+}
+
+u64 GetProgramCacheKey(const OpenGLInfo& info, String programSource, const char* programName, const char* defines)
+{
+    u64 key = 14695981039346656037ull;
+    key = HashBytes(key, programSource.str, programSource.len);
+    key = HashString(key, programName);
+    key = HashString(key, defines);
+    key = HashString(key, info.glVendor);
+    key = HashString(key, info.glRenderer);
+    key = HashString(key, info.glVersion);
+    return key;
+}
+
+static GLuint LoadProgramBinary(const char* cachePath, u64 key)
+{
+    MappedFile file = MapFile(cachePath);
+    if (!file.data)
+        return 0;
+
+    GLuint programHandle = 0;
+    const ProgramCacheHeader* header = (const ProgramCacheHeader*)file.data;
+    if (file.size >= sizeof(ProgramCacheHeader) &&
+        header->magic == PROGRAM_CACHE_MAGIC && header->version == PROGRAM_CACHE_VERSION && header->key == key &&
+        file.size >= sizeof(ProgramCacheHeader) + header->binarySize)
+    {
+        programHandle = glCreateProgram();
+        glProgramBinary(programHandle, header->binaryFormat, header + 1, header->binarySize);
+
+        // Drivers reject binaries from other versions or hardware, it just means a recompile
+        GLint success;
+        glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            ILOG("Program binary %s rejected by the driver, recompiling", cachePath);
+            glDeleteProgram(programHandle);
+            programHandle = 0;
+        }
+    }
+
+    UnmapFile(file);
+    return programHandle;
+}
+
+static void SaveProgramBinary(const char* cachePath, u64 key, GLuint programHandle)
+{
+    GLint binarySize = 0;
+    glGetProgramiv(programHandle, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+    if (binarySize <= 0)
+        return;
+
+    std::vector<u8> binary(binarySize);
+    ProgramCacheHeader header = {};
+    header.magic = PROGRAM_CACHE_MAGIC;
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    glGetProgramBinary(programHandle, binarySize, &binarySize, &header.binaryFormat, binary.data());
+    header.binarySize = (u32)binarySize;
+
+    FILE* file = fopen(cachePath, "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing program binary %s", cachePath);
+        return;
+    }
+
+    const bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                         fwrite(binary.data(), 1, header.binarySize, file) == header.binarySize;
+    fclose(file);
+
+    if (!written)
+    {
+        ELOG("fwrite() failed writing program binary %s", cachePath);
+        remove(cachePath);
+    }
+}
+
+static bool IsProgramCacheSupported(const App* app)
+{
+    GLint binaryFormatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+    return app->programBinaryCache && binaryFormatCount > 0;
+}
+
+GLuint LoadCachedProgram(App* app, String programSource, const char* filepath, const char* programName, const char* defines, u64& key)
+{
+    key = GetProgramCacheKey(app->openGLInfo, programSource, programName, defines);
+    if (!IsProgramCacheSupported(app))
+        return 0;
+
+    const std::string cachePath = GetProgramCachePath(filepath, programName, defines);
+    GLuint programHandle = LoadProgramBinary(cachePath.c_str(), key);
+    if (programHandle)
+        app->programCacheHits++;
+    return programHandle;
+}
+
+void SaveCachedProgram(App* app, const Program& program, u64 key)
+{
+    if (!IsProgramCacheSupported(app))
+        return;
+
+    const std::string cachePath = GetProgramCachePath(program.filepath.c_str(), program.programName.c_str(), program.defines.c_str());
+    SaveProgramBinary(cachePath.c_str(), key, program.handle);
+}
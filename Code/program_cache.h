@@ -0,0 +1,41 @@
+//
+// program_cache.h: On disk cache of linked program binaries. Programs are stored with
+// glGetProgramBinary() next to their source file, keyed by a hash of the source, the program
+// name, the variant defines and the driver strings, and restored with glProgramBinary() on the
+// next start.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define PROGRAM_CACHE_MAGIC   0x4E494250 // "PBIN"
+#define PROGRAM_CACHE_VERSION 1
+
+struct ProgramCacheHeader
+{
+    u32    magic;
+    u32    version;
+    u64    key;          // GetProgramCacheKey()
+    GLenum binaryFormat;
+    u32    binarySize;   // Bytes following the header
+};
+
+/**
+ * Hash of everything that makes a cached binary valid: the source, the program name, the
+ * variant defines and the vendor, renderer and version of the driver that produced it.
+ */
+u64 GetProgramCacheKey(const OpenGLInfo& info, String programSource, const char* programName, const char* defines);
+
+/**
+ * Returns the program from the cache if there is a binary with the same key the driver
+ * accepts, 0 otherwise. key receives the key to store the compiled program with, see
+ * SaveCachedProgram().
+ */
+GLuint LoadCachedProgram(App* app, String programSource, const char* filepath, const char* programName, const char* defines, u64& key);
+
+/**
+ * Stores the binary of a program compiled from source, at load or on a hot reload, so the
+ * next start doesn't compile it again. key is GetProgramCacheKey() of its source.
+ */
+void SaveCachedProgram(App* app, const Program& program, u64 key);
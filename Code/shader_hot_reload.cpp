@@ -0,0 +1,111 @@
+#include "shader_hot_reload.h"
+#include "program_cache.h"
+
+static bool IsProgramReloading(const App* app, u32 programIdx)
+{
+    for (const PendingProgram& reload : app->programReloads)
+        if (reload.programIdx == programIdx)
+            return true;
+    return false;
+}
+
+static void DeleteProgramVaos(App* app, GLuint programHandle)
+{
+    // VAOs bind the attributes of one program, the new handle gets its own ones on the next draw
+    for (Mesh& mesh : app->meshes)
+    {
+        for (Submesh& submesh : mesh.submeshes)
+        {
+            for (u32 i = 0; i < submesh.vaos.size(); )
+            {
+                if (submesh.vaos[i].programHandle == programHandle)
+                {
+                    glDeleteVertexArrays(1, &submesh.vaos[i].handle);
+                    submesh.vaos[i] = submesh.vaos.back();
+                    submesh.vaos.pop_back();
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+        }
+    }
+}
+
+static void StartProgramReloads(App* app)
+{
+    for (u32 programIdx = 0; programIdx < app->programs.size(); ++programIdx)
+    {
+        const Program& program = app->programs[programIdx];
+        const u64 timestamp = GetFileLastWriteTimestamp(program.filepath.c_str());
+        if (timestamp == 0 || timestamp == program.lastWriteTimestamp || program.pending || IsProgramReloading(app, programIdx))
+            continue;
+
+        String programSource = ReadTextFile(program.filepath.c_str());
+        if (programSource.len == 0)
+            continue; // Editors may truncate the file before writing it, try again later
+
+        PendingProgram reload = {};
+        reload.programIdx = programIdx;
+        reload.compile = StartProgramCompile(programSource, program.programName.c_str(), program.defines.c_str());
+        reload.sourceTimestamp = timestamp;
+        reload.cacheKey = GetProgramCacheKey(app->openGLInfo, programSource, program.programName.c_str(), program.defines.c_str());
+        app->programReloads.push_back(reload);
+
+        ILOG("Reloading program %s from %s", program.programName.c_str(), program.filepath.c_str());
+    }
+}
+
+static void FinishProgramReload(App* app, PendingProgram& reload)
+{
+    Program& program = app->programs[reload.programIdx];
+
+    // Failed or not, this version of the source is done with until it is saved again
+    program.lastWriteTimestamp = reload.sourceTimestamp;
+
+    if (!FinishProgramCompile(reload.compile, program.programName.c_str()))
+    {
+        ELOG("Program %s failed to reload, keeping the previous version", program.programName.c_str());
+        glDeleteProgram(reload.compile.programHandle);
+        return;
+    }
+
+    const GLuint oldHandle = program.handle;
+    DeleteProgramVaos(app, oldHandle);
+    glDeleteProgram(oldHandle);
+
+    program.handle = reload.compile.programHandle;
+    ReflectProgram(program);
+    QueryProgramUniforms(app, reload.programIdx);
+    SaveCachedProgram(app, program, reload.cacheKey);
+
+    app->programReloadCount++;
+}
+
+void UpdateShaderHotReload(App* app)
+{
+    // Started on previous frames, with parallel compilation they are kept until they complete
+    for (u32 i = 0; i < app->programReloads.size(); )
+    {
+        if (IsProgramCompileDone(app, app->programReloads[i].compile))
+        {
+            FinishProgramReload(app, app->programReloads[i]);
+            app->programReloads.erase(app->programReloads.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    if (!app->shaderHotReload)
+        return;
+
+    app->shaderHotReloadTimer += app->deltaTime;
+    if (app->shaderHotReloadTimer < app->shaderHotReloadInterval)
+        return;
+    app->shaderHotReloadTimer = 0.0f;
+
+    StartProgramReloads(app);
+}
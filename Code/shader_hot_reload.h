@@ -0,0 +1,17 @@
+//
+// shader_hot_reload.h: Hot reload of shader programs. The sources of the loaded programs are
+// watched for changes; a changed program is compiled in the background while the old one keeps
+// drawing, and only swapped in if it links, so a typo in a shader never breaks the frame.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Checks the source timestamps every App::shaderHotReloadInterval seconds and starts compiling
+ * the programs whose source changed. Reloads are finished once IsProgramCompileDone(): on
+ * success the handle in App::programs is replaced, the VAOs made for the old handle are
+ * deleted and its inputs and uniforms are reflected again. Called once per frame from Update().
+ */
+void UpdateShaderHotReload(App* app);
@@ -0,0 +1,89 @@
+#include "shader_variants.h"
+
+// By bit of ShaderFeature
+static const char* ShaderFeatureDefines[ShaderFeature_Count] = {
+    "INSTANCED",
+    "ALBEDO_MAP",
+    "EMISSIVE",
+    "GBUFFER",
+    "UBER",
+};
+
+static std::string GetShaderFeatureDefines(u32 features)
+{
+    std::string defines;
+    for (u32 bit = 0; bit < ShaderFeature_Count; ++bit)
+        if (features & (1u << bit))
+            defines += std::string("#define ") + ShaderFeatureDefines[bit] + "\n";
+    return defines;
+}
+
+static u32 LoadShaderVariant(App* app, ShaderVariants& variants, u32 features)
+{
+    // In the map before it is reflected, QueryProgramUniforms() looks the program up there
+    const std::string defines = GetShaderFeatureDefines(features);
+    const u32 programIdx = LoadProgram(app, variants.filepath.c_str(), variants.programName.c_str(), defines.c_str());
+    variants.programs[features] = programIdx;
+    return programIdx;
+}
+
+static u32 GetUberFeatures(const ShaderVariants& variants, u32 features)
+{
+    return (features & ~variants.uberFeatures) | ShaderFeature_Uber;
+}
+
+void InitShaderVariants(App* app, ShaderVariants& variants, const char* filepath, const char* programName, u32 uberFeatures)
+{
+    variants.filepath = filepath;
+    variants.programName = programName;
+    variants.uberFeatures = uberFeatures;
+    variants.programs.clear();
+
+    // One uber variant for each combination of the features that can't be branched on
+    const u32 allFeatures = (1u << ShaderFeature_Count) - 1;
+    for (u32 features = 0; features <= allFeatures; ++features)
+        if ((features & (uberFeatures | ShaderFeature_Uber)) == 0)
+            LoadShaderVariant(app, variants, GetUberFeatures(variants, features));
+}
+
+u32 GetShaderVariant(App* app, ShaderVariants& variants, u32 features)
+{
+    auto it = variants.programs.find(features);
+    u32 programIdx = it != variants.programs.end() ? it->second : UINT32_MAX;
+
+    if (programIdx == UINT32_MAX)
+    {
+        programIdx = LoadShaderVariant(app, variants, features);
+        ILOG("Shader variant %s 0x%x requested", variants.programName.c_str(), features);
+
+        // Without the fallback the frame waits for it, as well as any other pending program
+        if (!app->uberShaderFallback)
+            FinishProgramLoads(app);
+    }
+
+    const Program& program = app->programs[programIdx];
+    if (!program.pending && program.handle)
+        return programIdx;
+
+    // Compiling in the background (PollProgramLoads()) or failed, the uber variant draws it
+    app->uberShaderDraws++;
+    return variants.programs[GetUberFeatures(variants, features)];
+}
+
+bool IsShaderVariant(const ShaderVariants& variants, u32 programIdx)
+{
+    for (const auto& variant : variants.programs)
+        if (variant.second == programIdx)
+            return true;
+    return false;
+}
+
+u32 GetMaterialShaderFeatures(const App* app, const Material& material)
+{
+    u32 features = 0;
+    if (material.albedoTextureIdx < app->textures.size())
+        features |= ShaderFeature_AlbedoMap;
+    if (material.emissive != vec3(0.0f))
+        features |= ShaderFeature_Emissive;
+    return features;
+}
@@ -0,0 +1,39 @@
+//
+// shader_variants.h: Shader permutations. A program declares feature keys (ShaderFeature) that
+// its source tests with #ifdef; each combination asked for is compiled on first use, with the
+// defines of its bits, and kept in a hash map by feature mask. Materials get the variant that
+// covers exactly their features instead of one program branching on all of them.
+//
+// Variants compile in the background. Until they are ready the uber variant (UBER defined)
+// draws instead: it is loaded up front and tests the features in uberFeatures at runtime from
+// the uFeatures uniform, so new materials show up at once without a compile hitch.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Sets up the variants of the program programName of filepath and loads its uber variants, one
+ * per combination of the features not in uberFeatures. They are finished by the next
+ * FinishProgramLoads().
+ */
+void InitShaderVariants(App* app, ShaderVariants& variants, const char* filepath, const char* programName, u32 uberFeatures);
+
+/**
+ * Index in App::programs of the variant for the feature mask (ShaderFeature bits). The first
+ * time a mask is asked for its compile is started and, while it isn't done, the uber variant
+ * covering the mask is returned: its uFeatures uniform has to be set to features.
+ */
+u32 GetShaderVariant(App* app, ShaderVariants& variants, u32 features);
+
+/**
+ * Whether the program at programIdx is one of the variants of the set.
+ */
+bool IsShaderVariant(const ShaderVariants& variants, u32 programIdx);
+
+/**
+ * Features a material needs from the textured mesh program, without ShaderFeature_Instanced
+ * which depends on the model.
+ */
+u32 GetMaterialShaderFeatures(const App* app, const Material& material);
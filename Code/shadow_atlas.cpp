@@ -0,0 +1,462 @@
+#include "shadow_atlas.h"
+#include "light_grid.h"
+#include "mesh_lod.h"
+
+#include <float.h>
+
+#define SHADOW_ATLAS_CELLS (SHADOW_ATLAS_SIZE / SHADOW_CELL_SIZE) // Per side, at most 8 so they fit a u64
+
+// Order the shaders pick the face of a point light in: +x, -x, +y, -y, +z, -z
+static const vec3 CubeFaceDirections[6] = { vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1) };
+static const vec3 CubeFaceUps[6] = { vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0) };
+
+// Allocates a square of size x size cells, first fit. Returns false if the atlas is full
+static bool AllocateShadowCells(App* app, u32 size, ivec4& rect, u64& cells)
+{
+    for (u32 y = 0; y + size <= SHADOW_ATLAS_CELLS; y += size)
+    {
+        for (u32 x = 0; x + size <= SHADOW_ATLAS_CELLS; x += size)
+        {
+            u64 mask = 0;
+            for (u32 j = y; j < y + size; ++j)
+                for (u32 i = x; i < x + size; ++i)
+                    mask |= 1ull << (j * SHADOW_ATLAS_CELLS + i);
+
+            if (app->shadowAtlasCells & mask)
+                continue;
+
+            app->shadowAtlasCells |= mask;
+            cells |= mask;
+            rect = ivec4(x * SHADOW_CELL_SIZE, y * SHADOW_CELL_SIZE, size * SHADOW_CELL_SIZE, size * SHADOW_CELL_SIZE);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void FreeShadowSlot(App* app, ShadowSlot& slot)
+{
+    app->shadowAtlasCells &= ~slot.cells;
+    slot.cells = 0;
+}
+
+static bool AllocateShadowSlot(App* app, ShadowSlot& slot, const Light& light)
+{
+    const u32 viewCount = light.type == LIGHT_POINT ? 6 : SHADOW_CASCADE_COUNT;
+    const u32 viewCells = light.type == LIGHT_POINT ? 1 : SHADOW_CASCADE_SIZE / SHADOW_CELL_SIZE;
+
+    slot.views.resize(viewCount);
+    slot.viewRects.resize(viewCount);
+    for (u32 i = 0; i < viewCount; ++i)
+    {
+        if (!AllocateShadowCells(app, viewCells, slot.viewRects[i], slot.cells))
+        {
+            FreeShadowSlot(app, slot);
+            return false;
+        }
+        slot.views[i].atlasRect = vec4(slot.viewRects[i]) / (f32)SHADOW_ATLAS_SIZE;
+    }
+    slot.staticViews = 0;
+    slot.compositeStaticViews = 0;
+    return true;
+}
+
+// Game objects that don't move, with what they look like: any change re-renders the static layers
+static u64 GetStaticCasterHash(const App* app)
+{
+    u64 hash = 14695981039346656037ull;
+    for (const GameObject& gameObject : app->gameObjects)
+    {
+        if (gameObject.dynamic)
+            continue;
+
+        const u8* bytes = (const u8*)value_ptr(gameObject.transform.matrix);
+        for (u32 i = 0; i < sizeof(glm::mat4); ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        hash = (hash ^ gameObject.modelIdx) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// World space bounding sphere of every game object, from the bounds stored on its model
+static void ComputeCasterBounds(const App* app, std::vector<vec4>& casterBounds)
+{
+    casterBounds.resize(app->gameObjects.size());
+    for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
+    {
+        const GameObject& gameObject = app->gameObjects[i];
+        const Model& model = app->models[gameObject.modelIdx];
+        const vec4 bounds = vec4(model.boundsCenter, model.boundsRadius);
+
+        const glm::mat4& transform = gameObject.transform.matrix;
+        const f32 scale = glm::max(glm::length(vec3(transform[0])), glm::max(glm::length(vec3(transform[1])), glm::length(vec3(transform[2]))));
+        casterBounds[i] = vec4(vec3(transform * vec4(vec3(bounds), 1.0f)), bounds.w * scale);
+    }
+}
+
+static void ComputePointShadowViews(ShadowSlot& slot, const Light& light)
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, light.range);
+    for (u32 face = 0; face < 6; ++face)
+    {
+        const glm::mat4 view = glm::lookAt(light.position, light.position + CubeFaceDirections[face], CubeFaceUps[face]);
+        slot.views[face].viewProjection = projection * view;
+    }
+}
+
+// View depth range of the game objects the camera sees, false if it sees none
+static bool GetReceiverDepthRange(const App* app, const std::vector<vec4>& casterBounds, f32& nearDepth, f32& farDepth)
+{
+    vec4 planes[6];
+    GetFrustumPlanes(app->projection * app->view, planes);
+
+    nearDepth = FLT_MAX;
+    farDepth = -FLT_MAX;
+    for (const vec4& bounds : casterBounds)
+    {
+        bool visible = true;
+        for (const vec4& plane : planes)
+            visible &= glm::dot(vec3(plane), vec3(bounds)) + plane.w >= -bounds.w;
+        if (!visible)
+            continue;
+
+        const f32 depth = -(app->view * vec4(vec3(bounds), 1.0f)).z;
+        nearDepth = glm::min(nearDepth, depth - bounds.w);
+        farDepth = glm::max(farDepth, depth + bounds.w);
+    }
+
+    nearDepth = glm::max(nearDepth, app->zNear);
+    farDepth = glm::min(farDepth, app->zFar);
+    return nearDepth < farDepth;
+}
+
+// Refits the cascades of a directional light to the receivers. Cascade c is refitted every 2^c
+// frames; a cascade whose fit changed loses its static layer
+static void FitShadowCascades(App* app, ShadowSlot& slot, const Light& light, f32 receiverNear, f32 receiverFar)
+{
+    // Quarter octave steps: the splits, so the cascade sizes, only change when the range does a lot
+    receiverNear = exp2f(floorf(log2f(receiverNear) * 4.0f) / 4.0f);
+    receiverFar = exp2f(ceilf(log2f(receiverFar) * 4.0f) / 4.0f);
+
+    // Practical split scheme, mostly logarithmic
+    const f32 lambda = 0.8f;
+    for (u32 c = 0; c <= SHADOW_CASCADE_COUNT; ++c)
+    {
+        const f32 t = (f32)c / SHADOW_CASCADE_COUNT;
+        const f32 logSplit = receiverNear * powf(receiverFar / receiverNear, t);
+        const f32 uniformSplit = receiverNear + (receiverFar - receiverNear) * t;
+        app->shadowCascadeSplits[c] = glm::mix(uniformSplit, logSplit, lambda);
+    }
+
+    const vec3 up = fabsf(light.direction.y) > 0.99f ? vec3(1, 0, 0) : vec3(0, 1, 0);
+    const glm::mat4 lightView = glm::lookAt(vec3(0.0f), light.direction, up);
+    const glm::mat4 inverseView = glm::inverse(app->view);
+
+    // Depth covers every caster, it only changes with the static ones
+    const f32 casterDepth = (lightView * vec4(app->shadowCasterCenter, 1.0f)).z;
+    const f32 casterRadius = glm::max(app->shadowCasterRadius, 1.0f);
+    const f32 zNear = -(casterDepth + casterRadius);
+    const f32 zFar = -(casterDepth - casterRadius);
+
+    const f32 tanX = 1.0f / app->projection[0][0];
+    const f32 tanY = 1.0f / app->projection[1][1];
+    for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+    {
+        const u32 bit = 1u << c;
+        if ((slot.staticViews & bit) && app->shadowFrame % (1u << c) != 0)
+            continue;
+
+        // Bounding sphere of the frustum slice: its size doesn't change as the camera turns
+        const f32 sliceNear = app->shadowCascadeSplits[c];
+        const f32 sliceFar = app->shadowCascadeSplits[c + 1];
+        const vec3 center = vec3(0.0f, 0.0f, -0.5f * (sliceNear + sliceFar));
+        const f32 radius = glm::max(glm::length(vec3(sliceFar * tanX, sliceFar * tanY, -sliceFar) - center),
+                                    glm::length(vec3(sliceNear * tanX, sliceNear * tanY, -sliceNear) - center));
+
+        // Moves in whole texels, so the rasterized casters don't shimmer
+        const f32 texelSize = 2.0f * radius / SHADOW_CASCADE_SIZE;
+        vec3 lightCenter = vec3(lightView * inverseView * vec4(center, 1.0f));
+        lightCenter.x = floorf(lightCenter.x / texelSize) * texelSize;
+        lightCenter.y = floorf(lightCenter.y / texelSize) * texelSize;
+
+        const glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+                                                lightCenter.y - radius, lightCenter.y + radius, zNear, zFar);
+        const glm::mat4 viewProjection = projection * lightView;
+        if (viewProjection != slot.views[c].viewProjection)
+        {
+            slot.views[c].viewProjection = viewProjection;
+            slot.staticViews &= ~bit;
+        }
+        app->shadowCascadesFitted++;
+    }
+}
+
+// Draws the static or the dynamic casters, only those reaching the light if it has a range
+static void DrawShadowCasters(App* app, const Light& light, const std::vector<vec4>& casterBounds,
+                              const glm::mat4& viewProjection, bool dynamic)
+{
+    const Program& program = app->programs[app->shadowDepthProgramIdx];
+    const Program& instancedProgram = app->programs[app->shadowDepthInstancedProgramIdx];
+    const GLint uWorldViewProjection = GetUniformLocation(program, "uWorldViewProjection");
+    const GLint uInstancedWorldViewProjection = GetUniformLocation(instancedProgram, "uWorldViewProjection");
+
+    for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
+    {
+        const GameObject& gameObject = app->gameObjects[i];
+        if (gameObject.dynamic != dynamic)
+            continue;
+        if (light.type == LIGHT_POINT && glm::length(vec3(casterBounds[i]) - light.position) > casterBounds[i].w + light.range)
+            continue;
+
+        Model& model = app->models[gameObject.modelIdx];
+        Mesh& mesh = app->meshes[model.meshIdx];
+        const bool instanced = !model.instanceBatches.empty();
+        const Program& casterProgram = instanced ? instancedProgram : program;
+        glUseProgram(casterProgram.handle);
+        const glm::mat4 worldViewProjection = viewProjection * gameObject.transform.matrix;
+        glUniformMatrix4fv(instanced ? uInstancedWorldViewProjection : uWorldViewProjection, 1, GL_FALSE, value_ptr(worldViewProjection));
+
+        // Full geometry: static views are cached, they don't follow the LOD of the camera
+        const u32 drawCount = instanced ? (u32)model.instanceBatches.size() : (u32)mesh.submeshes.size();
+        for (u32 d = 0; d < drawCount; ++d)
+        {
+            const u32 submeshIdx = instanced ? model.instanceBatches[d].submeshIdx : d;
+            const Submesh& submesh = mesh.submeshes[submeshIdx];
+            glBindVertexArray(FindVAO(mesh, submeshIdx, casterProgram));
+            if (instanced)
+            {
+                const InstanceBatch& batch = model.instanceBatches[d];
+                glDrawElementsInstancedBaseInstance(GL_TRIANGLES, submesh.indexCount, submesh.indexType, (void*)(u64)submesh.indexOffset,
+                                                    batch.instanceCount, batch.firstInstance);
+            }
+            else
+            {
+                glDrawElements(GL_TRIANGLES, submesh.indexCount, submesh.indexType, (void*)(u64)submesh.indexOffset);
+            }
+        }
+    }
+}
+
+// Dynamic casters reaching each light: every one for directional lights, those within range
+// for point lights, found from the objects through the light grid
+static void CountDynamicCasters(const App* app, const std::vector<vec4>& casterBounds, std::vector<u32>& dynamicCasters)
+{
+    u32 dynamicCount = 0;
+    std::vector<u32> lightIndices;
+    for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
+    {
+        if (!app->gameObjects[i].dynamic)
+            continue;
+        dynamicCount++;
+        QueryLightsInSphere(app->lightGrid, vec3(casterBounds[i]), casterBounds[i].w, lightIndices);
+    }
+
+    dynamicCasters.assign(app->lights.size(), 0);
+    for (u32 lightIdx : lightIndices)
+        dynamicCasters[lightIdx]++;
+    for (u32 lightIdx = 0; lightIdx < (u32)app->lights.size(); ++lightIdx)
+        if (app->lights[lightIdx].type == LIGHT_DIRECTIONAL)
+            dynamicCasters[lightIdx] = dynamicCount;
+}
+
+static void SetShadowView(const ivec4& rect)
+{
+    glViewport(rect.x, rect.y, rect.z, rect.w);
+    glScissor(rect.x, rect.y, rect.z, rect.w);
+}
+
+void InitShadowAtlas(App* app)
+{
+    const ivec2 atlasSize = ivec2(SHADOW_ATLAS_SIZE);
+    app->shadowStaticAtlasHandle = CreateAttachmentTexture(GL_DEPTH_COMPONENT24, atlasSize, GL_DEPTH_COMPONENT, GL_FLOAT);
+    app->shadowAtlasHandle = CreateAttachmentTexture(GL_DEPTH_COMPONENT24, atlasSize, GL_DEPTH_COMPONENT, GL_FLOAT);
+
+    // Sampled with depth comparison, filtered 2x2 by the hardware
+    glBindTexture(GL_TEXTURE_2D, app->shadowAtlasHandle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLuint* framebuffers[] = { &app->shadowStaticFramebufferHandle, &app->shadowFramebufferHandle };
+    GLuint atlases[] = { app->shadowStaticAtlasHandle, app->shadowAtlasHandle };
+    for (u32 i = 0; i < ARRAY_COUNT(atlases); ++i)
+    {
+        glGenFramebuffers(1, framebuffers[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, *framebuffers[i]);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, atlases[i], 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        CheckFramebufferStatus();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(1, &app->shadowViewBuffer);
+
+    app->shadowDepthProgramIdx = LoadProgram(app, "shaders.glsl", "SHADOW_DEPTH");
+    app->shadowDepthInstancedProgramIdx = LoadProgram(app, "shaders.glsl", "SHADOW_DEPTH", "#define INSTANCED\n");
+}
+
+void UpdateShadowAtlas(App* app)
+{
+    app->lightShadowViews.assign(app->lights.size(), UINT32_MAX);
+    app->shadowStaticViewsRendered = 0;
+    app->shadowDynamicViewsRendered = 0;
+    app->shadowLightsOutOfAtlas = 0;
+    app->shadowCascadesFitted = 0;
+    app->shadowFrame++;
+    if (!app->shadowFramebufferHandle)
+        return;
+
+    const Program& program = app->programs[app->shadowDepthProgramIdx];
+    const Program& instancedProgram = app->programs[app->shadowDepthInstancedProgramIdx];
+    const bool programsReady = program.handle && !program.pending && instancedProgram.handle && !instancedProgram.pending;
+
+    // Slots of the lights that stopped casting shadows give their cells back
+    for (u32 i = 0; i < (u32)app->shadowSlots.size(); )
+    {
+        const Light& light = app->lights[app->shadowSlots[i].lightIdx];
+        if (!app->shadows || !light.castShadows || light.type != app->shadowSlots[i].renderedLight.type)
+        {
+            FreeShadowSlot(app, app->shadowSlots[i]);
+            app->shadowSlots.erase(app->shadowSlots.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    if (app->shadows)
+    {
+        for (u32 lightIdx = 0; lightIdx < (u32)app->lights.size(); ++lightIdx)
+        {
+            const Light& light = app->lights[lightIdx];
+            if (!light.castShadows)
+                continue;
+
+            bool allocated = false;
+            for (const ShadowSlot& slot : app->shadowSlots)
+                allocated |= slot.lightIdx == lightIdx;
+            if (allocated)
+                continue;
+
+            ShadowSlot slot = {};
+            slot.lightIdx = lightIdx;
+            slot.renderedLight = light;
+            if (AllocateShadowSlot(app, slot, light))
+                app->shadowSlots.push_back(slot);
+            else
+                app->shadowLightsOutOfAtlas++;
+        }
+    }
+
+    const u64 staticHash = GetStaticCasterHash(app);
+    const bool staticCastersChanged = staticHash != app->shadowStaticHash;
+
+    std::vector<vec4> casterBounds;
+    ComputeCasterBounds(app, casterBounds);
+    if (staticCastersChanged)
+    {
+        vec3 boundsMin = vec3(FLT_MAX), boundsMax = vec3(-FLT_MAX);
+        for (const vec4& bounds : casterBounds)
+        {
+            boundsMin = glm::min(boundsMin, vec3(bounds) - bounds.w);
+            boundsMax = glm::max(boundsMax, vec3(bounds) + bounds.w);
+        }
+        app->shadowCasterCenter = casterBounds.empty() ? vec3(0.0f) : (boundsMin + boundsMax) * 0.5f;
+        app->shadowCasterRadius = casterBounds.empty() ? 0.0f : glm::length(boundsMax - boundsMin) * 0.5f;
+    }
+
+    std::vector<u32> dynamicCastersByLight;
+    CountDynamicCasters(app, casterBounds, dynamicCastersByLight);
+
+    f32 receiverNear = 0.0f, receiverFar = 0.0f;
+    const bool receiversVisible = GetReceiverDepthRange(app, casterBounds, receiverNear, receiverFar);
+
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    app->shadowViews.clear();
+    for (ShadowSlot& slot : app->shadowSlots)
+    {
+        const Light& light = app->lights[slot.lightIdx];
+        const bool lightMoved = light.position != slot.renderedLight.position || light.direction != slot.renderedLight.direction ||
+                                light.range != slot.renderedLight.range;
+        if (lightMoved || staticCastersChanged)
+        {
+            slot.staticViews = 0;
+            slot.renderedLight = light;
+        }
+
+        if (light.type == LIGHT_POINT && !slot.staticViews)
+            ComputePointShadowViews(slot, light);
+        else if (light.type == LIGHT_DIRECTIONAL && receiversVisible)
+            FitShadowCascades(app, slot, light, receiverNear, receiverFar);
+
+        if (programsReady)
+        {
+            const u32 dynamicCasters = dynamicCastersByLight[slot.lightIdx];
+            for (u32 i = 0; i < (u32)slot.views.size(); ++i)
+            {
+                const u32 bit = 1u << i;
+                const ivec4& rect = slot.viewRects[i];
+
+                bool staticRendered = false;
+                if (!(slot.staticViews & bit))
+                {
+                    glBindFramebuffer(GL_FRAMEBUFFER, app->shadowStaticFramebufferHandle);
+                    SetShadowView(rect);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    DrawShadowCasters(app, light, casterBounds, slot.views[i].viewProjection, false);
+                    slot.staticViews |= bit;
+                    staticRendered = true;
+                    app->shadowStaticViewsRendered++;
+                }
+
+                // Nothing to do while neither the static layer nor any dynamic caster changes it
+                if (staticRendered || dynamicCasters || !(slot.compositeStaticViews & bit))
+                {
+                    glBindFramebuffer(GL_FRAMEBUFFER, app->shadowFramebufferHandle);
+                    glCopyImageSubData(app->shadowStaticAtlasHandle, GL_TEXTURE_2D, 0, rect.x, rect.y, 0,
+                                       app->shadowAtlasHandle, GL_TEXTURE_2D, 0, rect.x, rect.y, 0, rect.z, rect.w, 1);
+                    if (dynamicCasters)
+                    {
+                        SetShadowView(rect);
+                        DrawShadowCasters(app, light, casterBounds, slot.views[i].viewProjection, true);
+                        app->shadowDynamicViewsRendered++;
+                    }
+                    slot.compositeStaticViews = dynamicCasters ? slot.compositeStaticViews & ~bit : slot.compositeStaticViews | bit;
+                }
+            }
+        }
+
+        // Views that never rendered are still empty, better unshadowed than wrong
+        const u32 allViews = (1u << slot.views.size()) - 1;
+        app->lightShadowViews[slot.lightIdx] = slot.staticViews == allViews ? (u32)app->shadowViews.size() : UINT32_MAX;
+        app->shadowViews.insert(app->shadowViews.end(), slot.views.begin(), slot.views.end());
+    }
+    if (programsReady)
+        app->shadowStaticHash = staticHash;
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_SCISSOR_TEST);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+
+    // Never empty so the binding stays valid
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->shadowViewBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max(app->shadowViews.size(), (size_t)1) * sizeof(ShadowView), NULL, GL_STREAM_DRAW);
+    if (!app->shadowViews.empty())
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, app->shadowViews.size() * sizeof(ShadowView), app->shadowViews.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, app->shadowViewBuffer);
+
+    glActiveTexture(GL_TEXTURE0 + SHADOW_ATLAS_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, app->shadowAtlasHandle);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,34 @@
+//
+// shadow_atlas.h: Shadow maps of the lights with Light::castShadows, all allocated from one
+// depth atlas of SHADOW_ATLAS_SIZE squared. Directional lights take SHADOW_CASCADE_COUNT
+// cascades of SHADOW_CASCADE_SIZE, point lights six SHADOW_CELL_SIZE cube faces. Static casters are
+// rendered into a second, cached atlas only when the light or a static game object changes;
+// every frame the cached views are copied into the sampled atlas and the dynamic casters
+// (GameObject::dynamic) drawn on top, so a still scene costs nothing.
+//
+// Cascades split the depth range of the visible game objects, not zNear to zFar, and are
+// bounding spheres of their frustum slice moved in whole texels, so they don't shimmer as the
+// camera moves and turns. Farther cascades are refitted less often: a cascade only loses its
+// cached static layer when its fit actually changed.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define SHADOW_ATLAS_SIZE 4096
+#define SHADOW_CELL_SIZE 512        // Allocation unit, one point light cube face
+#define SHADOW_CASCADE_SIZE 1024
+#define SHADOW_ATLAS_TEXTURE_UNIT 7 // Bound once per frame, layout(binding) of uShadowAtlas
+
+/**
+ * Creates both atlases, the framebuffer rendering into them and loads the SHADOW_DEPTH programs.
+ */
+void InitShadowAtlas(App* app);
+
+/**
+ * Allocates the views of the shadowed lights, re-renders the static casters of the views that
+ * changed, composites the dynamic casters and uploads the views for the lit programs. Fills
+ * App::lightShadowViews. Called once per frame from Update(), before UpdateClusteredLighting().
+ */
+void UpdateShadowAtlas(App* app);
@@ -0,0 +1,160 @@
+#include "texture_atlas.h"
+#include "texture_processing.h"
+
+// ImGui compiles its own copy of the packer as static, so this file gets its own one too
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <imstb_rectpack.h>
+
+struct AtlasEntry
+{
+    u32             textureIdx;
+    ivec2           size;
+    ivec2           paddedSize;   // Whole blocks
+    std::vector<u8> paddedPixels; // RGBA, including the padding
+};
+
+bool IsAtlasCandidate(const Texture& texture)
+{
+    return texture.usage == TextureUsage_Color && glm::max(texture.size.x, texture.size.y) <= ATLAS_MAX_TEXTURE_SIZE;
+}
+
+static bool PackAtlasEntries(std::vector<stbrp_rect>& rects, i32 atlasBlocks)
+{
+    std::vector<stbrp_node> nodes(atlasBlocks);
+    stbrp_context context;
+    stbrp_init_target(&context, atlasBlocks, atlasBlocks, nodes.data(), (int)nodes.size());
+    return stbrp_pack_rects(&context, rects.data(), (int)rects.size()) == 1;
+}
+
+static void PadEntry(const Image& image, AtlasEntry& entry)
+{
+    entry.size = image.size;
+    entry.paddedSize = (image.size + 2 * ATLAS_PADDING + ATLAS_BLOCK_SIZE - 1) / ATLAS_BLOCK_SIZE * ATLAS_BLOCK_SIZE;
+    entry.paddedPixels.resize(entry.paddedSize.x * entry.paddedSize.y * 4);
+
+    // The padding repeats the edge texels, like GL_CLAMP_TO_EDGE would
+    for (i32 y = 0; y < entry.paddedSize.y; ++y)
+    {
+        i32 srcY = glm::clamp(y - ATLAS_PADDING, 0, image.size.y - 1);
+        for (i32 x = 0; x < entry.paddedSize.x; ++x)
+        {
+            i32 srcX = glm::clamp(x - ATLAS_PADDING, 0, image.size.x - 1);
+            const u8* src = (const u8*)image.pixels + srcY * image.stride + srcX * image.nchannels;
+            u8* dst = &entry.paddedPixels[(y * entry.paddedSize.x + x) * 4];
+
+            dst[0] = src[0];
+            dst[1] = image.nchannels >= 3 ? src[1] : src[0];
+            dst[2] = image.nchannels >= 3 ? src[2] : src[0];
+            dst[3] = image.nchannels == 4 ? src[3] : 255;
+        }
+    }
+}
+
+void BuildTextureAtlas(App* app)
+{
+    app->textureAtlasDirty = false;
+
+    std::vector<AtlasEntry> entries;
+    std::vector<stbrp_rect> rects;
+
+    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
+    {
+        Texture& texture = app->textures[texIdx];
+        texture.inAtlas = false;
+        if (!IsAtlasCandidate(texture))
+            continue;
+
+        // Small enough that decoding the source again is cheaper than unpacking blocks
+        Image image = LoadImage(texture.filepath.c_str());
+        if (!image.pixels)
+            continue;
+
+        AtlasEntry entry = {};
+        entry.textureIdx = texIdx;
+        PadEntry(image, entry);
+        FreeImage(image);
+
+        // Packed in blocks so every entry starts and ends on a texel of each mip
+        stbrp_rect rect = {};
+        rect.id = (int)entries.size();
+        rect.w = entry.paddedSize.x / ATLAS_BLOCK_SIZE;
+        rect.h = entry.paddedSize.y / ATLAS_BLOCK_SIZE;
+        rects.push_back(rect);
+        entries.push_back(std::move(entry));
+    }
+
+    if (entries.size() < 2)
+    {
+        // A single texture gains nothing from the atlas, and a previous one would be stale
+        if (app->textureAtlasHandle)
+            glDeleteTextures(1, &app->textureAtlasHandle);
+        app->textureAtlasHandle = 0;
+        for (Material& material : app->materials)
+            material.albedoUvTransform = vec4(1.0f, 1.0f, 0.0f, 0.0f);
+        return;
+    }
+
+    i32 atlasSize = ATLAS_MAX_TEXTURE_SIZE;
+    while (!PackAtlasEntries(rects, atlasSize / ATLAS_BLOCK_SIZE) && atlasSize < ATLAS_MAX_SIZE)
+        atlasSize *= 2;
+
+    std::vector<std::vector<u8>> atlasLevels(ATLAS_MIP_COUNT);
+    for (u32 mip = 0; mip < ATLAS_MIP_COUNT; ++mip)
+        atlasLevels[mip].resize((atlasSize >> mip) * (atlasSize >> mip) * 4, 0);
+
+    u32 packedCount = 0;
+    for (const stbrp_rect& rect : rects)
+    {
+        AtlasEntry& entry = entries[rect.id];
+        if (!rect.was_packed)
+            continue;
+
+        // Each entry gets its own chain (sRGB correct, alpha coverage kept) so the padding
+        // of every level comes from the entry alone and halves with the level size
+        Image padded = { entry.paddedPixels.data(), entry.paddedSize, 4, entry.paddedSize.x * 4 };
+        MipChain chain = GenerateMipChain(padded, TextureUsage_Color, app->textureMipFilter);
+
+        for (u32 mip = 0; mip < ATLAS_MIP_COUNT; ++mip)
+        {
+            const MipLevel& level = chain.levels[mip];
+            const i32 levelAtlasSize = atlasSize >> mip;
+            const ivec2 origin = ivec2(rect.x, rect.y) * (ATLAS_BLOCK_SIZE >> mip);
+            for (i32 y = 0; y < level.size.y; ++y)
+                memcpy(&atlasLevels[mip][((origin.y + y) * levelAtlasSize + origin.x) * 4],
+                       &chain.data[level.offset + y * level.size.x * 4], level.size.x * 4);
+        }
+
+        Texture& texture = app->textures[entry.textureIdx];
+        texture.inAtlas = true;
+        texture.atlasUvTransform = vec4((f32)entry.size.x / atlasSize,
+                                        (f32)entry.size.y / atlasSize,
+                                        (f32)(rect.x * ATLAS_BLOCK_SIZE + ATLAS_PADDING) / atlasSize,
+                                        (f32)(rect.y * ATLAS_BLOCK_SIZE + ATLAS_PADDING) / atlasSize);
+        packedCount++;
+    }
+
+    if (app->textureAtlasHandle)
+        glDeleteTextures(1, &app->textureAtlasHandle);
+
+    glGenTextures(1, &app->textureAtlasHandle);
+    glBindTexture(GL_TEXTURE_2D, app->textureAtlasHandle);
+    for (u32 mip = 0; mip < ATLAS_MIP_COUNT; ++mip)
+        glTexImage2D(GL_TEXTURE_2D, mip, GL_RGBA8, atlasSize >> mip, atlasSize >> mip, 0, GL_RGBA, GL_UNSIGNED_BYTE, atlasLevels[mip].data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ATLAS_MIP_COUNT - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    for (Material& material : app->materials)
+    {
+        if (material.albedoTextureIdx < app->textures.size() && app->textures[material.albedoTextureIdx].inAtlas)
+            material.albedoUvTransform = app->textures[material.albedoTextureIdx].atlasUvTransform;
+        else
+            material.albedoUvTransform = vec4(1.0f, 1.0f, 0.0f, 0.0f);
+    }
+
+    ILOG("Texture atlas built: %u textures in %dx%d, %u mips", packedCount, atlasSize, atlasSize, ATLAS_MIP_COUNT);
+}
@@ -0,0 +1,32 @@
+//
+// texture_atlas.h: Packs the small textures (solid colors, tiny masks...) into a single atlas
+// with the rect packer bundled with ImGui, so draws using them share one texture binding.
+//
+
+#pragma once
+
+#include "engine.h"
+
+// Color textures whose largest side is at most this size go to the atlas
+#define ATLAS_MAX_TEXTURE_SIZE 64
+#define ATLAS_MIP_COUNT 4
+// Entries are placed and sized in blocks of this many texels, so every mip of an entry
+// covers whole texels and never shares one with a neighbour
+#define ATLAS_BLOCK_SIZE (1 << (ATLAS_MIP_COUNT - 1))
+// Texels replicated around each entry on the base level. Halves with every mip, leaving
+// one texel on the smallest so bilinear filtering never reads a neighbour
+#define ATLAS_PADDING ATLAS_BLOCK_SIZE
+#define ATLAS_MAX_SIZE 2048
+
+/**
+ * True for the textures the atlas takes: small color ones. Normal and linear maps keep
+ * their own textures, the atlas only stands in for albedo lookups.
+ */
+bool IsAtlasCandidate(const Texture& texture);
+
+/**
+ * Packs every small color texture loaded so far into App::textureAtlasHandle, replacing
+ * the previous atlas, and updates the uv transform of the materials whose albedo ended up
+ * in it. Clears App::textureAtlasDirty.
+ */
+void BuildTextureAtlas(App* app);
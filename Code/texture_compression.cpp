@@ -0,0 +1,717 @@
+//
+// texture_compression.cpp: Block compression encoders.
+// BC1 color blocks and BC4 channel blocks (used by BC3 alpha and both BC5 channels) follow the
+// S3TC/RGTC specs. The BC7 encoder only emits mode 6 (one subset, RGBA endpoints with p-bits
+// and 4 bit indices), which is the mode that covers most smooth content well and keeps the
+// encoder small. The palette search runs on four texels at a time with SSE2.
+//
+
+#include "texture_compression.h"
+#include "job_system.h"
+
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#define BLOCK_ROWS_PER_JOB 4
+
+// Source block with texels as floats in [0, 255], channels separated so four texels load at once
+struct BlockTexels
+{
+    alignas(16) f32 channel[4][16];
+};
+
+struct BlockEndpoints
+{
+    f32 e0[4];
+    f32 e1[4];
+};
+
+static const u32 BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static u32 GetBlockSize(BlockFormat format)
+{
+    return format == BlockFormat_BC1 ? 8 : 16;
+}
+
+static void FetchBlock(const MipChain& chain, const MipLevel& level, i32 blockX, i32 blockY, BlockTexels& block)
+{
+    const i32 n = chain.nchannels;
+    const u8* pixels = &chain.data[level.offset];
+
+    for (i32 y = 0; y < 4; ++y)
+    {
+        // Blocks that overhang the level repeat the edge texels
+        i32 sy = glm::min(blockY * 4 + y, level.size.y - 1);
+        for (i32 x = 0; x < 4; ++x)
+        {
+            i32 sx = glm::min(blockX * 4 + x, level.size.x - 1);
+            const u8* texel = pixels + (sy * level.size.x + sx) * n;
+            const i32 i = y * 4 + x;
+
+            block.channel[0][i] = texel[0];
+            block.channel[1][i] = n >= 3 ? texel[1] : texel[0];
+            block.channel[2][i] = n >= 3 ? texel[2] : texel[0];
+            block.channel[3][i] = n == 4 ? texel[3] : (n == 2 ? texel[1] : 255.0f);
+        }
+    }
+}
+
+// Returns the squared error of the chosen entries. Channels with a zero mask are ignored.
+static f32 FindClosestPaletteEntries(const BlockTexels& block, const f32 (*palette)[4], u32 paletteCount, const f32 channelMask[4], u8 indices[16])
+{
+    __m128 totalError = _mm_setzero_ps();
+
+    for (u32 group = 0; group < 16; group += 4)
+    {
+        __m128 texel[4];
+        for (u32 c = 0; c < 4; ++c)
+            texel[c] = _mm_load_ps(&block.channel[c][group]);
+
+        __m128 bestError = _mm_set1_ps(FLT_MAX);
+        __m128 bestIndex = _mm_setzero_ps();
+
+        for (u32 p = 0; p < paletteCount; ++p)
+        {
+            __m128 error = _mm_setzero_ps();
+            for (u32 c = 0; c < 4; ++c)
+            {
+                __m128 diff = _mm_sub_ps(texel[c], _mm_set1_ps(palette[p][c]));
+                error = _mm_add_ps(error, _mm_mul_ps(_mm_mul_ps(diff, diff), _mm_set1_ps(channelMask[c])));
+            }
+
+            __m128 isBetter = _mm_cmplt_ps(error, bestError);
+            bestError = _mm_min_ps(error, bestError);
+            bestIndex = _mm_or_ps(_mm_and_ps(isBetter, _mm_set1_ps((f32)p)), _mm_andnot_ps(isBetter, bestIndex));
+        }
+
+        alignas(16) f32 groupIndices[4];
+        _mm_store_ps(groupIndices, bestIndex);
+        for (u32 i = 0; i < 4; ++i)
+            indices[group + i] = (u8)groupIndices[i];
+
+        totalError = _mm_add_ps(totalError, bestError);
+    }
+
+    alignas(16) f32 errors[4];
+    _mm_store_ps(errors, totalError);
+    return errors[0] + errors[1] + errors[2] + errors[3];
+}
+
+// Endpoints along the direction of maximum variance (or the bounding box diagonal in fast mode)
+static BlockEndpoints ComputeEndpoints(const BlockTexels& block, u32 channelCount, CompressionQuality quality)
+{
+    f32 mean[4] = {}, minValue[4], maxValue[4];
+    for (u32 c = 0; c < channelCount; ++c)
+    {
+        minValue[c] = 255.0f; maxValue[c] = 0.0f;
+        for (u32 i = 0; i < 16; ++i)
+        {
+            mean[c] += block.channel[c][i];
+            minValue[c] = glm::min(minValue[c], block.channel[c][i]);
+            maxValue[c] = glm::max(maxValue[c], block.channel[c][i]);
+        }
+        mean[c] /= 16.0f;
+    }
+
+    f32 axis[4] = {};
+    for (u32 c = 0; c < channelCount; ++c)
+        axis[c] = maxValue[c] - minValue[c];
+
+    if (quality != CompressionQuality_Fast)
+    {
+        f32 covariance[4][4] = {};
+        for (u32 i = 0; i < 16; ++i)
+            for (u32 a = 0; a < channelCount; ++a)
+                for (u32 b = 0; b < channelCount; ++b)
+                    covariance[a][b] += (block.channel[a][i] - mean[a]) * (block.channel[b][i] - mean[b]);
+
+        // Power iteration starting from the bounding box diagonal
+        for (u32 iteration = 0; iteration < 8; ++iteration)
+        {
+            f32 next[4] = {};
+            f32 largest = 0.0f;
+            for (u32 a = 0; a < channelCount; ++a)
+            {
+                for (u32 b = 0; b < channelCount; ++b)
+                    next[a] += covariance[a][b] * axis[b];
+                largest = glm::max(largest, fabsf(next[a]));
+            }
+            if (largest < 1e-6f)
+                break;
+            for (u32 a = 0; a < channelCount; ++a)
+                axis[a] = next[a] / largest;
+        }
+    }
+
+    f32 axisLengthSq = 0.0f;
+    for (u32 c = 0; c < channelCount; ++c)
+        axisLengthSq += axis[c] * axis[c];
+
+    BlockEndpoints endpoints = {};
+    if (axisLengthSq < 1e-6f)
+    {
+        for (u32 c = 0; c < channelCount; ++c)
+            endpoints.e0[c] = endpoints.e1[c] = mean[c];
+        return endpoints;
+    }
+
+    f32 minT = FLT_MAX, maxT = -FLT_MAX;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        f32 t = 0.0f;
+        for (u32 c = 0; c < channelCount; ++c)
+            t += (block.channel[c][i] - mean[c]) * axis[c];
+        t /= axisLengthSq;
+        minT = glm::min(minT, t);
+        maxT = glm::max(maxT, t);
+    }
+
+    for (u32 c = 0; c < channelCount; ++c)
+    {
+        endpoints.e0[c] = glm::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+        endpoints.e1[c] = glm::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+    }
+    return endpoints;
+}
+
+// Least squares fit of both endpoints given each texel weight towards e1
+static bool RefineEndpoints(const BlockTexels& block, const f32 weights[16], u32 channelCount, BlockEndpoints& endpoints)
+{
+    f32 aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    f32 ax[4] = {}, bx[4] = {};
+    for (u32 i = 0; i < 16; ++i)
+    {
+        f32 b = weights[i];
+        f32 a = 1.0f - b;
+        aa += a * a; bb += b * b; ab += a * b;
+        for (u32 c = 0; c < channelCount; ++c)
+        {
+            ax[c] += a * block.channel[c][i];
+            bx[c] += b * block.channel[c][i];
+        }
+    }
+
+    f32 det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f)
+        return false;
+
+    for (u32 c = 0; c < channelCount; ++c)
+    {
+        endpoints.e0[c] = glm::clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+        endpoints.e1[c] = glm::clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+static u32 GetRefinementPasses(CompressionQuality quality)
+{
+    switch (quality)
+    {
+        case CompressionQuality_Fast:   return 0;
+        case CompressionQuality_Normal: return 1;
+        default:                        return 3;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// BC1
+
+static u16 PackRGB565(const f32 color[4])
+{
+    u32 r = (u32)(color[0] * 31.0f / 255.0f + 0.5f);
+    u32 g = (u32)(color[1] * 63.0f / 255.0f + 0.5f);
+    u32 b = (u32)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(u16 packed, f32 color[4])
+{
+    u32 r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (f32)((r << 3) | (r >> 2));
+    color[1] = (f32)((g << 2) | (g >> 4));
+    color[2] = (f32)((b << 3) | (b >> 2));
+    color[3] = 255.0f;
+}
+
+static void BuildBC1Palette(u16 c0, u16 c1, f32 palette[4][4])
+{
+    UnpackRGB565(c0, palette[0]);
+    UnpackRGB565(c1, palette[1]);
+    for (u32 c = 0; c < 4; ++c)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+}
+
+static void EncodeBC1Block(const BlockTexels& block, CompressionQuality quality, u8* out)
+{
+    static const f32 rgbMask[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+    static const f32 indexWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    BlockEndpoints endpoints = ComputeEndpoints(block, 3, quality);
+
+    u16 bestC0 = PackRGB565(endpoints.e0), bestC1 = PackRGB565(endpoints.e1);
+    u8 bestIndices[16];
+    f32 palette[4][4];
+    BuildBC1Palette(bestC0, bestC1, palette);
+    f32 bestError = FindClosestPaletteEntries(block, palette, 4, rgbMask, bestIndices);
+
+    for (u32 pass = 0; pass < GetRefinementPasses(quality); ++pass)
+    {
+        f32 weights[16];
+        for (u32 i = 0; i < 16; ++i)
+            weights[i] = indexWeights[bestIndices[i]];
+        if (!RefineEndpoints(block, weights, 3, endpoints))
+            break;
+
+        u16 c0 = PackRGB565(endpoints.e0), c1 = PackRGB565(endpoints.e1);
+        u8 indices[16];
+        BuildBC1Palette(c0, c1, palette);
+        f32 error = FindClosestPaletteEntries(block, palette, 4, rgbMask, indices);
+        if (error >= bestError)
+            break;
+
+        bestError = error; bestC0 = c0; bestC1 = c1;
+        memcpy(bestIndices, indices, sizeof(indices));
+    }
+
+    // Four color mode requires c0 > c1
+    if (bestC0 < bestC1)
+    {
+        std::swap(bestC0, bestC1);
+        for (u32 i = 0; i < 16; ++i)
+            bestIndices[i] ^= 1; // 0<->1, 2<->3
+    }
+    else if (bestC0 == bestC1)
+    {
+        memset(bestIndices, 0, sizeof(bestIndices));
+    }
+
+    u32 packedIndices = 0;
+    for (u32 i = 0; i < 16; ++i)
+        packedIndices |= (u32)bestIndices[i] << (2 * i);
+
+    memcpy(out + 0, &bestC0, 2);
+    memcpy(out + 2, &bestC1, 2);
+    memcpy(out + 4, &packedIndices, 4);
+}
+
+static void DecodeBC1Block(const u8* in, u8 texels[16][4])
+{
+    u16 c0, c1;
+    u32 packedIndices;
+    memcpy(&c0, in + 0, 2);
+    memcpy(&c1, in + 2, 2);
+    memcpy(&packedIndices, in + 4, 4);
+
+    f32 palette[4][4];
+    BuildBC1Palette(c0, c1, palette);
+    if (c0 <= c1)
+    {
+        for (u32 c = 0; c < 3; ++c)
+            palette[2][c] = (palette[0][c] + palette[1][c]) * 0.5f;
+        palette[3][0] = palette[3][1] = palette[3][2] = palette[3][3] = 0.0f;
+    }
+
+    for (u32 i = 0; i < 16; ++i)
+        for (u32 c = 0; c < 4; ++c)
+            texels[i][c] = (u8)(palette[(packedIndices >> (2 * i)) & 3][c] + 0.5f);
+}
+
+///////////////////////////////////////////////////////////////////////
+// BC4 (single channel, used for the BC3 alpha and the two BC5 channels)
+
+static void EncodeBC4Block(const f32 values[16], u8* out)
+{
+    f32 minValue = 255.0f, maxValue = 0.0f;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        minValue = glm::min(minValue, values[i]);
+        maxValue = glm::max(maxValue, values[i]);
+    }
+
+    u8 a0 = (u8)(maxValue + 0.5f);
+    u8 a1 = (u8)(minValue + 0.5f);
+
+    u64 packedIndices = 0;
+    if (a0 > a1)
+    {
+        // Eight value mode: index 0 is a0, 1 is a1 and 2..7 interpolate from a0 to a1
+        const f32 range = (f32)(a0 - a1);
+        for (u32 i = 0; i < 16; ++i)
+        {
+            u32 step = (u32)glm::clamp((values[i] - a1) * 7.0f / range + 0.5f, 0.0f, 7.0f);
+            u64 index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+            packedIndices |= index << (3 * i);
+        }
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (u32 i = 0; i < 6; ++i)
+        out[2 + i] = (u8)(packedIndices >> (8 * i));
+}
+
+static void DecodeBC4Block(const u8* in, u8 values[16])
+{
+    f32 palette[8];
+    palette[0] = in[0];
+    palette[1] = in[1];
+    if (in[0] > in[1])
+    {
+        for (u32 i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7.0f;
+    }
+    else
+    {
+        for (u32 i = 1; i < 5; ++i)
+            palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5.0f;
+        palette[6] = 0.0f;
+        palette[7] = 255.0f;
+    }
+
+    u64 packedIndices = 0;
+    for (u32 i = 0; i < 6; ++i)
+        packedIndices |= (u64)in[2 + i] << (8 * i);
+
+    for (u32 i = 0; i < 16; ++i)
+        values[i] = (u8)(palette[(packedIndices >> (3 * i)) & 7] + 0.5f);
+}
+
+///////////////////////////////////////////////////////////////////////
+// BC7 (mode 6 only)
+
+struct BitWriter
+{
+    u64 bits[2] = {};
+    u32 position = 0;
+
+    void Write(u32 value, u32 count)
+    {
+        for (u32 i = 0; i < count; ++i, ++position)
+            bits[position / 64] |= (u64)((value >> i) & 1) << (position % 64);
+    }
+};
+
+struct BitReader
+{
+    u64 bits[2];
+    u32 position = 0;
+
+    u32 Read(u32 count)
+    {
+        u32 value = 0;
+        for (u32 i = 0; i < count; ++i, ++position)
+            value |= (u32)((bits[position / 64] >> (position % 64)) & 1) << i;
+        return value;
+    }
+};
+
+// Endpoint channels stored as 7 bits plus a p-bit shared by the four channels of the endpoint
+static void QuantizeBC7Endpoint(const f32 endpoint[4], u32 quantized[4], u32& pbit)
+{
+    f32 bestError = FLT_MAX;
+    for (u32 p = 0; p < 2; ++p)
+    {
+        u32 candidate[4];
+        f32 error = 0.0f;
+        for (u32 c = 0; c < 4; ++c)
+        {
+            candidate[c] = (u32)glm::clamp((endpoint[c] - p) * 0.5f + 0.5f, 0.0f, 127.0f);
+            f32 diff = (f32)((candidate[c] << 1) | p) - endpoint[c];
+            error += diff * diff;
+        }
+        if (error < bestError)
+        {
+            bestError = error;
+            pbit = p;
+            memcpy(quantized, candidate, sizeof(candidate));
+        }
+    }
+}
+
+static void BuildBC7Palette(const u32 q0[4], u32 p0, const u32 q1[4], u32 p1, f32 palette[16][4])
+{
+    for (u32 c = 0; c < 4; ++c)
+    {
+        u32 e0 = (q0[c] << 1) | p0;
+        u32 e1 = (q1[c] << 1) | p1;
+        for (u32 i = 0; i < 16; ++i)
+            palette[i][c] = (f32)(((64 - BC7Weights4[i]) * e0 + BC7Weights4[i] * e1 + 32) >> 6);
+    }
+}
+
+static void EncodeBC7Block(const BlockTexels& block, CompressionQuality quality, u8* out)
+{
+    static const f32 rgbaMask[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    BlockEndpoints endpoints = ComputeEndpoints(block, 4, quality);
+
+    u32 bestQ0[4], bestQ1[4], bestP0, bestP1;
+    QuantizeBC7Endpoint(endpoints.e0, bestQ0, bestP0);
+    QuantizeBC7Endpoint(endpoints.e1, bestQ1, bestP1);
+
+    f32 palette[16][4];
+    u8 bestIndices[16];
+    BuildBC7Palette(bestQ0, bestP0, bestQ1, bestP1, palette);
+    f32 bestError = FindClosestPaletteEntries(block, palette, 16, rgbaMask, bestIndices);
+
+    for (u32 pass = 0; pass < GetRefinementPasses(quality); ++pass)
+    {
+        f32 weights[16];
+        for (u32 i = 0; i < 16; ++i)
+            weights[i] = BC7Weights4[bestIndices[i]] / 64.0f;
+        if (!RefineEndpoints(block, weights, 4, endpoints))
+            break;
+
+        u32 q0[4], q1[4], p0, p1;
+        u8 indices[16];
+        QuantizeBC7Endpoint(endpoints.e0, q0, p0);
+        QuantizeBC7Endpoint(endpoints.e1, q1, p1);
+        BuildBC7Palette(q0, p0, q1, p1, palette);
+        f32 error = FindClosestPaletteEntries(block, palette, 16, rgbaMask, indices);
+        if (error >= bestError)
+            break;
+
+        bestError = error; bestP0 = p0; bestP1 = p1;
+        memcpy(bestQ0, q0, sizeof(q0));
+        memcpy(bestQ1, q1, sizeof(q1));
+        memcpy(bestIndices, indices, sizeof(indices));
+    }
+
+    // The anchor (first) index is stored with 3 bits, so its top bit must be 0
+    if (bestIndices[0] & 8)
+    {
+        u32 q[4];
+        memcpy(q, bestQ0, sizeof(q));
+        memcpy(bestQ0, bestQ1, sizeof(q));
+        memcpy(bestQ1, q, sizeof(q));
+        std::swap(bestP0, bestP1);
+        for (u32 i = 0; i < 16; ++i)
+            bestIndices[i] = 15 - bestIndices[i];
+    }
+
+    BitWriter writer;
+    writer.Write(1 << 6, 7); // Mode 6
+    for (u32 c = 0; c < 4; ++c)
+    {
+        writer.Write(bestQ0[c], 7);
+        writer.Write(bestQ1[c], 7);
+    }
+    writer.Write(bestP0, 1);
+    writer.Write(bestP1, 1);
+    for (u32 i = 0; i < 16; ++i)
+        writer.Write(bestIndices[i], i == 0 ? 3 : 4);
+
+    memcpy(out, writer.bits, 16);
+}
+
+static void DecodeBC7Block(const u8* in, u8 texels[16][4])
+{
+    BitReader reader;
+    memcpy(reader.bits, in, 16);
+
+    if (reader.Read(7) != (1 << 6))
+    {
+        memset(texels, 0, 16 * 4); // Only mode 6 is produced by the encoder
+        return;
+    }
+
+    u32 q0[4], q1[4];
+    for (u32 c = 0; c < 4; ++c)
+    {
+        q0[c] = reader.Read(7);
+        q1[c] = reader.Read(7);
+    }
+    u32 p0 = reader.Read(1);
+    u32 p1 = reader.Read(1);
+
+    f32 palette[16][4];
+    BuildBC7Palette(q0, p0, q1, p1, palette);
+    for (u32 i = 0; i < 16; ++i)
+    {
+        u32 index = reader.Read(i == 0 ? 3 : 4);
+        for (u32 c = 0; c < 4; ++c)
+            texels[i][c] = (u8)palette[index][c];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+static void EncodeBlock(const BlockTexels& block, BlockFormat format, CompressionQuality quality, u8* out)
+{
+    switch (format)
+    {
+        case BlockFormat_BC1: EncodeBC1Block(block, quality, out); break;
+        case BlockFormat_BC3: EncodeBC4Block(block.channel[3], out); EncodeBC1Block(block, quality, out + 8); break;
+        case BlockFormat_BC5: EncodeBC4Block(block.channel[0], out); EncodeBC4Block(block.channel[1], out + 8); break;
+        case BlockFormat_BC7: EncodeBC7Block(block, quality, out); break;
+        default: ELOG("EncodeBlock() - Unsupported block format");
+    }
+}
+
+static void DecodeBlock(const u8* in, BlockFormat format, u8 texels[16][4])
+{
+    switch (format)
+    {
+        case BlockFormat_BC1: DecodeBC1Block(in, texels); break;
+        case BlockFormat_BC3:
+        {
+            u8 alpha[16];
+            DecodeBC1Block(in + 8, texels);
+            DecodeBC4Block(in, alpha);
+            for (u32 i = 0; i < 16; ++i) texels[i][3] = alpha[i];
+            break;
+        }
+        case BlockFormat_BC5:
+        {
+            u8 red[16], green[16];
+            DecodeBC4Block(in, red);
+            DecodeBC4Block(in + 8, green);
+            for (u32 i = 0; i < 16; ++i)
+            {
+                texels[i][0] = red[i]; texels[i][1] = green[i]; texels[i][2] = 0; texels[i][3] = 255;
+            }
+            break;
+        }
+        case BlockFormat_BC7: DecodeBC7Block(in, texels); break;
+        default: memset(texels, 0, 16 * 4);
+    }
+}
+
+static f32 ComputeLevelPSNR(const MipChain& chain, const CompressedTexture& texture, BlockFormat format)
+{
+    const MipLevel& sourceLevel = chain.levels[0];
+    const MipLevel& compressedLevel = texture.levels[0];
+    const u32 blocksX = (sourceLevel.size.x + 3) / 4;
+    const u32 blocksY = (sourceLevel.size.y + 3) / 4;
+    const u32 blockSize = GetBlockSize(format);
+    const u32 channelCount = format == BlockFormat_BC5 ? 2 : (format == BlockFormat_BC1 ? 3 : 4);
+
+    f64 squaredError = 0.0;
+    u64 sampleCount = 0;
+    for (u32 by = 0; by < blocksY; ++by)
+    {
+        for (u32 bx = 0; bx < blocksX; ++bx)
+        {
+            BlockTexels source;
+            u8 decoded[16][4];
+            FetchBlock(chain, sourceLevel, bx, by, source);
+            DecodeBlock(&texture.data[compressedLevel.offset + (by * blocksX + bx) * blockSize], format, decoded);
+
+            for (u32 i = 0; i < 16; ++i)
+            {
+                if (bx * 4 + i % 4 >= (u32)sourceLevel.size.x || by * 4 + i / 4 >= (u32)sourceLevel.size.y)
+                    continue;
+                for (u32 c = 0; c < channelCount; ++c)
+                {
+                    f64 diff = (f64)source.channel[c][i] - (f64)decoded[i][c];
+                    squaredError += diff * diff;
+                }
+                sampleCount += channelCount;
+            }
+        }
+    }
+
+    f64 mse = squaredError / (f64)glm::max(sampleCount, (u64)1);
+    return mse > 0.0 ? (f32)(10.0 * log10(255.0 * 255.0 / mse)) : 99.0f;
+}
+
+BlockFormat ChooseBlockFormat(const MipChain& chain, TextureUsage usage, CompressionQuality quality)
+{
+    if (chain.nchannels < 3)
+        return BlockFormat_None;
+
+    if (usage == TextureUsage_Normal)
+        return BlockFormat_BC5;
+
+    bool usesAlpha = false;
+    if (chain.nchannels == 4)
+    {
+        const MipLevel& level = chain.levels[0];
+        for (u32 i = 3; i < level.dataSize && !usesAlpha; i += 4)
+            usesAlpha = chain.data[level.offset + i] != 255;
+    }
+
+    // With only mode 6 available, BC7 loses against BC3 on textures with alpha (endpoints are shared with color)
+    if (usesAlpha)
+        return BlockFormat_BC3;
+
+    return quality == CompressionQuality_High ? BlockFormat_BC7 : BlockFormat_BC1;
+}
+
+CompressedTexture CompressMipChain(const MipChain& chain, BlockFormat format, CompressionQuality quality)
+{
+    CompressedTexture texture = {};
+    texture.format = format;
+
+    const u32 blockSize = GetBlockSize(format);
+    u32 totalSize = 0;
+    for (const MipLevel& level : chain.levels)
+    {
+        MipLevel compressedLevel = {};
+        compressedLevel.size = level.size;
+        compressedLevel.offset = totalSize;
+        compressedLevel.dataSize = ((level.size.x + 3) / 4) * ((level.size.y + 3) / 4) * blockSize;
+        texture.levels.push_back(compressedLevel);
+        totalSize += compressedLevel.dataSize;
+    }
+    texture.data.resize(totalSize);
+
+    for (u32 levelIdx = 0; levelIdx < chain.levels.size(); ++levelIdx)
+    {
+        const MipLevel& level = chain.levels[levelIdx];
+        const u32 blocksX = (level.size.x + 3) / 4;
+        const u32 blocksY = (level.size.y + 3) / 4;
+        u8* levelBlocks = &texture.data[texture.levels[levelIdx].offset];
+
+        ParallelFor(blocksY, BLOCK_ROWS_PER_JOB, [&](u32 rowBegin, u32 rowEnd) {
+            for (u32 by = rowBegin; by < rowEnd; ++by)
+            {
+                for (u32 bx = 0; bx < blocksX; ++bx)
+                {
+                    BlockTexels block;
+                    FetchBlock(chain, level, bx, by, block);
+                    EncodeBlock(block, format, quality, levelBlocks + (by * blocksX + bx) * blockSize);
+                }
+            }
+        });
+    }
+
+    texture.psnr = ComputeLevelPSNR(chain, texture, format);
+
+    return texture;
+}
+
+GLenum GetBlockFormatInternalFormat(BlockFormat format)
+{
+    switch (format)
+    {
+        case BlockFormat_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BlockFormat_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default:              return GL_NONE;
+    }
+}
+
+const char* GetBlockFormatName(BlockFormat format)
+{
+    switch (format)
+    {
+        case BlockFormat_BC1: return "BC1";
+        case BlockFormat_BC3: return "BC3";
+        case BlockFormat_BC5: return "BC5";
+        case BlockFormat_BC7: return "BC7";
+        default:              return "Uncompressed";
+    }
+}
@@ -0,0 +1,30 @@
+//
+// texture_compression.h: Import time block compression (BC1/BC3/BC5/BC7) of mip chains.
+//
+
+#pragma once
+
+#include "texture_processing.h"
+
+struct CompressedTexture
+{
+    BlockFormat           format;
+    std::vector<u8>       data;   // Blocks of every level, level 0 first, blocks in row order
+    std::vector<MipLevel> levels; // Size of the level in texels, offset/size of its blocks in data
+    f32                   psnr;   // Of the top level against the source, in dB
+};
+
+/**
+ * Picks the block format from the channels the texture actually uses: normal maps go to
+ * BC5, opaque textures to BC1 (BC7 on high quality) and textures with alpha to BC3.
+ */
+BlockFormat ChooseBlockFormat(const MipChain& chain, TextureUsage usage, CompressionQuality quality);
+
+/**
+ * Encodes every level of the chain. Block rows are encoded in parallel with the job system.
+ */
+CompressedTexture CompressMipChain(const MipChain& chain, BlockFormat format, CompressionQuality quality);
+
+GLenum GetBlockFormatInternalFormat(BlockFormat format);
+
+const char* GetBlockFormatName(BlockFormat format);
@@ -0,0 +1,121 @@
+#include "texture_container.h"
+
+#define TEXTURE_CONTAINER_PAYLOAD_ALIGNMENT 16
+
+std::string GetTextureContainerPath(const char* sourcePath, TextureUsage usage)
+{
+    static const char* usageSuffixes[] = { "", ".normal", ".linear" }; // By TextureUsage
+
+    std::string path = sourcePath;
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        path.erase(dot);
+    return path + usageSuffixes[usage] + ".btex";
+}
+
+u32 GetTextureCookSettings(bool compress, CompressionQuality quality, MipFilter filter)
+{
+    // Low byte: 0 uncompressed, 1 + quality compressed. Above it the mip filter, Box being 0
+    return (compress ? 1u + (u32)quality : 0u) | (u32)filter << 8;
+}
+
+bool OpenTextureContainer(const char* containerPath, u64 sourceTimestamp, u32 cookSettings, TextureUsage usage, TextureContainer& container)
+{
+    container = {};
+    container.file = MapFile(containerPath);
+    if (!container.file.data)
+        return false;
+
+    const u8* bytes = (const u8*)container.file.data;
+    const TextureContainerHeader* header = (const TextureContainerHeader*)bytes;
+
+    bool isValid = container.file.size >= sizeof(TextureContainerHeader) &&
+                   header->magic == TEXTURE_CONTAINER_MAGIC &&
+                   header->version == TEXTURE_CONTAINER_VERSION &&
+                   header->sourceTimestamp == sourceTimestamp &&
+                   header->cookSettings == cookSettings &&
+                   header->usage == (u32)usage &&
+                   header->mipCount > 0 &&
+                   header->payloadOffset <= container.file.size &&
+                   sizeof(TextureContainerHeader) + header->mipCount * sizeof(MipLevel) <= header->payloadOffset;
+
+    if (isValid)
+    {
+        container.header = header;
+        container.levels = (const MipLevel*)(bytes + sizeof(TextureContainerHeader));
+        container.payload = bytes + header->payloadOffset;
+
+        const u64 payloadSize = container.file.size - header->payloadOffset;
+        for (u32 i = 0; i < header->mipCount && isValid; ++i)
+            isValid = (u64)container.levels[i].offset + container.levels[i].dataSize <= payloadSize;
+    }
+
+    if (!isValid)
+        CloseTextureContainer(container);
+
+    return isValid;
+}
+
+void CloseTextureContainer(TextureContainer& container)
+{
+    UnmapFile(container.file);
+    container = {};
+}
+
+TextureContainer GetTextureContainerView(const MappedFile& file)
+{
+    const u8* bytes = (const u8*)file.data;
+
+    TextureContainer container = {};
+    container.file = file;
+    container.header = (const TextureContainerHeader*)bytes;
+    container.levels = (const MipLevel*)(bytes + sizeof(TextureContainerHeader));
+    container.payload = bytes + container.header->payloadOffset;
+    return container;
+}
+
+bool WriteTextureContainer(const char* containerPath, u64 sourceTimestamp, u32 cookSettings, TextureUsage usage,
+                           BlockFormat format, i32 nchannels, const std::vector<MipLevel>& levels, const u8* payload)
+{
+    FILE* file = fopen(containerPath, "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing texture container %s", containerPath);
+        return false;
+    }
+
+    u32 payloadSize = 0;
+    for (const MipLevel& level : levels)
+        payloadSize = glm::max(payloadSize, level.offset + level.dataSize);
+
+    TextureContainerHeader header = {};
+    header.magic = TEXTURE_CONTAINER_MAGIC;
+    header.version = TEXTURE_CONTAINER_VERSION;
+    header.sourceTimestamp = sourceTimestamp;
+    header.cookSettings = cookSettings;
+    header.usage = usage;
+    header.format = format;
+    header.nchannels = nchannels;
+    header.width = levels[0].size.x;
+    header.height = levels[0].size.y;
+    header.mipCount = (u32)levels.size();
+
+    u32 tableEnd = sizeof(header) + header.mipCount * sizeof(MipLevel);
+    header.payloadOffset = (tableEnd + TEXTURE_CONTAINER_PAYLOAD_ALIGNMENT - 1) & ~(TEXTURE_CONTAINER_PAYLOAD_ALIGNMENT - 1);
+
+    const u8 padding[TEXTURE_CONTAINER_PAYLOAD_ALIGNMENT] = {};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(levels.data(), sizeof(MipLevel), levels.size(), file) == levels.size() &&
+                   fwrite(padding, 1, header.payloadOffset - tableEnd, file) == header.payloadOffset - tableEnd &&
+                   fwrite(payload, 1, payloadSize, file) == payloadSize;
+
+    fclose(file);
+
+    if (!written)
+    {
+        ELOG("Could not write texture container %s", containerPath);
+        remove(containerPath);
+    }
+    return written;
+}
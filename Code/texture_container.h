@@ -0,0 +1,62 @@
+//
+// texture_container.h: Precooked texture files (.btex). They hold the final mip chain,
+// already block compressed if needed, so loading them is just mapping the file and
+// handing each level to GL.
+//
+// Layout: TextureContainerHeader, mipCount MipLevel entries (offsets relative to the
+// payload) and then the payload, starting at header.payloadOffset.
+//
+
+#pragma once
+
+#include "texture_processing.h"
+
+#define TEXTURE_CONTAINER_MAGIC   0x58455442 // "BTEX"
+#define TEXTURE_CONTAINER_VERSION 1
+
+struct TextureContainerHeader
+{
+    u32 magic;
+    u32 version;
+    u64 sourceTimestamp; // Last write time of the source image when this file was cooked
+    u32 cookSettings;    // Import settings the payload was cooked with (see GetTextureCookSettings)
+    u32 usage;           // TextureUsage
+    u32 format;          // BlockFormat
+    i32 nchannels;
+    i32 width;
+    i32 height;
+    u32 mipCount;
+    u32 payloadOffset;
+};
+
+struct TextureContainer
+{
+    MappedFile                    file;
+    const TextureContainerHeader* header;
+    const MipLevel*               levels;
+    const u8*                     payload;
+};
+
+/**
+ * Path of the container cooked from sourcePath for a usage. Each usage gets its own file, an
+ * image used both as color and as data is cooked (filtered, compressed) differently.
+ */
+std::string GetTextureContainerPath(const char* sourcePath, TextureUsage usage);
+
+u32 GetTextureCookSettings(bool compress, CompressionQuality quality, MipFilter filter);
+
+/**
+ * Maps a container and validates it against the source image timestamp, the current cook
+ * settings and the usage. Returns false (and leaves nothing mapped) when it has to be cooked again.
+ */
+bool OpenTextureContainer(const char* containerPath, u64 sourceTimestamp, u32 cookSettings, TextureUsage usage, TextureContainer& container);
+
+void CloseTextureContainer(TextureContainer& container);
+
+/**
+ * Container view of a file that was already validated by OpenTextureContainer.
+ */
+TextureContainer GetTextureContainerView(const MappedFile& file);
+
+bool WriteTextureContainer(const char* containerPath, u64 sourceTimestamp, u32 cookSettings, TextureUsage usage,
+                           BlockFormat format, i32 nchannels, const std::vector<MipLevel>& levels, const u8* payload);
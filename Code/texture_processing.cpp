@@ -0,0 +1,376 @@
+//
+// texture_processing.cpp: Mip chain generation on the CPU.
+// Every pixel is kept as an __m128 (RGBA as floats) while filtering so the kernels
+// work on the four channels at once with SSE2, which every x64 target supports.
+//
+
+#include "texture_processing.h"
+#include "job_system.h"
+
+#include <emmintrin.h>
+#include <math.h>
+
+#define MIP_ROWS_PER_JOB 16
+#define ALPHA_COVERAGE_REFERENCE 0.5f
+#define KAISER_FILTER_WIDTH 3.0f
+#define KAISER_FILTER_ALPHA 4.0f
+
+// Wrapped so the vector keeps the alignment, __m128 as a template argument loses its attributes
+struct FloatPixel
+{
+    __m128 rgba;
+};
+typedef std::vector<FloatPixel> FloatPixels;
+
+struct FilterKernel
+{
+    std::vector<u32> tapBegin;   // Per destination texel, first tap (dstCount + 1 entries)
+    std::vector<u32> tapIndex;   // Source texel of each tap (already clamped to the edge)
+    std::vector<f32> tapWeight;
+};
+
+static const f32* GetSrgbToLinearTable()
+{
+    static f32 table[256];
+    static bool initialized = [] {
+        for (u32 i = 0; i < 256; ++i)
+        {
+            f32 c = i / 255.0f;
+            table[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return true;
+    }();
+    (void)initialized;
+    return table;
+}
+
+#define LINEAR_TO_SRGB_TABLE_SIZE 4096
+
+static const u8* GetLinearToSrgbTable()
+{
+    static u8 table[LINEAR_TO_SRGB_TABLE_SIZE];
+    static bool initialized = [] {
+        for (u32 i = 0; i < LINEAR_TO_SRGB_TABLE_SIZE; ++i)
+        {
+            f32 l = i / (f32)(LINEAR_TO_SRGB_TABLE_SIZE - 1);
+            f32 c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+            table[i] = (u8)(c * 255.0f + 0.5f);
+        }
+        return true;
+    }();
+    (void)initialized;
+    return table;
+}
+
+static inline bool IsAlphaChannel(i32 channel, i32 nchannels)
+{
+    return (nchannels == 2 && channel == 1) || (nchannels == 4 && channel == 3);
+}
+
+static inline f32 Saturate(f32 value)
+{
+    return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+}
+
+static inline __m128 NormalizeXYZ(__m128 v)
+{
+    const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    __m128 sq = _mm_and_ps(_mm_mul_ps(v, v), xyzMask);
+    __m128 sum = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    __m128 length = _mm_sqrt_ps(_mm_max_ps(sum, _mm_set1_ps(1e-12f)));
+    __m128 normalized = _mm_div_ps(v, length);
+    return _mm_or_ps(_mm_and_ps(normalized, xyzMask), _mm_andnot_ps(xyzMask, v));
+}
+
+u32 ComputeMipCount(ivec2 size)
+{
+    u32 largest = (u32)glm::max(size.x, size.y);
+    u32 count = 1;
+    while (largest > 1)
+    {
+        largest >>= 1;
+        count++;
+    }
+    return count;
+}
+
+static void DecodeImage(const Image& image, TextureUsage usage, FloatPixels& pixels)
+{
+    const f32* srgbToLinear = GetSrgbToLinearTable();
+    const i32 n = image.nchannels;
+    pixels.resize(image.size.x * image.size.y);
+
+    ParallelFor(image.size.y, MIP_ROWS_PER_JOB, [&](u32 rowBegin, u32 rowEnd) {
+        for (u32 y = rowBegin; y < rowEnd; ++y)
+        {
+            const u8* row = (const u8*)image.pixels + y * image.stride;
+            for (i32 x = 0; x < image.size.x; ++x)
+            {
+                f32 texel[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                for (i32 c = 0; c < n; ++c)
+                {
+                    u8 value = row[x * n + c];
+                    i32 lane = IsAlphaChannel(c, n) ? 3 : c;
+                    if (lane == 3)                        texel[lane] = value / 255.0f;
+                    else if (usage == TextureUsage_Color)  texel[lane] = srgbToLinear[value];
+                    else if (usage == TextureUsage_Normal) texel[lane] = value / 127.5f - 1.0f;
+                    else                                   texel[lane] = value / 255.0f;
+                }
+                __m128 pixel = _mm_loadu_ps(texel);
+                if (usage == TextureUsage_Normal && n >= 3)
+                    pixel = NormalizeXYZ(pixel);
+                pixels[y * image.size.x + x].rgba = pixel;
+            }
+        }
+    });
+}
+
+static void EncodeLevel(const FloatPixels& pixels, ivec2 size, i32 n, TextureUsage usage, f32 alphaScale, u8* dst)
+{
+    const u8* linearToSrgb = GetLinearToSrgbTable();
+
+    ParallelFor(size.y, MIP_ROWS_PER_JOB, [&](u32 rowBegin, u32 rowEnd) {
+        for (u32 y = rowBegin; y < rowEnd; ++y)
+        {
+            u8* row = dst + y * size.x * n;
+            for (i32 x = 0; x < size.x; ++x)
+            {
+                f32 texel[4];
+                _mm_storeu_ps(texel, pixels[y * size.x + x].rgba);
+                for (i32 c = 0; c < n; ++c)
+                {
+                    i32 lane = IsAlphaChannel(c, n) ? 3 : c;
+                    f32 value = texel[lane];
+                    u8 encoded;
+                    if (lane == 3)                        encoded = (u8)(Saturate(value * alphaScale) * 255.0f + 0.5f);
+                    else if (usage == TextureUsage_Color)  encoded = linearToSrgb[(u32)(Saturate(value) * (LINEAR_TO_SRGB_TABLE_SIZE - 1) + 0.5f)];
+                    else if (usage == TextureUsage_Normal) encoded = (u8)(Saturate(value * 0.5f + 0.5f) * 255.0f + 0.5f);
+                    else                                   encoded = (u8)(Saturate(value) * 255.0f + 0.5f);
+                    row[x * n + c] = encoded;
+                }
+            }
+        }
+    });
+}
+
+// Plain 2x2 average, used whenever the level halves exactly on both axes
+static void DownsampleBox2x2(const FloatPixels& src, ivec2 srcSize, FloatPixels& dst, ivec2 dstSize)
+{
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const i32 stepX = srcSize.x > 1 ? 1 : 0;
+    const i32 stepY = srcSize.y > 1 ? srcSize.x : 0;
+    dst.resize(dstSize.x * dstSize.y);
+
+    ParallelFor(dstSize.y, MIP_ROWS_PER_JOB, [&](u32 rowBegin, u32 rowEnd) {
+        for (u32 y = rowBegin; y < rowEnd; ++y)
+        {
+            u32 srcY = srcSize.y > 1 ? y * 2 : 0;
+            for (i32 x = 0; x < dstSize.x; ++x)
+            {
+                u32 srcX = srcSize.x > 1 ? x * 2 : 0;
+                const FloatPixel* p = &src[srcY * srcSize.x + srcX];
+                __m128 sum = _mm_add_ps(_mm_add_ps(p[0].rgba, p[stepX].rgba), _mm_add_ps(p[stepY].rgba, p[stepY + stepX].rgba));
+                dst[y * dstSize.x + x].rgba = _mm_mul_ps(sum, quarter);
+            }
+        }
+    });
+}
+
+static f32 BesselI0(f32 x)
+{
+    f32 sum = 1.0f, term = 1.0f, halfX = x * 0.5f;
+    for (u32 k = 1; k < 32; ++k)
+    {
+        term *= (halfX / k) * (halfX / k);
+        sum += term;
+        if (term < sum * 1e-7f) break;
+    }
+    return sum;
+}
+
+static f32 KaiserSinc(f32 t)
+{
+    if (fabsf(t) >= KAISER_FILTER_WIDTH)
+        return 0.0f;
+
+    f32 sinc = t == 0.0f ? 1.0f : sinf(PI * t) / (PI * t);
+    f32 ratio = t / KAISER_FILTER_WIDTH;
+    f32 window = BesselI0(KAISER_FILTER_ALPHA * sqrtf(1.0f - ratio * ratio)) / BesselI0(KAISER_FILTER_ALPHA);
+    return sinc * window;
+}
+
+// Weights to go from srcCount texels to dstCount texels along one axis. The box filter
+// weights each source texel by how much of it falls under the destination texel, so odd
+// sizes are handled without dropping the last row/column.
+static FilterKernel BuildFilterKernel(i32 srcCount, i32 dstCount, MipFilter filter)
+{
+    FilterKernel kernel;
+    const f32 scale = (f32)srcCount / (f32)dstCount;
+    const f32 support = filter == MipFilter_Box ? scale * 0.5f : KAISER_FILTER_WIDTH * scale;
+
+    for (i32 d = 0; d < dstCount; ++d)
+    {
+        kernel.tapBegin.push_back((u32)kernel.tapIndex.size());
+
+        f32 center = (d + 0.5f) * scale;
+        i32 first = (i32)floorf(center - support);
+        i32 last = (i32)ceilf(center + support);
+        f32 weightSum = 0.0f;
+        u32 firstTap = (u32)kernel.tapWeight.size();
+
+        for (i32 s = first; s <= last; ++s)
+        {
+            f32 weight;
+            if (filter == MipFilter_Box)
+                weight = glm::max(0.0f, glm::min((f32)s + 1.0f, center + support) - glm::max((f32)s, center - support));
+            else
+                weight = KaiserSinc(((f32)s + 0.5f - center) / scale);
+
+            if (weight == 0.0f)
+                continue;
+
+            kernel.tapIndex.push_back((u32)glm::clamp(s, 0, srcCount - 1));
+            kernel.tapWeight.push_back(weight);
+            weightSum += weight;
+        }
+
+        for (u32 t = firstTap; t < kernel.tapWeight.size(); ++t)
+            kernel.tapWeight[t] /= weightSum;
+    }
+    kernel.tapBegin.push_back((u32)kernel.tapIndex.size());
+
+    return kernel;
+}
+
+static void DownsampleSeparable(const FloatPixels& src, ivec2 srcSize, FloatPixels& dst, ivec2 dstSize, MipFilter filter)
+{
+    FilterKernel kernelX = BuildFilterKernel(srcSize.x, dstSize.x, filter);
+    FilterKernel kernelY = BuildFilterKernel(srcSize.y, dstSize.y, filter);
+
+    // Horizontal pass (dstSize.x * srcSize.y), then vertical pass
+    FloatPixels temp(dstSize.x * srcSize.y);
+    ParallelFor(srcSize.y, MIP_ROWS_PER_JOB, [&](u32 rowBegin, u32 rowEnd) {
+        for (u32 y = rowBegin; y < rowEnd; ++y)
+        {
+            const FloatPixel* srcRow = &src[y * srcSize.x];
+            for (i32 x = 0; x < dstSize.x; ++x)
+            {
+                __m128 sum = _mm_setzero_ps();
+                for (u32 t = kernelX.tapBegin[x]; t < kernelX.tapBegin[x + 1]; ++t)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(srcRow[kernelX.tapIndex[t]].rgba, _mm_set1_ps(kernelX.tapWeight[t])));
+                temp[y * dstSize.x + x].rgba = sum;
+            }
+        }
+    });
+
+    dst.resize(dstSize.x * dstSize.y);
+    ParallelFor(dstSize.y, MIP_ROWS_PER_JOB, [&](u32 rowBegin, u32 rowEnd) {
+        for (u32 y = rowBegin; y < rowEnd; ++y)
+        {
+            FloatPixel* dstRow = &dst[y * dstSize.x];
+            for (i32 x = 0; x < dstSize.x; ++x)
+                dstRow[x].rgba = _mm_setzero_ps();
+
+            for (u32 t = kernelY.tapBegin[y]; t < kernelY.tapBegin[y + 1]; ++t)
+            {
+                const FloatPixel* tempRow = &temp[kernelY.tapIndex[t] * dstSize.x];
+                const __m128 weight = _mm_set1_ps(kernelY.tapWeight[t]);
+                for (i32 x = 0; x < dstSize.x; ++x)
+                    dstRow[x].rgba = _mm_add_ps(dstRow[x].rgba, _mm_mul_ps(tempRow[x].rgba, weight));
+            }
+        }
+    });
+}
+
+static f32 ComputeAlphaCoverage(const FloatPixels& pixels, f32 alphaScale)
+{
+    u32 covered = 0;
+    for (const FloatPixel& pixel : pixels)
+    {
+        f32 texel[4];
+        _mm_storeu_ps(texel, pixel.rgba);
+        if (texel[3] * alphaScale > ALPHA_COVERAGE_REFERENCE)
+            covered++;
+    }
+    return (f32)covered / (f32)pixels.size();
+}
+
+// Finds the alpha scale that makes this level cover the same area as the top level
+// when alpha tested against ALPHA_COVERAGE_REFERENCE
+static f32 FindAlphaScaleForCoverage(const FloatPixels& pixels, f32 targetCoverage)
+{
+    f32 low = 0.0f, high = 4.0f, scale = 1.0f;
+    for (u32 i = 0; i < 10; ++i)
+    {
+        f32 coverage = ComputeAlphaCoverage(pixels, scale);
+        if (coverage < targetCoverage) low = scale;
+        else                           high = scale;
+        scale = (low + high) * 0.5f;
+    }
+    return scale;
+}
+
+MipChain GenerateMipChain(const Image& image, TextureUsage usage, MipFilter filter)
+{
+    MipChain chain = {};
+    chain.nchannels = image.nchannels;
+
+    const u32 mipCount = ComputeMipCount(image.size);
+    const i32 n = image.nchannels;
+
+    u32 totalSize = 0;
+    ivec2 size = image.size;
+    for (u32 i = 0; i < mipCount; ++i)
+    {
+        MipLevel level = {};
+        level.size = size;
+        level.offset = totalSize;
+        level.dataSize = size.x * size.y * n;
+        chain.levels.push_back(level);
+
+        totalSize += level.dataSize;
+        size = glm::max(size / 2, ivec2(1));
+    }
+    chain.data.resize(totalSize);
+
+    // Level 0 is the source image itself
+    for (i32 y = 0; y < image.size.y; ++y)
+        memcpy(&chain.data[y * image.size.x * n], (const u8*)image.pixels + y * image.stride, image.size.x * n);
+
+    if (mipCount == 1)
+        return chain;
+
+    FloatPixels current, next;
+    DecodeImage(image, usage, current);
+
+    const bool hasAlpha = n == 2 || n == 4;
+    f32 targetCoverage = hasAlpha && usage == TextureUsage_Color ? ComputeAlphaCoverage(current, 1.0f) : 1.0f;
+    const bool preserveCoverage = targetCoverage > 0.0f && targetCoverage < 1.0f;
+
+    for (u32 i = 1; i < mipCount; ++i)
+    {
+        const MipLevel& srcLevel = chain.levels[i - 1];
+        const MipLevel& dstLevel = chain.levels[i];
+
+        bool halvesExactly = (srcLevel.size.x == 1 || srcLevel.size.x == dstLevel.size.x * 2) &&
+                             (srcLevel.size.y == 1 || srcLevel.size.y == dstLevel.size.y * 2);
+
+        if (filter == MipFilter_Box && halvesExactly)
+            DownsampleBox2x2(current, srcLevel.size, next, dstLevel.size);
+        else
+            DownsampleSeparable(current, srcLevel.size, next, dstLevel.size, filter);
+
+        if (usage == TextureUsage_Normal)
+            for (FloatPixel& pixel : next)
+                pixel.rgba = NormalizeXYZ(pixel.rgba);
+
+        // The unscaled level feeds the next one, the scale only affects what gets stored
+        f32 alphaScale = preserveCoverage ? FindAlphaScaleForCoverage(next, targetCoverage) : 1.0f;
+        EncodeLevel(next, dstLevel.size, n, usage, alphaScale, &chain.data[dstLevel.offset]);
+
+        current.swap(next);
+    }
+
+    return chain;
+}
@@ -0,0 +1,24 @@
+//
+// texture_processing.h: CPU side texture work done at import time (mip chain generation).
+//
+
+#pragma once
+
+#include "engine.h"
+
+struct MipChain
+{
+    std::vector<u8>       data;      // Tightly packed levels (no row padding), level 0 first
+    std::vector<MipLevel> levels;
+    i32                   nchannels;
+};
+
+u32 ComputeMipCount(ivec2 size);
+
+/**
+ * Builds the full mip chain of an 8 bit per channel image. Color textures are averaged in
+ * linear space (sRGB decode/encode), normal maps are renormalized on every level and alpha
+ * tested textures keep the alpha coverage of the top level. Rows are processed in parallel
+ * with the job system.
+ */
+MipChain GenerateMipChain(const Image& image, TextureUsage usage, MipFilter filter = MipFilter_Box);
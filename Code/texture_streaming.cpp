@@ -0,0 +1,237 @@
+#include "texture_streaming.h"
+
+#include <algorithm>
+
+static bool IsStreamed(const Texture& texture)
+{
+    return texture.container.data != NULL;
+}
+
+static u64 GetLevelBytes(const Texture& texture, u32 level)
+{
+    ivec2 size = glm::max(texture.size >> ivec2((i32)level), ivec2(1));
+
+    switch (texture.format)
+    {
+        case BlockFormat_None: return (u64)size.x * size.y * texture.nchannels;
+        case BlockFormat_BC1:  return (u64)((size.x + 3) / 4) * ((size.y + 3) / 4) * 8;
+        default:               return (u64)((size.x + 3) / 4) * ((size.y + 3) / 4) * 16;
+    }
+}
+
+static u64 GetLevelRangeBytes(const Texture& texture, u32 firstLevel)
+{
+    u64 bytes = 0;
+    for (u32 level = firstLevel; level < texture.mipCount; ++level)
+        bytes += GetLevelBytes(texture, level);
+    return bytes;
+}
+
+u64 GetTextureResidentBytes(const Texture& texture)
+{
+    return GetLevelRangeBytes(texture, texture.residentMip);
+}
+
+u32 GetInitialStreamingMip(const TextureContainer& container)
+{
+    for (u32 level = 0; level < container.header->mipCount; ++level)
+        if (glm::max(container.levels[level].size.x, container.levels[level].size.y) <= STREAMING_INITIAL_MIP_SIZE)
+            return level;
+
+    return container.header->mipCount - 1;
+}
+
+// Lowers the wanted level of the texture if an object with this footprint needs more detail
+static void RequestTextureDetail(App* app, u32 textureIdx, f32 distance, f32 radius, f32 uvPerWorldUnit)
+{
+    if (textureIdx >= app->textures.size())
+        return;
+
+    Texture& texture = app->textures[textureIdx];
+    if (!IsStreamed(texture) || uvPerWorldUnit <= 0.0f)
+        return;
+
+    const f32 pixelsPerWorldUnit = app->displaySize.y * 0.5f * app->projection[1][1] / glm::max(distance, app->zNear);
+    const f32 texelsPerWorldUnit = glm::max(texture.size.x, texture.size.y) * uvPerWorldUnit;
+    const f32 lod = log2f(glm::max(texelsPerWorldUnit / pixelsPerWorldUnit, 1.0f));
+
+    texture.wantedMip = glm::min(texture.wantedMip, glm::min((u32)lod, texture.mipCount - 1));
+
+    const f32 projectedRadius = radius * pixelsPerWorldUnit;
+    texture.screenCoverage = glm::max(texture.screenCoverage, PI * projectedRadius * projectedRadius);
+}
+
+static void RequestSubmeshDetail(App* app, const glm::mat4& world, const Submesh& submesh, u32 materialIdx)
+{
+    const f32 scale = glm::max(glm::length(vec3(world[0])), glm::max(glm::length(vec3(world[1])), glm::length(vec3(world[2]))));
+    const vec3 center = vec3(world * vec4(submesh.boundsCenter, 1.0f));
+    const f32 radius = submesh.boundsRadius * scale;
+    const f32 distance = glm::length(center - app->camera.position) - radius;
+
+    // Only the albedo texture is sampled by the textured mesh program
+    const Material& material = app->materials[materialIdx];
+    RequestTextureDetail(app, material.albedoTextureIdx, distance, radius, submesh.uvDensity / scale);
+}
+
+static void ComputeWantedMips(App* app)
+{
+    for (Texture& texture : app->textures)
+    {
+        if (!IsStreamed(texture))
+            continue;
+        texture.wantedMip = texture.mipCount - 1;
+        texture.screenCoverage = 0.0f;
+    }
+
+    switch (app->mode)
+    {
+        case Mode_TexturedQuad:
+        {
+            // The quad fills the screen
+            if (app->diceTexIdx >= app->textures.size())
+                break;
+
+            Texture& texture = app->textures[app->diceTexIdx];
+            if (!IsStreamed(texture))
+                break;
+
+            f32 texelsPerPixel = glm::max(texture.size.x / (f32)app->displaySize.x, texture.size.y / (f32)app->displaySize.y);
+            texture.wantedMip = glm::min((u32)log2f(glm::max(texelsPerPixel, 1.0f)), texture.mipCount - 1);
+            texture.screenCoverage = (f32)app->displaySize.x * app->displaySize.y;
+            break;
+        }
+        case Mode_TexturedMesh:
+        case Mode_Deferred:
+        {
+            for (u32 i = 0; i < (u32)app->gameObjects.size(); ++i)
+            {
+                const GameObject& gameObject = app->gameObjects[i];
+                if (gameObject.modelIdx >= app->models.size())
+                    continue;
+
+                const Model& model = app->models[gameObject.modelIdx];
+                const Mesh& mesh = app->meshes[model.meshIdx];
+
+                if (model.instanceBatches.empty())
+                {
+                    for (u32 s = 0; s < mesh.submeshes.size(); ++s)
+                        RequestSubmeshDetail(app, gameObject.transform.matrix, mesh.submeshes[s], model.materialIdx[s]);
+                    continue;
+                }
+
+                for (const InstanceBatch& batch : model.instanceBatches)
+                    for (u32 instance = batch.firstInstance; instance < batch.firstInstance + batch.instanceCount; ++instance)
+                        RequestSubmeshDetail(app, gameObject.transform.matrix * model.instanceTransforms[instance],
+                                             mesh.submeshes[batch.submeshIdx], model.materialIdx[batch.submeshIdx]);
+            }
+            break;
+        }
+        default:;
+    }
+}
+
+// Drops the most detailed wanted mip of the texture with the smallest footprint until
+// everything fits in the budget
+static void FitStreamingBudget(App* app)
+{
+    u64 totalBytes = 0;
+    for (const Texture& texture : app->textures)
+        totalBytes += IsStreamed(texture) ? GetLevelRangeBytes(texture, texture.wantedMip) : GetTextureResidentBytes(texture);
+
+    while (totalBytes > app->textureStreamingBudget)
+    {
+        Texture* leastNeeded = NULL;
+        for (Texture& texture : app->textures)
+            if (IsStreamed(texture) && texture.wantedMip + 1 < texture.mipCount)
+                if (!leastNeeded || texture.screenCoverage < leastNeeded->screenCoverage)
+                    leastNeeded = &texture;
+
+        if (!leastNeeded)
+            break;
+
+        totalBytes -= GetLevelBytes(*leastNeeded, leastNeeded->wantedMip);
+        leastNeeded->wantedMip++;
+        leastNeeded->screenCoverage *= 0.25f; // The next level down has a quarter of the texels
+    }
+}
+
+// Creates the texture again with levels [newResidentMip, mipCount). Levels that were already
+// resident are copied on the GPU, the rest come from the mapped container.
+static void SetResidentMip(App* app, Texture& texture, u32 newResidentMip)
+{
+    const TextureContainer container = GetTextureContainerView(texture.container);
+    const GLsizei levelCount = (GLsizei)(texture.mipCount - newResidentMip);
+    const MipLevel& topLevel = container.levels[newResidentMip];
+
+    GLuint handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D, handle);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, GetTextureInternalFormat(texture.format, texture.nchannels), topLevel.size.x, topLevel.size.y);
+
+    for (u32 level = newResidentMip; level < texture.mipCount; ++level)
+    {
+        const MipLevel& mip = container.levels[level];
+        const GLint dstLevel = (GLint)(level - newResidentMip);
+
+        if (level >= texture.residentMip)
+        {
+            const GLint srcLevel = (GLint)(level - texture.residentMip);
+            glCopyImageSubData(texture.handle, GL_TEXTURE_2D, srcLevel, 0, 0, 0,
+                               handle, GL_TEXTURE_2D, dstLevel, 0, 0, 0, mip.size.x, mip.size.y, 1);
+        }
+        else if (texture.format != BlockFormat_None)
+        {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, dstLevel, 0, 0, mip.size.x, mip.size.y,
+                                      GetTextureInternalFormat(texture.format, texture.nchannels), mip.dataSize, container.payload + mip.offset);
+        }
+        else
+        {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, dstLevel, 0, 0, mip.size.x, mip.size.y,
+                            texture.nchannels == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, container.payload + mip.offset);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    app->textureStreamingResidentBytes -= GetTextureResidentBytes(texture);
+    glDeleteTextures(1, &texture.handle);
+
+    texture.handle = handle;
+    texture.residentMip = newResidentMip;
+    app->textureStreamingResidentBytes += GetTextureResidentBytes(texture);
+}
+
+void UpdateTextureStreaming(App* app)
+{
+    if (!app->textureStreaming)
+        return;
+
+    ComputeWantedMips(app);
+    FitStreamingBudget(app);
+
+    // Evictions go first so the memory is released before new levels come in,
+    // then the textures that cover more of the screen
+    std::vector<Texture*> pending;
+    for (Texture& texture : app->textures)
+        if (IsStreamed(texture) && texture.wantedMip != texture.residentMip)
+            pending.push_back(&texture);
+
+    std::sort(pending.begin(), pending.end(), [](const Texture* a, const Texture* b) {
+        bool aEvicts = a->wantedMip > a->residentMip;
+        bool bEvicts = b->wantedMip > b->residentMip;
+        if (aEvicts != bEvicts)
+            return aEvicts;
+        return a->screenCoverage > b->screenCoverage;
+    });
+
+    const u32 updateCount = glm::min((u32)pending.size(), app->textureStreamingUpdatesPerFrame);
+    for (u32 i = 0; i < updateCount; ++i)
+        SetResidentMip(app, *pending[i], pending[i]->wantedMip);
+}
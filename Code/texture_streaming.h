@@ -0,0 +1,23 @@
+//
+// texture_streaming.h: Mip streaming. Textures are created with only their small mips and
+// the more detailed ones are streamed in from the mapped .btex container when the objects
+// using them get big enough on screen, within a memory budget.
+//
+
+#pragma once
+
+#include "texture_container.h"
+
+// Textures are loaded with the levels whose largest side is at most this size
+#define STREAMING_INITIAL_MIP_SIZE 64
+
+u32 GetInitialStreamingMip(const TextureContainer& container);
+
+u64 GetTextureResidentBytes(const Texture& texture);
+
+/**
+ * Computes the level each texture needs from the projected texel density of the submeshes
+ * using it, fits the result in App::textureStreamingBudget and reallocates a few textures
+ * with their new resident levels. Called once per frame from Update().
+ */
+void UpdateTextureStreaming(App* app);
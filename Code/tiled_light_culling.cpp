@@ -0,0 +1,55 @@
+#include "tiled_light_culling.h"
+
+static uvec2 GetTileCount(const App* app)
+{
+    return uvec2((app->displaySize.x + TILE_SIZE - 1) / TILE_SIZE, (app->displaySize.y + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+void InitTiledLightCulling(App* app)
+{
+    app->tiledLightCullingProgramIdx = LoadProgram(app, "shaders.glsl", "TILED_LIGHT_CULLING", "#define COMPUTE\n");
+    app->deferredTiledLightingProgramIdx = LoadProgram(app, "shaders.glsl", "DEFERRED_LIGHTING", "#define TILED_LIGHTS\n");
+
+    // Fixed size lists, the compute pass never has to allocate
+    const uvec2 tileCount = GetTileCount(app);
+    const u32 tiles = tileCount.x * tileCount.y;
+
+    glGenBuffers(1, &app->tileLightsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->tileLightsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, tiles * sizeof(uvec2), NULL, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &app->tileLightIndexBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->tileLightIndexBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, tiles * MAX_LIGHTS_PER_TILE * sizeof(u32), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+bool DispatchTiledLightCulling(App* app)
+{
+    // The lighting variant reads the lists, without it they are not worth building
+    const Program& program = app->programs[app->tiledLightCullingProgramIdx];
+    const Program& lightingProgram = app->programs[app->deferredTiledLightingProgramIdx];
+    if (!program.handle || program.pending || !lightingProgram.handle || lightingProgram.pending)
+        return false;
+
+    glUseProgram(program.handle);
+    glUniform1i(GetUniformLocation(program, "uDepth"), 0);
+    const glm::mat4 inverseProjection = glm::inverse(app->projection);
+    glUniformMatrix4fv(GetUniformLocation(program, "uInverseProjection"), 1, GL_FALSE, value_ptr(inverseProjection));
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, app->depthAttachmentHandle);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, app->tileLightsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, app->tileLightIndexBuffer);
+
+    const uvec2 tileCount = GetTileCount(app);
+    glDispatchCompute(tileCount.x, tileCount.y, 1);
+
+    // The lighting pass reads the lists right after
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    return true;
+}
@@ -0,0 +1,28 @@
+//
+// tiled_light_culling.h: GPU light culling against the depth buffer, an alternative to the
+// CPU clusters of clustered_lighting.h for light sets that change every frame. A compute pass
+// reads the depth attachment, finds the depth range of every TILE_SIZE x TILE_SIZE pixel tile
+// and keeps the point lights whose sphere touches the tile frustum within that range. The
+// per tile lists land in SSBOs read by the TILED_LIGHTS variant of DEFERRED_LIGHTING.
+//
+
+#pragma once
+
+#include "engine.h"
+
+#define TILE_SIZE 16            // Pixels per side, the compute work group size
+#define MAX_LIGHTS_PER_TILE 256 // Lights past this are dropped from the tile
+
+/**
+ * Loads the culling compute program and the lighting variant reading its output, and sizes
+ * the tile SSBOs for App::displaySize.
+ */
+void InitTiledLightCulling(App* app);
+
+/**
+ * Culls the point lights of the light buffer against the depth attachment and binds the tile
+ * SSBOs. The depth has to be written and GlobalParams bound already. Returns false, binding
+ * nothing, unless both the culling and the TILED_LIGHTS lighting programs are ready: the
+ * caller lights with the clusters then.
+ */
+bool DispatchTiledLightCulling(App* app);
@@ -0,0 +1,586 @@
+#include "world_streaming.h"
+#include "assimp_model_loading.h"
+#include "impostor.h"
+#include "job_system.h"
+#include "json.h"
+#include "mesh_lod.h"
+#include "obj_model_loading.h"
+
+#include <algorithm>
+
+// Cells are unloaded once this much further than the load radius, so they don't flicker in
+// and out at the edge
+#define WORLD_UNLOAD_RADIUS_SCALE 1.25f
+// Memory an asset is assumed to take per byte of its file until it has been loaded once.
+// On the high side: text formats shrink when parsed but the LODs and index data add up
+#define WORLD_UNMEASURED_ASSET_BYTES_PER_FILE_BYTE 2
+
+struct WorldCellLoad
+{
+    JobCounter               counter;
+    bool                     ok = false;
+    std::vector<WorldObject> objects;
+};
+
+struct WorldAssetLoad
+{
+    JobCounter counter;
+    bool       ok = false;
+    ObjModel   model;
+};
+
+static u64 GetCellKey(ivec2 coord)
+{
+    return ((u64)(u32)coord.x << 32) | (u32)coord.y;
+}
+
+static bool IsObjFile(const std::string& filepath)
+{
+    const size_t dot = filepath.find_last_of('.');
+    std::string extension = dot == std::string::npos ? std::string() : filepath.substr(dot);
+    for (char& c : extension)
+        c = (char)tolower(c);
+    return extension == ".obj";
+}
+
+static bool ParseWorldObjects(const JsonValue& objects, std::vector<WorldObject>& result)
+{
+    for (u32 i = 0; i < objects.Size(); ++i)
+    {
+        const JsonValue& object = objects[i];
+        if (object["model"].type != JsonType_String)
+            return false;
+
+        WorldObject worldObject;
+        worldObject.model = object["model"].GetString();
+        for (u32 c = 0; c < 3; ++c)
+            worldObject.position[c] = (f32)object["position"][c].GetNumber();
+
+        const JsonValue& scale = object["scale"];
+        if (scale.type == JsonType_Array)
+            for (u32 c = 0; c < 3; ++c)
+                worldObject.scale[c] = (f32)scale[c].GetNumber(1.0);
+        else
+            worldObject.scale = vec3((f32)scale.GetNumber(1.0));
+
+        worldObject.yaw = (f32)object["yaw"].GetNumber();
+        result.push_back(worldObject);
+    }
+    return true;
+}
+
+bool LoadWorldManifest(App* app, const char* filename)
+{
+    MappedFile file = MapFile(filename);
+    if (!file.data)
+        return false;
+
+    JsonValue manifest;
+    const bool parsed = ParseJson((const char*)file.data, file.size, manifest);
+    UnmapFile(file);
+    if (!parsed)
+    {
+        ELOG("Could not parse the world manifest %s", filename);
+        return false;
+    }
+
+    app->worldCellSize = (f32)manifest["cellSize"].GetNumber(app->worldCellSize);
+
+    const JsonValue& cells = manifest["cells"];
+    for (u32 i = 0; i < cells.Size(); ++i)
+    {
+        const JsonValue& cellDesc = cells[i];
+
+        WorldCell cell;
+        cell.coord = ivec2((i32)cellDesc["x"].GetNumber(), (i32)cellDesc["z"].GetNumber());
+        cell.filepath = cellDesc["file"].GetString();
+        if (!ParseWorldObjects(cellDesc["objects"], cell.objects))
+        {
+            ELOG("World cell (%d, %d) of %s has invalid objects", cell.coord.x, cell.coord.y, filename);
+            continue;
+        }
+
+        const u64 key = GetCellKey(cell.coord);
+        if (app->worldCellByCoord.count(key))
+        {
+            ELOG("World cell (%d, %d) appears twice in %s", cell.coord.x, cell.coord.y, filename);
+            continue;
+        }
+
+        app->worldCellByCoord[key] = (u32)app->worldCells.size();
+        app->worldCells.push_back(cell);
+    }
+
+    ILOG("World manifest %s: %u cells of %.1f units", filename, (u32)app->worldCells.size(), app->worldCellSize);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Assets
+
+static u64 GetSubmeshesCpuBytes(const std::vector<Submesh>& submeshes)
+{
+    u64 bytes = 0;
+    for (const Submesh& submesh : submeshes)
+    {
+        bytes += submesh.vertices.size() * sizeof(float) + submesh.indices.size() * sizeof(u32);
+        for (const SubmeshLod& lod : submesh.lods)
+            bytes += lod.indices.size() * sizeof(u32);
+    }
+    return bytes;
+}
+
+static u64 GetBufferBytes(GLuint bufferHandle)
+{
+    if (!bufferHandle)
+        return 0;
+
+    GLint size = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, bufferHandle);
+    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return (u64)size;
+}
+
+static u64 GetMeshGpuBytes(const Mesh& mesh)
+{
+    u64 bytes = GetBufferBytes(mesh.vertexBufferHandle) + GetBufferBytes(mesh.instanceBufferHandle);
+    if (mesh.indexBufferHandle != mesh.vertexBufferHandle)
+        bytes += GetBufferBytes(mesh.indexBufferHandle);
+    return bytes;
+}
+
+static u32 FindOrAddAsset(App* app, const std::string& filepath)
+{
+    auto it = app->worldAssetByPath.find(filepath);
+    if (it != app->worldAssetByPath.end())
+        return it->second;
+
+    WorldAsset asset;
+    asset.filepath = filepath;
+    asset.cpuBytes = asset.gpuBytes = GetFileSizeInBytes(filepath.c_str()) * WORLD_UNMEASURED_ASSET_BYTES_PER_FILE_BYTE;
+    app->worldAssets.push_back(asset);
+    app->worldAssetByPath[filepath] = (u32)app->worldAssets.size() - 1u;
+    return (u32)app->worldAssets.size() - 1u;
+}
+
+static void AcquireAsset(App* app, u32 assetIdx)
+{
+    WorldAsset& asset = app->worldAssets[assetIdx];
+    asset.refCount++;
+    if (asset.residency != WorldResidency_Unloaded)
+        return;
+
+    // OBJ files parse on a worker, other formats are imported on the main thread at upload
+    asset.residency = WorldResidency_Loaded;
+    if (IsObjFile(asset.filepath))
+    {
+        asset.residency = WorldResidency_Loading;
+        asset.load = new WorldAssetLoad;
+
+        WorldAssetLoad* load = asset.load;
+        const std::string filepath = asset.filepath;
+        RunJob([load, filepath]() {
+            load->ok = PrepareObjModel(filepath.c_str(), load->model);
+        }, &load->counter);
+    }
+}
+
+static void ReleaseAsset(App* app, u32 assetIdx)
+{
+    WorldAsset& asset = app->worldAssets[assetIdx];
+    ASSERT(asset.refCount > 0, "Releasing an asset nobody uses");
+    if (--asset.refCount > 0)
+        return;
+
+    switch (asset.residency)
+    {
+        case WorldResidency_Loading:
+            break; // Dropped once its job finishes
+        case WorldResidency_Loaded:
+            if (asset.load)
+            {
+                app->worldCpuBytes -= asset.cpuBytes;
+                delete asset.load;
+                asset.load = nullptr;
+            }
+            asset.residency = WorldResidency_Unloaded;
+            break;
+        case WorldResidency_Resident:
+            FreeMesh(app->meshes[app->models[asset.modelIdx].meshIdx]);
+            app->worldCpuBytes -= asset.cpuBytes;
+            app->worldGpuBytes -= asset.gpuBytes;
+            asset.residency = WorldResidency_Unloaded;
+            break;
+        default:;
+    }
+}
+
+static void FinishAssetJobs(App* app)
+{
+    for (WorldAsset& asset : app->worldAssets)
+    {
+        if (asset.residency != WorldResidency_Loading || !IsJobDone(asset.load->counter))
+            continue;
+
+        if (!asset.load->ok || asset.refCount == 0)
+        {
+            if (!asset.load->ok)
+                ELOG("World streaming could not load %s", asset.filepath.c_str());
+            delete asset.load;
+            asset.load = nullptr;
+            asset.residency = WorldResidency_Unloaded;
+            continue;
+        }
+
+        asset.cpuBytes = GetSubmeshesCpuBytes(asset.load->model.submeshes);
+        app->worldCpuBytes += asset.cpuBytes;
+        asset.residency = WorldResidency_Loaded;
+    }
+}
+
+static void UploadLoadedAssets(App* app)
+{
+    u32 uploads = 0;
+    for (WorldAsset& asset : app->worldAssets)
+    {
+        if (uploads >= app->worldUploadsPerFrame)
+            break;
+        if (asset.residency != WorldResidency_Loaded)
+            continue;
+
+        if (asset.load)
+        {
+            // Reloads refill the mesh created the first time, materials and textures stay
+            app->worldCpuBytes -= asset.cpuBytes;
+            if (asset.modelIdx == UINT32_MAX)
+            {
+                asset.modelIdx = CreateObjModel(app, asset.load->model);
+                BakeImpostor(app, asset.modelIdx);
+            }
+            else
+            {
+                Mesh& mesh = app->meshes[app->models[asset.modelIdx].meshIdx];
+                mesh.submeshes.swap(asset.load->model.submeshes);
+                UploadMesh(mesh);
+                ComputeModelBounds(app, app->models[asset.modelIdx]);
+            }
+            delete asset.load;
+            asset.load = nullptr;
+        }
+        else
+        {
+            const u32 modelCount = (u32)app->models.size();
+            const u32 meshCount = (u32)app->meshes.size();
+            const u32 materialCount = (u32)app->materials.size();
+            const u32 modelIdx = LoadModel(app, asset.filepath.c_str());
+            if (modelIdx == UINT32_MAX)
+            {
+                ELOG("World streaming could not load %s", asset.filepath.c_str());
+                asset.residency = WorldResidency_Unloaded;
+                continue;
+            }
+
+            if (asset.modelIdx == UINT32_MAX)
+            {
+                asset.modelIdx = modelIdx;
+                BakeImpostor(app, modelIdx);
+            }
+            else
+            {
+                // Other formats can only import into new entries: the mesh moves into the one
+                // created the first time and the rest is dropped, materials and textures stay
+                app->meshes[app->models[asset.modelIdx].meshIdx] = std::move(app->meshes[app->models[modelIdx].meshIdx]);
+                app->models[asset.modelIdx].boundsCenter = app->models[modelIdx].boundsCenter;
+                app->models[asset.modelIdx].boundsRadius = app->models[modelIdx].boundsRadius;
+                app->models.resize(modelCount);
+                app->meshes.resize(meshCount);
+                app->materials.resize(materialCount);
+            }
+        }
+
+        const Mesh& mesh = app->meshes[app->models[asset.modelIdx].meshIdx];
+        asset.cpuBytes = GetSubmeshesCpuBytes(mesh.submeshes);
+        asset.gpuBytes = GetMeshGpuBytes(mesh);
+        app->worldCpuBytes += asset.cpuBytes;
+        app->worldGpuBytes += asset.gpuBytes;
+        asset.residency = WorldResidency_Resident;
+        uploads++;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Cells
+
+static vec3 GetCellOrigin(const App* app, ivec2 coord)
+{
+    return vec3(coord.x * app->worldCellSize, 0.0f, coord.y * app->worldCellSize);
+}
+
+static f32 GetCellDistance(const App* app, ivec2 coord, const vec3& position)
+{
+    const vec3 center = GetCellOrigin(app, coord) + vec3(0.5f, 0.0f, 0.5f) * app->worldCellSize;
+    return glm::length(vec2(center.x - position.x, center.z - position.z));
+}
+
+// Geometry the cell would add to the budgets, with the last measured sizes of its models.
+// Registers the assets never seen before so they get their file size based estimate
+static void EstimateCellBytes(App* app, const WorldCell& cell, u64& cpuBytes, u64& gpuBytes)
+{
+    cpuBytes = gpuBytes = 0;
+    std::vector<u32> counted;
+    for (const WorldObject& object : cell.objects)
+    {
+        const u32 assetIdx = FindOrAddAsset(app, object.model);
+        if (std::find(counted.begin(), counted.end(), assetIdx) != counted.end())
+            continue;
+
+        counted.push_back(assetIdx);
+        const WorldAsset& asset = app->worldAssets[assetIdx];
+        if (asset.residency == WorldResidency_Unloaded)
+        {
+            cpuBytes += asset.cpuBytes;
+            gpuBytes += asset.gpuBytes;
+        }
+    }
+}
+
+static void AcquireCellAssets(App* app, WorldCell& cell)
+{
+    for (const WorldObject& object : cell.objects)
+    {
+        const u32 assetIdx = FindOrAddAsset(app, object.model);
+        if (std::find(cell.assets.begin(), cell.assets.end(), assetIdx) == cell.assets.end())
+        {
+            cell.assets.push_back(assetIdx);
+            AcquireAsset(app, assetIdx);
+        }
+    }
+}
+
+static void StartCellLoad(App* app, u32 cellIdx)
+{
+    WorldCell& cell = app->worldCells[cellIdx];
+    cell.residency = WorldResidency_Loading;
+    app->worldActiveCells.push_back(cellIdx);
+
+    if (cell.filepath.empty())
+    {
+        AcquireCellAssets(app, cell);
+        return;
+    }
+
+    cell.load = new WorldCellLoad;
+    WorldCellLoad* load = cell.load;
+    const std::string filepath = cell.filepath;
+    RunJob([load, filepath]() {
+        MappedFile file = MapFile(filepath.c_str());
+        if (!file.data)
+            return;
+
+        JsonValue root;
+        load->ok = ParseJson((const char*)file.data, file.size, root) && ParseWorldObjects(root["objects"], load->objects);
+        UnmapFile(file);
+    }, &load->counter);
+}
+
+static void SpawnCellObjects(App* app, u32 cellIdx)
+{
+    const WorldCell& cell = app->worldCells[cellIdx];
+    const vec3 origin = GetCellOrigin(app, cell.coord);
+
+    for (const WorldObject& object : cell.objects)
+    {
+        const WorldAsset& asset = app->worldAssets[app->worldAssetByPath[object.model]];
+        if (asset.residency != WorldResidency_Resident)
+            continue; // Failed to load
+
+        GameObject gameObject;
+        gameObject.name = object.model;
+        gameObject.transform.position = origin + object.position;
+        gameObject.transform.matrix = glm::translate(gameObject.transform.position) *
+                                      glm::rotate(glm::radians(object.yaw), vec3(0.0f, 1.0f, 0.0f)) *
+                                      glm::scale(object.scale);
+        gameObject.modelIdx = asset.modelIdx;
+        gameObject.cellIdx = cellIdx;
+        app->gameObjects.push_back(gameObject);
+    }
+}
+
+static void UnloadCell(App* app, u32 cellIdx)
+{
+    WorldCell& cell = app->worldCells[cellIdx];
+    ASSERT(cell.load == nullptr, "Cells can't be unloaded while their file is being read");
+
+    app->gameObjects.erase(std::remove_if(app->gameObjects.begin(), app->gameObjects.end(),
+                                          [cellIdx](const GameObject& gameObject) { return gameObject.cellIdx == cellIdx; }),
+                           app->gameObjects.end());
+
+    for (u32 assetIdx : cell.assets)
+        ReleaseAsset(app, assetIdx);
+    cell.assets.clear();
+
+    // Objects read from a cell file are read again next time, only the manifest stays resident
+    if (!cell.filepath.empty())
+        std::vector<WorldObject>().swap(cell.objects);
+
+    cell.residency = WorldResidency_Unloaded;
+    app->worldActiveCells.erase(std::find(app->worldActiveCells.begin(), app->worldActiveCells.end(), cellIdx));
+}
+
+static void FinishCellLoads(App* app)
+{
+    for (u32 cellIdx : app->worldActiveCells)
+    {
+        WorldCell& cell = app->worldCells[cellIdx];
+        if (cell.residency != WorldResidency_Loading)
+            continue;
+
+        if (cell.load)
+        {
+            if (!IsJobDone(cell.load->counter))
+                continue;
+
+            if (!cell.load->ok)
+                ELOG("World streaming could not read the cell file %s", cell.filepath.c_str());
+
+            cell.objects.swap(cell.load->objects);
+            delete cell.load;
+            cell.load = nullptr;
+            AcquireCellAssets(app, cell);
+        }
+
+        bool assetsReady = true;
+        for (u32 assetIdx : cell.assets)
+        {
+            const WorldResidency residency = app->worldAssets[assetIdx].residency;
+            assetsReady &= residency == WorldResidency_Resident || residency == WorldResidency_Unloaded;
+        }
+
+        if (assetsReady)
+        {
+            SpawnCellObjects(app, cellIdx);
+            cell.residency = WorldResidency_Resident;
+        }
+    }
+}
+
+void UpdateWorldStreaming(App* app)
+{
+    if (app->worldCells.empty())
+        return;
+
+    // Smoothed camera velocity, to prefetch the cells ahead
+    const vec3 position = app->camera.position;
+    if (app->deltaTime > 0.0f)
+    {
+        const vec3 velocity = (position - app->worldLastCameraPosition) / app->deltaTime;
+        app->worldCameraVelocity = glm::mix(app->worldCameraVelocity, velocity, 0.2f);
+    }
+    app->worldLastCameraPosition = position;
+    const vec3 ahead = position + app->worldCameraVelocity * app->worldPrefetchSeconds;
+
+    // Cells to keep: around the camera and around where it will be. Only the coordinates in
+    // range are visited, so the cost doesn't grow with the world.
+    std::vector<std::pair<f32, u32>> wantedCells;
+    const f32 radius = app->worldLoadRadius;
+    const vec3 minPos = glm::min(position, ahead) - radius;
+    const vec3 maxPos = glm::max(position, ahead) + radius;
+    for (i32 z = (i32)floorf(minPos.z / app->worldCellSize); z <= (i32)floorf(maxPos.z / app->worldCellSize); ++z)
+    {
+        for (i32 x = (i32)floorf(minPos.x / app->worldCellSize); x <= (i32)floorf(maxPos.x / app->worldCellSize); ++x)
+        {
+            auto it = app->worldCellByCoord.find(GetCellKey(ivec2(x, z)));
+            if (it == app->worldCellByCoord.end())
+                continue;
+
+            const f32 distance = GetCellDistance(app, ivec2(x, z), position);
+            if (distance <= radius || GetCellDistance(app, ivec2(x, z), ahead) <= radius)
+                wantedCells.push_back(std::make_pair(distance, it->second));
+        }
+    }
+    std::sort(wantedCells.begin(), wantedCells.end());
+
+    FinishAssetJobs(app);
+    UploadLoadedAssets(app);
+    FinishCellLoads(app);
+
+    // Unload the cells that went out of range
+    const std::vector<u32> activeCells = app->worldActiveCells;
+    for (u32 cellIdx : activeCells)
+    {
+        const WorldCell& cell = app->worldCells[cellIdx];
+        if (cell.load)
+            continue;
+
+        const f32 unloadRadius = radius * WORLD_UNLOAD_RADIUS_SCALE;
+        if (GetCellDistance(app, cell.coord, position) > unloadRadius && GetCellDistance(app, cell.coord, ahead) > unloadRadius)
+            UnloadCell(app, cellIdx);
+    }
+
+    // Hard budgets: drop the farthest cells until the geometry fits again
+    while (app->worldCpuBytes > app->worldCpuBudget || app->worldGpuBytes > app->worldGpuBudget)
+    {
+        u32 farthestCell = UINT32_MAX;
+        f32 farthestDistance = -1.0f;
+        for (u32 cellIdx : app->worldActiveCells)
+        {
+            const WorldCell& cell = app->worldCells[cellIdx];
+            const f32 distance = GetCellDistance(app, cell.coord, position);
+            if (!cell.load && distance > farthestDistance)
+            {
+                farthestCell = cellIdx;
+                farthestDistance = distance;
+            }
+        }
+        if (farthestCell == UINT32_MAX)
+            break;
+        UnloadCell(app, farthestCell);
+    }
+
+    // Start loading the closest missing cells that fit
+    u32 loadingCount = 0;
+    for (u32 cellIdx : app->worldActiveCells)
+        loadingCount += app->worldCells[cellIdx].residency == WorldResidency_Loading;
+
+    for (const std::pair<f32, u32>& wanted : wantedCells)
+    {
+        if (loadingCount >= app->worldMaxLoadingJobs)
+            break;
+
+        const WorldCell& cell = app->worldCells[wanted.second];
+        if (cell.residency != WorldResidency_Unloaded)
+            continue;
+
+        u64 cpuBytes, gpuBytes;
+        EstimateCellBytes(app, cell, cpuBytes, gpuBytes);
+        if (app->worldCpuBytes + cpuBytes > app->worldCpuBudget || app->worldGpuBytes + gpuBytes > app->worldGpuBudget)
+            continue;
+
+        StartCellLoad(app, wanted.second);
+        loadingCount++;
+    }
+}
+
+void ShutdownWorldStreaming(App* app)
+{
+    for (WorldCell& cell : app->worldCells)
+    {
+        if (cell.load)
+        {
+            WaitForJobs(cell.load->counter);
+            delete cell.load;
+            cell.load = nullptr;
+        }
+    }
+
+    for (WorldAsset& asset : app->worldAssets)
+    {
+        if (asset.load)
+        {
+            WaitForJobs(asset.load->counter);
+            delete asset.load;
+            asset.load = nullptr;
+        }
+    }
+}
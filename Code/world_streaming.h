@@ -0,0 +1,35 @@
+//
+// world_streaming.h: Streaming of world cells around the camera. A manifest lists the cells
+// of the world; cells near the camera (or where it is heading) are loaded asynchronously,
+// parsing on the job system and uploading on the main thread, and far ones are unloaded,
+// keeping the geometry of the resident cells within CPU and GPU budgets.
+//
+// Manifest (JSON):
+//   { "cellSize": 40,
+//     "cells": [ { "x": 0, "z": 0, "file": "world/cell_0_0.json" },
+//                { "x": 1, "z": 0, "objects": [ { "model": "Patrick/Patrick.obj",
+//                                                 "position": [4, 0, 2], "scale": 1, "yaw": 90 } ] } ] }
+// Cell files hold { "objects": [...] }. Object positions are relative to the cell origin.
+//
+
+#pragma once
+
+#include "engine.h"
+
+/**
+ * Reads the manifest, only the cell list: no cell content is loaded until the camera gets
+ * close. Returns false if the file is missing or malformed.
+ */
+bool LoadWorldManifest(App* app, const char* filename);
+
+/**
+ * Picks the cells to keep from App::camera.position and its velocity, finishes the jobs
+ * that completed, uploads a few loaded models, spawns / removes the game objects of the
+ * cells and enforces the budgets. Called once per frame from Update().
+ */
+void UpdateWorldStreaming(App* app);
+
+/**
+ * Waits for the loads in flight and frees their data. Call before ShutdownJobSystem().
+ */
+void ShutdownWorldStreaming(App* app);
@@ -1,49 +1,262 @@
 ///////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////
-#ifdef TEXTURED_GEOMETRY
+#if defined(TEXTURED_GEOMETRY) || defined(IMPOSTOR) || defined(DEFERRED_LIGHTING) || defined(TILED_LIGHT_CULLING) || defined(DEPTH_PREPASS)
 
+layout(binding = 0,std140) uniform GlobalParams //Same for all game Objects
+{
+	vec3 uCameraPosition;
+	unsigned int uLightCount; // Directional lights listed in uDirectionalLights, point lights are in the clusters
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;       // Clusters along x, y (tiles on screen) and z (depth slices)
+	vec4 uClusterDepth;       // x: end of the first slice, y: slices per log unit of depth after it
+	vec4 uViewport;           // xy: size in pixels
+	uvec4 uDirectionalLights[3]; // Indices in uLights, four per element (MAX_DIRECTIONAL_LIGHTS)
+};
+
+layout(binding = 1,std140) uniform LocalParams //Per game Object
+{
+	mat4 uWorldMatrix;
+	mat4 uWorldViewProjectionMatrix;
+};
+
+#if defined(FRAGMENT) || defined(COMPUTE)
+
+// Every light, same order as App::lights (light_buffer.h)
 struct Light
 {
-	unsigned int type;
+	vec4 positionRange; // xyz: world position, w: range of point lights
 	vec3 color;
-	vec3 direction;
-	vec3 position;
+	uint shadowView;    // First of its views in uShadowViews (cascades or cube faces), NO_SHADOW if unshadowed
+	vec3 direction;     // Directional lights, the way the light travels
+	uint type;          // LightType
 };
 
+const uint LIGHT_DIRECTIONAL = 0u;
+const uint LIGHT_POINT = 1u;
 
-layout(binding = 0,std140) uniform GlobalParams //Same for all game Objects
+layout(binding = 0, std430) readonly buffer Lights { Light uLights[]; };
+
+#endif
+
+#if defined(FRAGMENT)
+
+#if defined(TILED_LIGHTS)
+// Lists of the tiled light culling (tiled_light_culling.h)
+layout(binding = 3, std430) readonly buffer TileLights { uvec2 uTileLights[]; }; // x: first index, y: count
+layout(binding = 4, std430) readonly buffer TileLightIndices { uint uTileLightIndices[]; };
+#else
+layout(binding = 1, std430) readonly buffer ClusterLights { uvec2 uClusterLights[]; }; // x: first index, y: count
+layout(binding = 2, std430) readonly buffer ClusterLightIndices { uint uClusterLightIndices[]; };
+#endif
+
+const vec3 AMBIENT_LIGHT = vec3(0.2);
+
+// Shadow atlas (shadow_atlas.h)
+struct ShadowView
 {
-	vec3 uCameraPosition;
-	unsigned int uLightCount;
-	Light uLight[10];
+	mat4 viewProjection;
+	vec4 atlasRect; // xy: offset, zw: size, in atlas uv
 };
 
+layout(binding = 5, std430) readonly buffer ShadowViews { ShadowView uShadowViews[]; };
+layout(binding = 7) uniform sampler2DShadow uShadowAtlas; // SHADOW_ATLAS_TEXTURE_UNIT
+
+const uint NO_SHADOW = 0xFFFFFFFFu;
+const float SHADOW_NORMAL_OFFSET = 0.05; // World units along the normal, against acne on grazing surfaces
+
+const uint SHADOW_CASCADE_COUNT = 4u; // SHADOW_CASCADE_COUNT
+
+// Position in the view, inside it if all in [0, 1]
+vec3 GetShadowPosition(ShadowView shadowView, vec3 position)
+{
+	vec4 clipPosition = shadowView.viewProjection * vec4(position, 1.0);
+	return clipPosition.xyz / clipPosition.w * 0.5 + 0.5;
+}
+
+bool IsInShadowView(vec3 shadowPosition)
+{
+	return all(greaterThanEqual(shadowPosition, vec3(0.0))) && all(lessThanEqual(shadowPosition, vec3(1.0)));
+}
+
+// 1 lit, 0 shadowed, filtered 2x2 by the depth comparison
+float SampleShadowView(ShadowView shadowView, vec3 shadowPosition)
+{
+	// Half a texel inside the view so the filter never reads its neighbors in the atlas
+	vec2 halfTexel = 0.5 / (shadowView.atlasRect.zw * vec2(textureSize(uShadowAtlas, 0)));
+	vec2 uv = shadowView.atlasRect.xy + clamp(shadowPosition.xy, halfTexel, 1.0 - halfTexel) * shadowView.atlasRect.zw;
+	return texture(uShadowAtlas, vec3(uv, shadowPosition.z));
+}
+
+float SampleShadow(uint view, vec3 position)
+{
+	vec3 shadowPosition = GetShadowPosition(uShadowViews[view], position);
+	return IsInShadowView(shadowPosition) ? SampleShadowView(uShadowViews[view], shadowPosition) : 1.0; // Nothing casts outside
+}
+
+// Cascades go from near to far, the first one holding the position is the sharpest. They are
+// fitted at different times, so they are picked by their bounds rather than by split depths
+float SampleCascadedShadow(uint firstView, vec3 position)
+{
+	for (uint c = 0u; c < SHADOW_CASCADE_COUNT; ++c)
+	{
+		vec3 shadowPosition = GetShadowPosition(uShadowViews[firstView + c], position);
+		if (IsInShadowView(shadowPosition))
+			return SampleShadowView(uShadowViews[firstView + c], shadowPosition);
+	}
+	return 1.0;
+}
+
+// Cube face of a point light, in the order of the views: +x, -x, +y, -y, +z, -z
+uint GetCubeFace(vec3 direction)
+{
+	vec3 a = abs(direction);
+	if (a.x >= a.y && a.x >= a.z)
+		return direction.x > 0.0 ? 0u : 1u;
+	if (a.y >= a.z)
+		return direction.y > 0.0 ? 2u : 3u;
+	return direction.z > 0.0 ? 4u : 5u;
+}
+
+#if defined(TILED_LIGHTS)
+const uint TILE_SIZE = 16u; // TILE_SIZE
+
+// First index and count of the point lights reaching the fragment
+uvec2 GetPointLightRange(vec3 position)
+{
+	uint tilesX = (uint(uViewport.x) + TILE_SIZE - 1u) / TILE_SIZE;
+	uvec2 tile = uvec2(gl_FragCoord.xy) / TILE_SIZE;
+	return uTileLights[tile.y * tilesX + tile.x];
+}
+
+uint GetPointLightIndex(uint i)
+{
+	return uTileLightIndices[i];
+}
+#else
+uint GetClusterIndex(float viewDepth)
+{
+	uint slice = 0u;
+	if (viewDepth > uClusterDepth.x)
+		slice = min(1u + uint(log(viewDepth / uClusterDepth.x) * uClusterDepth.y), uClusterGrid.z - 1u);
+
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / uViewport.xy * vec2(uClusterGrid.xy)), uClusterGrid.xy - 1u);
+	return (slice * uClusterGrid.y + tile.y) * uClusterGrid.x + tile.x;
+}
+
+// First index and count of the point lights reaching the fragment
+uvec2 GetPointLightRange(vec3 position)
+{
+	float viewDepth = -(uViewMatrix * vec4(position, 1.0)).z;
+	return uClusterLights[GetClusterIndex(viewDepth)];
+}
+
+uint GetPointLightIndex(uint i)
+{
+	return uClusterLightIndices[i];
+}
+#endif
+
+// Diffuse light reaching a surface from the directional lights and the point lights of its cluster
+// (or tile)
+vec3 ComputeLighting(vec3 position, vec3 normal)
+{
+	// Meshes without normals are lit from every direction
+	bool hasNormal = dot(normal, normal) > 1e-6;
+	vec3 N = hasNormal ? normalize(normal) : vec3(0.0);
+
+	vec3 shadowPosition = position + N * SHADOW_NORMAL_OFFSET;
+
+	vec3 light = AMBIENT_LIGHT;
+	for (uint i = 0u; i < uLightCount; ++i)
+	{
+		Light directionalLight = uLights[uDirectionalLights[i / 4u][i % 4u]];
+		float lambert = hasNormal ? max(dot(N, -directionalLight.direction), 0.0) : 1.0;
+		if (lambert > 0.0 && directionalLight.shadowView != NO_SHADOW)
+			lambert *= SampleCascadedShadow(directionalLight.shadowView, shadowPosition);
+		light += directionalLight.color * lambert;
+	}
+
+	uvec2 pointLights = GetPointLightRange(position);
+	for (uint i = 0u; i < pointLights.y; ++i)
+	{
+		Light pointLight = uLights[GetPointLightIndex(pointLights.x + i)];
+		vec3 toLight = pointLight.positionRange.xyz - position;
+		float distance = length(toLight);
+		float falloff = clamp(1.0 - distance * distance / (pointLight.positionRange.w * pointLight.positionRange.w), 0.0, 1.0);
+		float lambert = hasNormal ? max(dot(N, toLight / max(distance, 1e-4)), 0.0) : 1.0;
+		if (falloff * lambert > 0.0 && pointLight.shadowView != NO_SHADOW)
+			lambert *= SampleShadow(pointLight.shadowView + GetCubeFace(-toLight), shadowPosition);
+		light += pointLight.color * (falloff * falloff * lambert);
+	}
+
+	return light;
+}
+
+// Normals of the G-buffer (deferred_shading.h), octahedral in [0, 1]. Zero stands for no normal
+vec2 EncodeNormal(vec3 normal)
+{
+	if (dot(normal, normal) <= 1e-6)
+		return vec2(0.0);
+
+	vec3 n = normal / (abs(normal.x) + abs(normal.y) + abs(normal.z));
+	vec2 octahedral = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return max(octahedral * 0.5 + 0.5, vec2(1.0 / 65535.0));
+}
+
+vec3 DecodeNormal(vec2 encoded)
+{
+	if (encoded == vec2(0.0))
+		return vec3(0.0);
+
+	vec2 f = encoded * 2.0 - 1.0;
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Variants (shader_variants.h): INSTANCED, ALBEDO_MAP, EMISSIVE, GBUFFER. The UBER variant
+// tests ALBEDO_MAP and EMISSIVE at runtime from uFeatures (ShaderFeature bits) instead.
+///////////////////////////////////////////////////////////////////////
+#if defined(TEXTURED_GEOMETRY)
+
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
 // TODO: Write your vertex shader here
 
 layout(location=0) in vec3 aPosition;
+layout(location=1) in vec3 aNormal;
 layout(location=2) in vec2 aTexCoord;
-
-layout(binding = 1,std140) uniform LocalParams //Per game Object
-{
-	mat4 uWorldMatrix;
-	mat4 uWorldViewProjectionMatrix;
-};
+#ifdef INSTANCED
+layout(location=5) in mat4 aInstanceTransform; // Node transform, relative to the model (INSTANCE_TRANSFORM_LOCATION)
+#endif
 
 out vec2 vTexCoord;
 out vec3 vPosition;
-//out vec3 vNormal;
+out vec3 vNormal;
 //out vec3 vViewDir;
 
+invariant gl_Position; // Same depth as DEPTH_PREPASS, tested with GL_EQUAL after it
+
 void main()
 {
+	vec4 localPosition = vec4(aPosition,1.0);
+	vec4 localNormal = vec4(aNormal,0.0);
+#ifdef INSTANCED
+	localPosition = aInstanceTransform * localPosition;
+	localNormal = aInstanceTransform * localNormal;
+#endif
+
 	vTexCoord = aTexCoord;
-	vPosition = vec3(uWorldMatrix * vec4(aPosition,1.0));
-	//vNormal = vec3(uWorldMatrix * vec4(aNormal,0.0));
+	vPosition = vec3(uWorldMatrix * localPosition);
+	vNormal = vec3(uWorldMatrix * localNormal);
 
-	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition,1.0);
+	gl_Position = uWorldViewProjectionMatrix * localPosition;
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
@@ -52,23 +265,454 @@ void main()
 
 in vec2 vTexCoord;
 in vec3 vPosition;
-//in vec3 vNormal;
+in vec3 vNormal;
 //in vec3 vViewDir;
 
+// Uniforms of the features a variant doesn't have are optimized out
 uniform sampler2D uTexture;
+uniform vec4 uAlbedoUvTransform; // xy: scale, zw: offset (textures packed in the atlas)
+uniform vec3 uAlbedo;
+uniform vec3 uEmissive;
+
+#if defined(UBER)
+uniform uint uFeatures;
+#define HAS_ALBEDO_MAP ((uFeatures & 2u) != 0u) // ShaderFeature_AlbedoMap
+#define HAS_EMISSIVE   ((uFeatures & 4u) != 0u) // ShaderFeature_Emissive
+#else
+#if defined(ALBEDO_MAP)
+#define HAS_ALBEDO_MAP true
+#else
+#define HAS_ALBEDO_MAP false
+#endif
+#if defined(EMISSIVE)
+#define HAS_EMISSIVE true
+#else
+#define HAS_EMISSIVE false
+#endif
+#endif
 
+#if defined(GBUFFER)
+layout(location=0) out vec4 oAlbedo;
+layout(location=1) out vec2 oNormal;
+layout(location=2) out vec4 oColor; // Emissive, lit by DEFERRED_LIGHTING
+#else
 layout(location=0) out vec4 oColor;
+#endif
 
 void main()
 {
-	oColor = texture(uTexture,vTexCoord);
-	oColor += vec4(uLight[0].color,1.0);
+	vec4 albedo;
+	if (HAS_ALBEDO_MAP)
+	{
+		vec2 albedoUv = clamp(vTexCoord, 0.0, 1.0) * uAlbedoUvTransform.xy + uAlbedoUvTransform.zw;
+		albedo = texture(uTexture,albedoUv);
+	}
+	else
+	{
+		albedo = vec4(uAlbedo,1.0);
+	}
+	vec3 emissive = HAS_EMISSIVE ? uEmissive : vec3(0.0);
+
+#if defined(GBUFFER)
+	oAlbedo = albedo;
+	oNormal = EncodeNormal(vNormal);
+	oColor = vec4(emissive, 1.0);
+#else
+	oColor = albedo;
+	oColor.rgb *= ComputeLighting(vPosition, vNormal);
+	oColor.rgb += emissive;
+#endif
 }
 
 #endif
 #endif
 
 
+///////////////////////////////////////////////////////////////////////
+// Octahedral impostors: frames are laid out on a hemi-octahedron, frame (x,y) of an NxN atlas
+// holds the view from the direction decoded from (x,y)/(N-1). The basis of each view keeps
+// the model up axis pointing up (ImpostorBasis() in impostor.cpp).
+///////////////////////////////////////////////////////////////////////
+#if defined(IMPOSTOR_BAKE) || defined(IMPOSTOR_BAKE_INSTANCED)
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+layout(location=1) in vec3 aNormal;
+layout(location=2) in vec2 aTexCoord;
+#ifdef IMPOSTOR_BAKE_INSTANCED
+layout(location=5) in mat4 aInstanceTransform;
+#endif
+
+uniform mat4 uViewProjection; // Orthographic view of the frame, from model space
+
+out vec2 vTexCoord;
+out vec3 vPosition; // Model space
+out vec3 vNormal;
+
+void main()
+{
+	vec4 localPosition = vec4(aPosition,1.0);
+	vec3 localNormal = aNormal;
+#ifdef IMPOSTOR_BAKE_INSTANCED
+	localPosition = aInstanceTransform * localPosition;
+	localNormal = mat3(aInstanceTransform) * localNormal;
+#endif
+
+	vTexCoord = aTexCoord;
+	vPosition = localPosition.xyz;
+	vNormal = localNormal;
+
+	gl_Position = uViewProjection * localPosition;
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+in vec2 vTexCoord;
+in vec3 vPosition;
+in vec3 vNormal;
+
+uniform sampler2D uTexture;
+uniform vec4 uAlbedoUvTransform;
+uniform vec3 uViewDirection; // Model space, towards the viewer
+uniform vec4 uBounds;        // xyz: center, w: radius
+
+layout(location=0) out vec4 oAlbedo;
+layout(location=1) out vec4 oNormalDepth;
+
+void main()
+{
+	vec2 albedoUv = clamp(vTexCoord, 0.0, 1.0) * uAlbedoUvTransform.xy + uAlbedoUvTransform.zw;
+	oAlbedo = vec4(texture(uTexture,albedoUv).rgb, 1.0);
+
+	float depth = dot(vPosition - uBounds.xyz, uViewDirection) / uBounds.w;
+	oNormalDepth = vec4(normalize(vNormal) * 0.5 + 0.5, depth * 0.5 + 0.5);
+}
+
+#endif
+#endif
+
+#ifdef IMPOSTOR
+
+uniform vec4 uBounds;    // Impostor::boundsCenter, boundsRadius
+uniform int  uFrameCount;
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+out vec2 vFrameUv;              // Position inside a frame
+flat out vec2 vFrameCoord;      // View direction in frames, fractional
+out vec4 vClipPosition;
+out vec4 vClipOffset;           // Clip space move of one radius towards the viewer
+
+vec2 EncodeHemiOctahedron(vec3 direction)
+{
+	vec2 p = direction.xz / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+	return vec2(p.x + p.y, p.x - p.y) * 0.5 + 0.5;
+}
+
+void main()
+{
+	// View direction in model space, the frames only cover the upper hemisphere
+	vec3 camera = vec3(inverse(uWorldMatrix) * vec4(uCameraPosition,1.0));
+	vec3 viewDirection = camera - uBounds.xyz;
+	viewDirection.y = max(viewDirection.y, 0.0);
+	viewDirection = dot(viewDirection,viewDirection) > 0.0 ? normalize(viewDirection) : vec3(0.0,0.0,1.0);
+
+	vec3 right = cross(vec3(0.0,1.0,0.0), viewDirection);
+	right = dot(right,right) > 1e-6 ? normalize(right) : vec3(1.0,0.0,0.0);
+	vec3 up = cross(viewDirection, right);
+
+	// Camera facing quad drawn as a strip, corners from the vertex id
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+	vec3 localPosition = uBounds.xyz + (corner.x * right + corner.y * up) * uBounds.w;
+
+	vClipPosition = uWorldViewProjectionMatrix * vec4(localPosition,1.0);
+	vClipOffset = uWorldViewProjectionMatrix * vec4(viewDirection * uBounds.w, 0.0);
+	vFrameUv = corner * 0.5 + 0.5;
+	vFrameCoord = EncodeHemiOctahedron(viewDirection) * float(uFrameCount - 1);
+
+	gl_Position = vClipPosition;
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+in vec2 vFrameUv;
+flat in vec2 vFrameCoord;
+in vec4 vClipPosition;
+in vec4 vClipOffset;
+
+uniform sampler2D uAlbedo;
+uniform sampler2D uNormalDepth;
+
+#if defined(GBUFFER)
+layout(location=0) out vec4 oAlbedo;
+layout(location=1) out vec2 oNormal;
+layout(location=2) out vec4 oColor;
+#else
+layout(location=0) out vec4 oColor;
+#endif
+
+void main()
+{
+	// Blend the four frames around the view direction
+	vec2 baseFrame = min(floor(vFrameCoord), vec2(uFrameCount - 2));
+	vec2 blend = clamp(vFrameCoord - baseFrame, 0.0, 1.0);
+
+	vec4 albedo = vec4(0.0);
+	vec3 normal = vec3(0.0);
+	float depth = 0.0;
+	for (int i = 0; i < 4; ++i)
+	{
+		vec2 frame = baseFrame + vec2(i & 1, i >> 1);
+		vec2 weights = mix(1.0 - blend, blend, vec2(i & 1, i >> 1));
+		vec2 uv = (frame + vFrameUv) / float(uFrameCount);
+
+		vec4 frameAlbedo = texture(uAlbedo, uv) * (weights.x * weights.y);
+		vec4 frameNormalDepth = texture(uNormalDepth, uv);
+		albedo += frameAlbedo;
+		normal += (frameNormalDepth.xyz * 2.0 - 1.0) * frameAlbedo.a;
+		depth += frameNormalDepth.w * frameAlbedo.a;
+	}
+
+	if (albedo.a < 0.5)
+		discard;
+
+	// Push the depth back onto the baked surface so impostors intersect the scene properly
+	depth = depth / albedo.a * 2.0 - 1.0;
+	vec4 clipPosition = vClipPosition + vClipOffset * depth;
+	gl_FragDepth = clipPosition.z / clipPosition.w * 0.5 + 0.5;
+
+#if defined(GBUFFER)
+	oAlbedo = vec4(albedo.rgb / albedo.a, 1.0);
+	oNormal = EncodeNormal(mat3(uWorldMatrix) * normal);
+	oColor = vec4(0.0, 0.0, 0.0, 1.0);
+#else
+	// Lit at the model center, close enough at the distances impostors are drawn
+	vec3 position = vec3(uWorldMatrix * vec4(uBounds.xyz,1.0));
+	oColor = vec4(albedo.rgb / albedo.a, 1.0);
+	oColor.rgb *= ComputeLighting(position, mat3(uWorldMatrix) * normal);
+#endif
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Lighting pass of Mode_Deferred: once per pixel covered by the G-buffer, added to the
+// emissive already in the color attachment. Positions come back from depth.
+///////////////////////////////////////////////////////////////////////
+#ifdef DEFERRED_LIGHTING
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+layout(location=1) in vec2 aTexCoord;
+
+out vec2 vTexCoord;
+
+void main()
+{
+	vTexCoord = aTexCoord;
+	gl_Position = vec4(aPosition,1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+in vec2 vTexCoord;
+
+uniform sampler2D uAlbedo;
+uniform sampler2D uNormal;
+uniform sampler2D uDepth;
+uniform mat4 uInverseViewProjection;
+
+layout(location=0) out vec4 oColor;
+
+void main()
+{
+	float depth = texture(uDepth, vTexCoord).r;
+	if (depth == 1.0)
+		discard; // Background
+
+	vec4 ndcPosition = vec4(vec3(vTexCoord, depth) * 2.0 - 1.0, 1.0);
+	vec4 worldPosition = uInverseViewProjection * ndcPosition;
+	vec3 position = worldPosition.xyz / worldPosition.w;
+
+	vec3 albedo = texture(uAlbedo, vTexCoord).rgb;
+	vec3 normal = DecodeNormal(texture(uNormal, vTexCoord).rg);
+	oColor = vec4(albedo * ComputeLighting(position, normal), 0.0);
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Tiled light culling (tiled_light_culling.h): one work group per tile, the depth range of the
+// tile is reduced in shared memory, then its threads test the point lights in parallel.
+///////////////////////////////////////////////////////////////////////
+#ifdef TILED_LIGHT_CULLING
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+#define TILE_SIZE 16            // TILE_SIZE
+#define MAX_LIGHTS_PER_TILE 256 // MAX_LIGHTS_PER_TILE
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(binding = 3, std430) writeonly buffer TileLights { uvec2 uTileLights[]; };
+layout(binding = 4, std430) writeonly buffer TileLightIndices { uint uTileLightIndices[]; };
+
+uniform sampler2D uDepth;
+uniform mat4 uInverseProjection;
+
+// View depths are positive, their bits sort like the floats
+shared uint sMinDepth;
+shared uint sMaxDepth;
+shared uint sLightCount;
+
+vec3 UnprojectFar(vec2 pixel)
+{
+	vec4 position = uInverseProjection * vec4(pixel / uViewport.xy * 2.0 - 1.0, 1.0, 1.0);
+	return position.xyz / position.w;
+}
+
+void main()
+{
+	if (gl_LocalInvocationIndex == 0u)
+	{
+		sMinDepth = 0x7F7FFFFFu;
+		sMaxDepth = 0u;
+		sLightCount = 0u;
+	}
+	barrier();
+
+	ivec2 pixel = min(ivec2(gl_GlobalInvocationID.xy), ivec2(uViewport.xy) - 1);
+	float depth = texelFetch(uDepth, pixel, 0).r;
+	if (depth < 1.0)
+	{
+		vec4 viewPosition = uInverseProjection * vec4(0.0, 0.0, depth * 2.0 - 1.0, 1.0);
+		uint viewDepth = floatBitsToUint(-viewPosition.z / viewPosition.w);
+		atomicMin(sMinDepth, viewDepth);
+		atomicMax(sMaxDepth, viewDepth);
+	}
+	barrier();
+
+	uint tilesX = gl_NumWorkGroups.x;
+	uint tileIdx = gl_WorkGroupID.y * tilesX + gl_WorkGroupID.x;
+	uint firstIdx = tileIdx * uint(MAX_LIGHTS_PER_TILE);
+
+	// Nothing but background in the tile
+	if (sMaxDepth != 0u)
+	{
+		float minDepth = uintBitsToFloat(sMinDepth);
+		float maxDepth = uintBitsToFloat(sMaxDepth);
+
+		// Side planes of the tile frustum through the eye, normals pointing inside
+		vec2 tileMin = vec2(gl_WorkGroupID.xy * uint(TILE_SIZE));
+		vec2 tileMax = min(tileMin + float(TILE_SIZE), uViewport.xy);
+		vec3 leftBottom = UnprojectFar(tileMin);
+		vec3 leftTop = UnprojectFar(vec2(tileMin.x, tileMax.y));
+		vec3 rightBottom = UnprojectFar(vec2(tileMax.x, tileMin.y));
+		vec3 rightTop = UnprojectFar(tileMax);
+		vec3 planes[4] = vec3[4](normalize(cross(leftBottom, leftTop)), normalize(cross(rightTop, rightBottom)),
+		                         normalize(cross(rightBottom, leftBottom)), normalize(cross(leftTop, rightTop)));
+
+		// The whole light buffer, its unused tail is zero (directional)
+		uint lightCount = uint(uLights.length());
+		for (uint i = gl_LocalInvocationIndex; i < lightCount; i += uint(TILE_SIZE * TILE_SIZE))
+		{
+			if (uLights[i].type != LIGHT_POINT)
+				continue;
+
+			vec4 positionRange = uLights[i].positionRange;
+			vec3 center = vec3(uViewMatrix * vec4(positionRange.xyz, 1.0));
+			float range = positionRange.w;
+
+			bool inside = -center.z + range >= minDepth && -center.z - range <= maxDepth;
+			for (int p = 0; p < 4 && inside; ++p)
+				inside = dot(planes[p], center) >= -range;
+
+			if (inside)
+			{
+				uint slot = atomicAdd(sLightCount, 1u);
+				if (slot < uint(MAX_LIGHTS_PER_TILE))
+					uTileLightIndices[firstIdx + slot] = i;
+			}
+		}
+	}
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0u)
+		uTileLights[tileIdx] = uvec2(firstIdx, min(sLightCount, uint(MAX_LIGHTS_PER_TILE)));
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Depth of the game objects before shading them (depth_prepass.h). Same position
+// as TEXTURED_GEOMETRY, computed the same way so GL_EQUAL passes on the visible surfaces
+///////////////////////////////////////////////////////////////////////
+#ifdef DEPTH_PREPASS
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+#ifdef INSTANCED
+layout(location=5) in mat4 aInstanceTransform; // INSTANCE_TRANSFORM_LOCATION
+#endif
+
+invariant gl_Position;
+
+void main()
+{
+	vec4 localPosition = vec4(aPosition,1.0);
+#ifdef INSTANCED
+	localPosition = aInstanceTransform * localPosition;
+#endif
+	gl_Position = uWorldViewProjectionMatrix * localPosition;
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+void main()
+{
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Depth of the shadow casters into the shadow atlas (shadow_atlas.h)
+///////////////////////////////////////////////////////////////////////
+#ifdef SHADOW_DEPTH
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+#ifdef INSTANCED
+layout(location=5) in mat4 aInstanceTransform; // INSTANCE_TRANSFORM_LOCATION
+#endif
+
+uniform mat4 uWorldViewProjection; // Of the light view
+
+void main()
+{
+	vec4 localPosition = vec4(aPosition,1.0);
+#ifdef INSTANCED
+	localPosition = aInstanceTransform * localPosition;
+#endif
+	gl_Position = uWorldViewProjection * localPosition;
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+void main()
+{
+}
+
+#endif
+#endif
+
 // NOTE: You can write several shaders in the same file if you want as
 // long as you embrace them within an #ifdef block (as you can see above).
 // The third parameter of the LoadProgram function in engine.cpp allows